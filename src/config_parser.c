@@ -39,11 +39,16 @@
 #include "cpufreq_utils.h"
 #include "cpufreqd_log.h"
 #include "plugin_utils.h"
+#include "sampler.h"
 
 static struct cpufreqd_conf default_configuration = {
 	.config_file		= CPUFREQD_CONFDIR "cpufreqd.conf",
 	.pidfile		= CPUFREQD_STATEDIR "cpufreqd.pid",
 	.poll_intv		= { .tv_sec = DEFAULT_POLL, .tv_usec = 0 },
+	.ramp_interval		= 0,
+	.ramp_step		= 1,
+	.state_file		= "",
+	.state_interval		= DEFAULT_STATE_INTERVAL,
 	.has_sysfs		= 1,
 	.no_daemon		= 0,
 	.log_level_overridden	= 0,
@@ -186,6 +191,29 @@ static int parse_config_general (FILE *fconfig, struct cpufreqd_conf *config) {
 			continue;
 		}
 
+		if (strcmp(name,"ramp_interval") == 0) {
+			config->ramp_interval = value != NULL ? (unsigned int)atoi(value) : 0;
+			if (config->ramp_interval != 0
+					&& config->ramp_interval < SAMPLER_MIN_INTERVAL) {
+				clog(LOG_WARNING, "WARNING! ramp_interval has too low value "
+						"(%u), using %ums.\n", config->ramp_interval,
+						SAMPLER_MIN_INTERVAL);
+				config->ramp_interval = SAMPLER_MIN_INTERVAL;
+			}
+			clog(LOG_INFO, "ramp_interval is %ums\n", config->ramp_interval);
+			continue;
+		}
+
+		if (strcmp(name,"ramp_step") == 0) {
+			config->ramp_step = value != NULL ? (unsigned int)atoi(value) : 1;
+			if (config->ramp_step == 0) {
+				clog(LOG_WARNING, "WARNING! ramp_step has invalid value, "
+						"using 1.\n");
+				config->ramp_step = 1;
+			}
+			continue;
+		}
+
 		if (strcmp(name,"verbosity") == 0) {
 			if (config->log_level_overridden) {
 				clog(LOG_DEBUG, "skipping \"verbosity\", "
@@ -227,6 +255,20 @@ static int parse_config_general (FILE *fconfig, struct cpufreqd_conf *config) {
 			continue;
 		}
 
+		if (strcmp(name,"state_file") == 0) {
+			if (value != NULL)
+				strncpy(config->state_file, value, MAX_PATH_LEN);
+			else
+				config->state_file[0] = '\0';
+			config->state_file[MAX_PATH_LEN - 1] = '\0';
+			continue;
+		}
+
+		if (strcmp(name,"state_interval") == 0) {
+			config->state_interval = value != NULL ? (unsigned int)atoi(value) : 0;
+			continue;
+		}
+
 		if (strcmp(name,"double_check") == 0) {
 			if (value != NULL) {
 				config->double_check = atoi (value);
@@ -276,6 +318,26 @@ static int parse_config_general (FILE *fconfig, struct cpufreqd_conf *config) {
 	return 0;
 }
 
+/*
+ * appends line to the section text in *source, used on reload to
+ * tell the Rules and Profiles that didn't change
+ *
+ * Returns -1 if there's no room left, 0 otherwise
+ */
+static int append_source(char **source, const char *line) {
+	size_t len = *source != NULL ? strlen(*source) : 0;
+	char *tmp = realloc(*source, len + strlen(line) + 2);
+
+	if (tmp == NULL) {
+		clog(LOG_ERR, "cannot make enough room for the section text (%s).\n",
+				strerror(errno));
+		return -1;
+	}
+	sprintf(tmp + len, "%s\n", line);
+	*source = tmp;
+	return 0;
+}
+
 /*
  * parse a [Profile] section
  *
@@ -287,8 +349,9 @@ static int parse_config_general (FILE *fconfig, struct cpufreqd_conf *config) {
 #define HAS_POLICY  (1<<3)
 #define HAS_CPU     (1<<4)
 static int parse_config_profile (FILE *config, struct profile *p, struct LIST *plugins,
-		struct cpufreq_limits *limits, struct cpufreq_available_frequencies *freq) {
+		struct cpufreq_limits *limits, struct cpufreq_sys_info *sys_info) {
 	int state = 0, min_is_percent = 0, max_is_percent = 0, tmp_freq = 0;
+	unsigned int cpu = 0;
 	struct NODE *dir = NULL;
 	void *obj = NULL; /* to hold the value provided by a plugin */
 	struct cpufreqd_keyword *ckw = NULL;
@@ -321,6 +384,9 @@ static int parse_config_profile (FILE *config, struct profile *p, struct LIST *p
 			break;
 		}
 
+		if (append_source(&p->source, clean) < 0)
+			return -1;
+
 		name = strtok(clean, "=");
 		value = strtok(NULL, "");
 
@@ -432,22 +498,23 @@ static int parse_config_profile (FILE *config, struct profile *p, struct LIST *p
 
 	/* validate and normalize frequencies */
 	if (limits) {
+		/* the Profile cpu ones, CPU0 ones if not given.
+		 * Offline cpus are probed only when they come back
+		 */
+		if (state & HAS_CPU && p->cpu < cpufreqd_info->cpus
+				&& limits[p->cpu].max != 0)
+			cpu = p->cpu;
 		/* calculate actual frequncies if percent where given frequencies */
-		if (state & HAS_CPU) {
-			if (min_is_percent)
-				p->policy.min = percent_to_absolute(limits[p->cpu].max, p->policy.min);
-			if (max_is_percent)
-				p->policy.max = percent_to_absolute(limits[p->cpu].max, p->policy.max);
-		} else {
-			if (min_is_percent)
-				p->policy.min = percent_to_absolute(limits[0].max, p->policy.min);
-			if (max_is_percent)
-				p->policy.max = percent_to_absolute(limits[0].max, p->policy.max);
-		}
+		if (min_is_percent)
+			p->policy.min = percent_to_absolute(limits[cpu].max, p->policy.min);
+		if (max_is_percent)
+			p->policy.max = percent_to_absolute(limits[cpu].max, p->policy.max);
 		/* normalize frequencies if such informations are available */
-		if (freq) {
-			p->policy.max = normalize_frequency(limits, freq, p->policy.max);
-			p->policy.min = normalize_frequency(limits, freq, p->policy.min);
+		if (sys_info[cpu].table) {
+			p->policy.max = normalize_frequency(&limits[cpu],
+					sys_info[cpu].table, p->policy.max);
+			p->policy.min = normalize_frequency(&limits[cpu],
+					sys_info[cpu].table, p->policy.min);
 		}
 	} else {
 		if (min_is_percent | max_is_percent) {
@@ -509,6 +576,9 @@ static int parse_config_rule (FILE *config, struct rule *r, struct LIST *plugins
 			break;
 		}
 
+		if (append_source(&r->source, clean) < 0)
+			return -1;
+
 		name = strtok(clean, "=");
 		value = strtok(NULL, "");
 
@@ -572,9 +642,10 @@ static int parse_config_rule (FILE *config, struct rule *r, struct LIST *plugins
 	return 0;
 }
 
-/* Handles the configuration section for a given plugin
+/* Handles the configuration section for a given plugin,
+ * skip only reads past it
  */
-static void configure_plugin(FILE *config, struct plugin_obj *plugin) {
+static void configure_plugin(FILE *config, struct plugin_obj *plugin, int skip) {
 	char endtag[MAX_STRING_LEN];
 	char buf[MAX_STRING_LEN];
 	fpos_t pos;
@@ -608,7 +679,7 @@ static void configure_plugin(FILE *config, struct plugin_obj *plugin) {
 		 * simply skip this option.
 		 * Will spit a lout warning later.
 		 */
-		if (plugin->configured)
+		if (plugin->configured || skip)
 			continue;
 
 		name = strtok(clean, "=");
@@ -619,7 +690,10 @@ static void configure_plugin(FILE *config, struct plugin_obj *plugin) {
 					plugin->plugin->plugin_name, name);
 		}
 	}
-	if (plugin->configured) {
+	if (skip) {
+		clog(LOG_INFO, "plugin \"%s\" section unchanged until restart.\n",
+				plugin->plugin->plugin_name);
+	} else if (plugin->configured) {
 		clog(LOG_WARNING, "plugin \"%s\" already configured, "
 				"skipped full duplicate section.\n",
 				plugin->plugin->plugin_name);
@@ -628,12 +702,40 @@ static void configure_plugin(FILE *config, struct plugin_obj *plugin) {
 	}
 }
 
-/* intialize the cpufreqd_conf object
- * by reading the configuration file
+/* frees what a Profile holds, not the Profile itself */
+static void free_profile(struct profile *p) {
+	struct directive *tmp_directive;
+
+	free(p->policy.governor);
+	LIST_FOREACH_NODE(node, &p->directives) {
+		tmp_directive = (struct directive *) node->content;
+		free_keyword_object(tmp_directive->keyword, tmp_directive->obj);
+	}
+	list_free_sublist(&p->directives, p->directives.first);
+	free(p->source);
+}
+
+/* frees what a Rule holds, not the Rule itself */
+static void free_rule(struct rule *r) {
+	struct directive *tmp_directive;
+
+	LIST_FOREACH_NODE(node, &r->directives) {
+		tmp_directive = (struct directive *) node->content;
+		free_keyword_object(tmp_directive->keyword, tmp_directive->obj);
+	}
+	list_free_sublist(&r->directives, r->directives.first);
+	if (r->prof)
+		free(r->prof);
+	cpumask_free(r->assigned_cpus);
+	free(r->source);
+}
+
+/* reads Rules and Profiles from fp_config into config,
+ * on reload the plugins are already loaded and configured
  */
-int init_configuration(struct cpufreqd_conf *config)
+static int read_configuration(FILE *fp_config, struct cpufreqd_conf *config,
+		int reload)
 {
-	FILE *fp_config = NULL;
 	struct NODE *n = NULL;
 	struct profile *tmp_profile = NULL;
 	struct rule *tmp_rule = NULL;
@@ -641,21 +743,9 @@ int init_configuration(struct cpufreqd_conf *config)
 	char *clean = NULL;
 	char buf[256];
 	unsigned int i = 0;
-	int plugins_post_confed = 0; /* did I already run post_conf for all? */
+	int plugins_post_confed = reload; /* did I already run post_conf for all? */
 	struct cpufreqd_info *cinfo = cpufreqd_info;
 
-	/* configuration file */
-	clog(LOG_INFO, "reading configuration file %s\n", config->config_file);
-	fp_config = fopen(config->config_file, "r");
-	if (!fp_config) {
-		clog(LOG_ERR, "%s: %s\n", config->config_file, strerror(errno));
-		return -1;
-	}
-
-	/* read and initialize plugins */
-	discover_plugins(&config->plugins);
-	load_plugin_list(&config->plugins);
-
 	while (!feof(fp_config)) {
 
 		*buf = '\0';
@@ -667,10 +757,8 @@ int init_configuration(struct cpufreqd_conf *config)
 		/* if General scan general options */
 		if (strstr(clean,"[General]")) {
 
-			if (parse_config_general(fp_config, config) < 0) {
-				fclose(fp_config);
+			if (parse_config_general(fp_config, config) < 0)
 				return -1;
-			}
 			continue;
 		}
 
@@ -686,7 +774,6 @@ int init_configuration(struct cpufreqd_conf *config)
 			if (n == NULL) {
 				clog(LOG_ERR, "cannot make enough room for a new Profile (%s)\n",
 						strerror(errno));
-				fclose(fp_config);
 				return -1;
 			}
 			/* create governor string */
@@ -695,16 +782,15 @@ int init_configuration(struct cpufreqd_conf *config)
 				clog(LOG_ERR, "cannot make enough room for a new Profile governor (%s)\n",
 						strerror(errno));
 				node_free(n);
-				fclose(fp_config);
 				return -1;
 			}
 
 			if (parse_config_profile(fp_config, tmp_profile, &config->plugins,
-					cinfo->limits, cinfo->sys_info->frequencies) < 0) {
+					cinfo->limits, cinfo->sys_info) < 0) {
 				clog(LOG_CRIT, "[Profile] error parsing %s, see logs for details.\n",
 						config->config_file);
+				free_profile(tmp_profile);
 				node_free(n);
-				fclose(fp_config);
 				return -1;
 			}
 			/* checks duplicate names */
@@ -714,6 +800,7 @@ int init_configuration(struct cpufreqd_conf *config)
 					continue;
 				clog(LOG_CRIT, "[Profile] name \"%s\" already exists. Skipped\n",
 						tmp_profile->name);
+				free_profile(tmp_profile);
 				node_free(n);
 				n = NULL;
 				break;
@@ -736,15 +823,14 @@ int init_configuration(struct cpufreqd_conf *config)
 			if (n == NULL) {
 				clog(LOG_ERR, "cannot make enough room for a new Rule (%s)\n",
 						strerror(errno));
-				fclose(fp_config);
 				return -1;
 			}
 			tmp_rule = (struct rule *)n->content;
 			if (parse_config_rule(fp_config, tmp_rule, &config->plugins) < 0) {
 				clog(LOG_CRIT, "[Rule] error parsing %s, see logs for details.\n",
 						config->config_file);
+				free_rule(tmp_rule);
 				node_free(n);
-				fclose(fp_config);
 				return -1;
 			}
 
@@ -752,6 +838,7 @@ int init_configuration(struct cpufreqd_conf *config)
 			if (LIST_EMPTY(&tmp_rule->directives)) {
 				clog(LOG_CRIT, "[Rule] name \"%s\" has no options. Discarded.\n",
 						tmp_rule->name);
+				free_rule(tmp_rule);
 				node_free(n);
 				continue;
 			}
@@ -763,6 +850,7 @@ int init_configuration(struct cpufreqd_conf *config)
 
 				clog(LOG_ERR, "[Rule] name \"%s\" already exists. Skipped\n",
 						tmp_rule->name);
+				free_rule(tmp_rule);
 				node_free(n);
 				n = NULL;
 				break;
@@ -775,13 +863,12 @@ int init_configuration(struct cpufreqd_conf *config)
 
 		/* try match a plugin name (case insensitive) */
 		if ((plugin = plugin_handle_section(clean, &config->plugins)) != NULL) {
-			configure_plugin(fp_config, plugin);
+			configure_plugin(fp_config, plugin, reload);
 			continue;
 		}
 		clog(LOG_WARNING, "Unknown %s: nobody handles it.\n", clean);
 
 	} /* end while */
-	fclose(fp_config);
 
 	/* did I read something?
 	 * check if I read at least one rule, otherwise exit
@@ -808,7 +895,8 @@ int init_configuration(struct cpufreqd_conf *config)
 
 		/* this allocation can result being very piggy in large SMP systems */
 		tmp_rule->prof = calloc(cinfo->cpus, sizeof(struct profile *));
-		if (tmp_rule->prof == NULL) {
+		tmp_rule->assigned_cpus = cpumask_new(cinfo->cpus);
+		if (tmp_rule->prof == NULL || tmp_rule->assigned_cpus == NULL) {
 			clog(LOG_CRIT, "ERROR! couldn't make room for the Rule/Profile "
 					" association, exiting.\n");
 			return -1;
@@ -834,8 +922,11 @@ int init_configuration(struct cpufreqd_conf *config)
 				LIST_FOREACH_NODE(node1, &config->profiles) {
 					tmp_profile = (struct profile *)node1->content;
 					if (strcmp(profile_name, tmp_profile->name) == 0) {
-						for (i = 0; i < cinfo->cpus; i++)
-							tmp_rule->prof[i] = tmp_profile;
+						for (i = 0; i < cinfo->cpus; i++) {
+							/* CPU%d:profile wins whatever the order */
+							if (!cpumask_test(tmp_rule->assigned_cpus, i))
+								tmp_rule->prof[i] = tmp_profile;
+						}
 						profile_found = 1;
 						break;
 					}
@@ -853,7 +944,7 @@ int init_configuration(struct cpufreqd_conf *config)
 
 				strncpy(profile_name, strstr(token, ":") + 1, MAX_STRING_LEN);
 				cpu_num = atoi(token + 3);
-				if (profile_name[0]) {
+				if (!profile_name[0]) {
 					clog(LOG_ERR, "Wrong format for Profile name \"%s\".\n",
 							token);
 					return -1;
@@ -870,14 +961,14 @@ int init_configuration(struct cpufreqd_conf *config)
 					/* go through profiles */
 					if (strcmp(profile_name, tmp_profile->name) == 0) {
 						/* bail out if the rule has a profile already for that CPU */
-						if (tmp_rule->assigned_cpus & cpu_num) {
+						if (cpumask_test(tmp_rule->assigned_cpus, cpu_num)) {
 							clog(LOG_ERR, "Rule \"%s\" has a Profile for "
 									"CPU%d already, exiting\n",
 									tmp_rule->name, cpu_num);
 							return -1;
 						}
 						tmp_rule->prof[cpu_num] = tmp_profile;
-						tmp_rule->assigned_cpus |= 1 << cpu_num;
+						cpumask_set(tmp_rule->assigned_cpus, cpu_num);
 						break;
 					}
 					tmp_profile = NULL;
@@ -908,28 +999,189 @@ int init_configuration(struct cpufreqd_conf *config)
 	return 0;
 }
 
-/*
- * Frees the structures allocated.
+/* intialize the cpufreqd_conf object
+ * by reading the configuration file
  */
-void free_configuration(struct cpufreqd_conf *config)
+int init_configuration(struct cpufreqd_conf *config)
 {
-	struct rule *tmp_rule;
-	struct profile *tmp_profile;
-	struct directive *tmp_directive;
+	FILE *fp_config = NULL;
+	int ret = 0;
+
+	/* configuration file */
+	clog(LOG_INFO, "reading configuration file %s\n", config->config_file);
+	fp_config = fopen(config->config_file, "r");
+	if (!fp_config) {
+		clog(LOG_ERR, "%s: %s\n", config->config_file, strerror(errno));
+		return -1;
+	}
+
+	/* read and initialize plugins */
+	discover_plugins(&config->plugins);
+	load_plugin_list(&config->plugins);
+
+	ret = read_configuration(fp_config, config, 0);
+	fclose(fp_config);
+	return ret;
+}
+
+/* counts again the directives each plugin handles */
+static void count_plugin_usage(struct cpufreqd_conf *config) {
 	struct plugin_obj *o_plugin;
+	struct directive *d;
 
+	LIST_FOREACH_NODE(node, &config->plugins) {
+		o_plugin = (struct plugin_obj *) node->content;
+		o_plugin->used = 0;
+		LIST_FOREACH_NODE(node1, &config->rules) {
+			LIST_FOREACH_NODE(node2, &((struct rule *) node1->content)->directives) {
+				d = (struct directive *) node2->content;
+				o_plugin->used += d->plugin == o_plugin->plugin;
+			}
+		}
+		LIST_FOREACH_NODE(node1, &config->profiles) {
+			LIST_FOREACH_NODE(node2, &((struct profile *) node1->content)->directives) {
+				d = (struct directive *) node2->content;
+				o_plugin->used += d->plugin == o_plugin->plugin;
+			}
+		}
+	}
+}
+
+/*
+ * Reads the configuration file again into a new cpufreqd_conf object,
+ * sharing the plugins loaded for config. Plugin sections are skipped,
+ * the [General] options missing go back to their default.
+ *
+ * Returns NULL if the file can't be read or isn't valid, config is
+ * still usable.
+ */
+struct cpufreqd_conf *reload_configuration(struct cpufreqd_conf *config)
+{
+	FILE *fp_config = NULL;
+	struct cpufreqd_conf *new = NULL;
+	int ret = 0;
+
+	clog(LOG_INFO, "reading configuration file %s\n", config->config_file);
+	fp_config = fopen(config->config_file, "r");
+	if (!fp_config) {
+		clog(LOG_ERR, "%s: %s\n", config->config_file, strerror(errno));
+		return NULL;
+	}
+
+	new = malloc(sizeof(struct cpufreqd_conf));
+	if (new == NULL) {
+		clog(LOG_ERR, "cannot make enough room for a new configuration (%s)\n",
+				strerror(errno));
+		fclose(fp_config);
+		return NULL;
+	}
+	memcpy(new, config, sizeof(struct cpufreqd_conf));
+	new->rules.first = new->rules.last = NULL;
+	new->profiles.first = new->profiles.last = NULL;
+	new->poll_intv.tv_usec = 0;
+	new->poll_intv.tv_sec = DEFAULT_POLL;
+	new->double_check = 0;
+	new->ramp_interval = 0;
+	new->ramp_step = 1;
+	new->state_file[0] = '\0';
+	new->state_interval = DEFAULT_STATE_INTERVAL;
+	if (!new->log_level_overridden)
+		new->log_level = DEFAULT_VERBOSITY;
+
+	ret = read_configuration(fp_config, new, 1);
+	fclose(fp_config);
+	if (ret < 0) {
+		discard_configuration(new);
+		/* what the new Rules and Profiles counted */
+		count_plugin_usage(config);
+		return NULL;
+	}
+	return new;
+}
+
+/*
+ * Moves the Rules, Profiles and [General] options of new into config.
+ * Rules and Profiles whose section didn't change are kept from config
+ * along with the plugin objects they hold, the replaced ones are left
+ * in new to be discarded. Plugins and the options that need a restart
+ * (pidfile, enable_remote, remote_group) are untouched.
+ */
+void swap_configuration(struct cpufreqd_conf *config, struct cpufreqd_conf *new)
+{
+	struct NODE *n = NULL, *next = NULL;
+	struct profile *tmp_profile = NULL, **tmp_prof = NULL;
+	struct rule *tmp_rule = NULL;
+	struct cpumask *tmp_mask = NULL;
+	struct LIST tmp_list;
+	unsigned int i = 0;
+
+	for (n = new->profiles.first; n != NULL; n = next) {
+		next = n->next;
+		tmp_profile = (struct profile *) n->content;
+		LIST_FOREACH_NODE(node, &config->profiles) {
+			struct profile *old = (struct profile *) node->content;
+			if (strcmp(old->name, tmp_profile->name) != 0
+					|| strcmp(old->source, tmp_profile->source) != 0)
+				continue;
+			clog(LOG_DEBUG, "[Profile] \"%s\" unchanged.\n", old->name);
+			LIST_FOREACH_NODE(node1, &new->rules) {
+				tmp_rule = (struct rule *) node1->content;
+				for (i = 0; i < cpufreqd_info->cpus; i++) {
+					if (tmp_rule->prof[i] == tmp_profile)
+						tmp_rule->prof[i] = old;
+				}
+			}
+			list_swap_nodes(&new->profiles, n, &config->profiles, node);
+			break;
+		}
+	}
+
+	for (n = new->rules.first; n != NULL; n = next) {
+		next = n->next;
+		tmp_rule = (struct rule *) n->content;
+		LIST_FOREACH_NODE(node, &config->rules) {
+			struct rule *old = (struct rule *) node->content;
+			if (strcmp(old->name, tmp_rule->name) != 0
+					|| strcmp(old->source, tmp_rule->source) != 0)
+				continue;
+			clog(LOG_DEBUG, "[Rule] \"%s\" unchanged.\n", old->name);
+			/* Profiles might have changed anyway */
+			tmp_prof = old->prof;
+			old->prof = tmp_rule->prof;
+			tmp_rule->prof = tmp_prof;
+			tmp_mask = old->assigned_cpus;
+			old->assigned_cpus = tmp_rule->assigned_cpus;
+			tmp_rule->assigned_cpus = tmp_mask;
+			list_swap_nodes(&new->rules, n, &config->rules, node);
+			break;
+		}
+	}
+
+	tmp_list = config->rules;
+	config->rules = new->rules;
+	new->rules = tmp_list;
+	tmp_list = config->profiles;
+	config->profiles = new->profiles;
+	new->profiles = tmp_list;
+
+	config->poll_intv = new->poll_intv;
+	config->double_check = new->double_check;
+	config->ramp_interval = new->ramp_interval;
+	config->ramp_step = new->ramp_step;
+	memcpy(config->state_file, new->state_file, MAX_PATH_LEN);
+	config->state_interval = new->state_interval;
+	config->log_level = new->log_level;
+
+	count_plugin_usage(config);
+}
+
+/* frees Rules and Profiles, the plugins are left alone */
+static void free_rules_profiles(struct cpufreqd_conf *config)
+{
 	/* cleanup rule directives and profile arrays */
 	clog(LOG_INFO, "freeing rules directives.\n");
 	LIST_FOREACH_NODE(node, &config->rules) {
-		tmp_rule = (struct rule *) node->content;
-
-		LIST_FOREACH_NODE(node1, &tmp_rule->directives) {
-			tmp_directive = (struct directive *) node1->content;
-			free_keyword_object(tmp_directive->keyword, tmp_directive->obj);
-		}
-		list_free_sublist(&tmp_rule->directives, tmp_rule->directives.first);
-		if (tmp_rule->prof)
-			free(tmp_rule->prof);
+		free_rule((struct rule *) node->content);
 	}
 	/* cleanup rule structs */
 	clog(LOG_INFO, "freeing rules.\n");
@@ -939,17 +1191,30 @@ void free_configuration(struct cpufreqd_conf *config)
 	/* cleanup profile directives */
 	clog(LOG_INFO, "freeing profiles directives.\n");
 	LIST_FOREACH_NODE(node, &config->profiles) {
-		tmp_profile = (struct profile *) node->content;
-		free(tmp_profile->policy.governor);
-		LIST_FOREACH_NODE(node1, &tmp_profile->directives) {
-			tmp_directive = (struct directive *) node1->content;
-			free_keyword_object(tmp_directive->keyword, tmp_directive->obj);
-		}
-		list_free_sublist(&tmp_profile->directives, tmp_profile->directives.first);
+		free_profile((struct profile *) node->content);
 	}
 	clog(LOG_INFO, "freeing profiles.\n");
 	list_free_sublist(&(config->profiles), config->profiles.first);
 	config->profiles.first = config->profiles.last = NULL;
+}
+
+/*
+ * Frees a configuration object returned by reload_configuration.
+ */
+void discard_configuration(struct cpufreqd_conf *config)
+{
+	free_rules_profiles(config);
+	free(config);
+}
+
+/*
+ * Frees the structures allocated.
+ */
+void free_configuration(struct cpufreqd_conf *config)
+{
+	struct plugin_obj *o_plugin;
+
+	free_rules_profiles(config);
 
 	/* clean other values */
 	config->poll_intv.tv_usec = 0;
@@ -24,6 +24,7 @@
 #include <cpufreq.h>
 #include "cpufreqd.h"
 #include "cpufreqd_plugin.h"
+#include "cpumask.h"
 #include "list.h"
 
 struct directive {
@@ -38,6 +39,7 @@ struct profile {
 	struct cpufreq_policy policy;
 	struct LIST directives; /* list of struct directive */
 	unsigned int directives_count;
+	char *source; /* section text, tells unchanged Profiles on reload */
 };
 
 struct rule {
@@ -45,9 +47,10 @@ struct rule {
 	char profile_name[MAX_STRING_LEN]; /* this is a list actually, eg: "CPU0:prof0;CPU1:prof1" */
 	struct LIST directives; /* list of struct directive */
 	struct profile **prof; /* profiles per CPU */
-	unsigned long assigned_cpus; /* bit map holding which cpus have been assigned a Profile for this rule */
+	struct cpumask *assigned_cpus; /* cpus that have been assigned a Profile of their own for this rule */
 	unsigned int score;
 	unsigned int directives_count;
+	char *source; /* section text, tells unchanged Rules on reload */
 };
 
 struct cpufreqd_conf {
@@ -59,6 +62,10 @@ struct cpufreqd_conf {
 	gid_t remote_gid;
 	unsigned int double_check;
 	struct timeval poll_intv;
+	unsigned int ramp_interval; /* ms, 0 if Profiles are set at once */
+	unsigned int ramp_step; /* frequencies per ramp step */
+	char state_file[MAX_PATH_LEN]; /* warm start, empty if disabled */
+	unsigned int state_interval; /* s, 0 if only saved when exiting */
 	unsigned int has_sysfs;
 	unsigned int no_daemon;
 	unsigned int log_level_overridden;
@@ -74,5 +81,8 @@ extern struct cpufreqd_conf *configuration;
 
 int	init_configuration	(struct cpufreqd_conf *config);
 void	free_configuration	(struct cpufreqd_conf *config);
+struct cpufreqd_conf	*reload_configuration	(struct cpufreqd_conf *config);
+void	swap_configuration	(struct cpufreqd_conf *config, struct cpufreqd_conf *new);
+void	discard_configuration	(struct cpufreqd_conf *config);
 
 #endif /* _CONFIG_PARSER_H */
@@ -0,0 +1,110 @@
+/*
+ *  Copyright (C) 2002-2008  Mattia Dongili <malattia@linux.it>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "cpufreqd_plugin.h"
+#include "cpufreq_utils.h"
+#include "cpu_hotplug.h"
+#include "uevent.h"
+
+#define CPU_SUBSYSTEM		"cpu"
+#define CPU_DEVPATH		"/devices/system/cpu/cpu"
+
+static short rescan;	/* uevents lost or not available */
+static short subscribed;
+static cpu_hotplug_handler handler;
+
+static void set_online(unsigned int cpu, int online) {
+	struct cpufreqd_info *cinfo = get_cpufreqd_info();
+
+	if (cpu >= cinfo->cpus || cinfo->online[cpu] == online)
+		return;
+	cinfo->online[cpu] = (unsigned char)online;
+	clog(LOG_NOTICE, "CPU%u is %s\n", cpu, online ? "online" : "offline");
+	if (handler != NULL)
+		handler(cpu, online);
+}
+
+static void rescan_all(void) {
+	unsigned int i = 0;
+
+	for (i = 0; i < get_cpufreqd_info()->cpus; i++)
+		set_online(i, cpu_is_online(i));
+}
+
+/* only the cpu devices themselves are interesting, the handler sets
+ * the Profile of a cpu coming back so no Rule pass is needed
+ */
+static int hotplug_uevent(const struct uevent *ev) {
+	unsigned int cpu = 0;
+	int end = 0;
+
+	if (ev == NULL) {
+		clog(LOG_NOTICE, "rereading CPUs state.\n");
+		rescan = 1;
+		return 0;
+	}
+	if (sscanf(ev->devpath, CPU_DEVPATH "%u%n", &cpu, &end) != 1
+			|| ev->devpath[end] != '\0')
+		return 0;
+	clog(LOG_DEBUG, "%s CPU%u\n", ev->action, cpu);
+
+	if (strcmp(ev->action, "online") == 0)
+		set_online(cpu, 1);
+	else if (strcmp(ev->action, "offline") == 0)
+		set_online(cpu, 0);
+	else if (strcmp(ev->action, "add") == 0 || strcmp(ev->action, "remove") == 0)
+		set_online(cpu, cpu_is_online(cpu));
+	return 0;
+}
+
+int cpu_hotplug_init(cpu_hotplug_handler h) {
+	handler = h;
+	subscribed = uevent_subscribe(CPU_SUBSYSTEM, &hotplug_uevent) == 0;
+	if (subscribed) {
+		clog(LOG_INFO, "listening to CPU hotplug uevents.\n");
+		rescan = 0;
+	} else {
+		clog(LOG_NOTICE, "CPU hotplug uevents not available, "
+				"reading CPUs state at each update.\n");
+		rescan = 1;
+	}
+	/* anything happened before the subscription */
+	rescan_all();
+	return 0;
+}
+
+void cpu_hotplug_exit(void) {
+	if (subscribed)
+		uevent_unsubscribe(&hotplug_uevent);
+	subscribed = 0;
+	handler = NULL;
+}
+
+void cpu_hotplug_update(void) {
+	if (rescan) {
+		rescan_all();
+		rescan = !subscribed;
+	}
+}
+
+int cpu_hotplug_check(unsigned int cpu) {
+	set_online(cpu, cpu_is_online(cpu));
+	return get_cpufreqd_info()->online[cpu];
+}
@@ -0,0 +1,46 @@
+/*
+ *  Copyright (C) 2002-2008  Mattia Dongili <malattia@linux.it>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __CPU_HOTPLUG_H__
+#define __CPU_HOTPLUG_H__ 1
+
+/*
+ *  Keeps cpufreqd_info->online up to date with the CPUs going
+ *  offline and coming back (hotplug, cpu parking, suspend).
+ *  Changes are read from the kernel uevents (see uevent.h). Where
+ *  uevents are not available the online attributes are read at each
+ *  update.
+ *  The handler is called for every CPU changing state.
+ */
+typedef void (*cpu_hotplug_handler)(unsigned int cpu, int online);
+
+/* cpufreqd_info->online must be allocated already, to be called after
+ * uevent_init().
+ */
+int cpu_hotplug_init(cpu_hotplug_handler handler);
+void cpu_hotplug_exit(void);
+
+/* rereads the CPUs state if uevents were lost or are not available */
+void cpu_hotplug_update(void);
+
+/* rereads the state of cpu (e.g. after failing to set its policy).
+ * Returns 1 if it's online.
+ */
+int cpu_hotplug_check(unsigned int cpu);
+
+#endif
@@ -21,21 +21,21 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
 #include "cpufreqd.h"
 #include "cpufreqd_log.h"
 #include "cpufreq_utils.h"
+#include "sysfs_utils.h"
 
-/* normalizes the user supplied frequency to a cpufreq available freq
- * ROUNDS ALWAYS UP (except if the values is over the limits)!!
+/* normalizes the user supplied frequency to the closest cpufreq available
+ * freq (rounds up when half way), limits are applied first if given
  */
 unsigned long normalize_frequency (struct cpufreq_limits *limits,
-		struct cpufreq_available_frequencies *freqs,
+		struct freq_table *table,
 		unsigned long user_freq)
 {
-
-	struct cpufreq_available_frequencies *tmp = freqs;
-	unsigned long higher=0L, lower=0L;
-
 	/* if limits are available determine if an out of bounds values is given */
 	if (limits != NULL) {
 		if (user_freq<=limits->min)
@@ -45,23 +45,15 @@ unsigned long normalize_frequency (struct cpufreq_limits *limits,
 			return limits->max;
 	}
 
-	/* normalize freq */
-	while (tmp != NULL) {
-		if (tmp->frequency>=user_freq && (tmp->frequency<higher || higher==0))
-			higher = tmp->frequency;
-
-		if (tmp->frequency<=user_freq && (tmp->frequency>lower || lower==0))
-			lower = tmp->frequency;
-
-		tmp = tmp->next;
-	}
-
-	return user_freq >= ((higher-lower)/2)+lower ? higher : lower;
+	if (table == NULL)
+		return user_freq;
+	return freq_table_nearest(table, user_freq);
 }
 
 /* translate percent values to absolute values */
 unsigned long percent_to_absolute(unsigned long max_freq, unsigned long user_freq) {
-	return max_freq * (unsigned long)((float)user_freq / 100);
+	/* split so that it doesn't overflow */
+	return max_freq / 100 * user_freq + max_freq % 100 * user_freq / 100;
 }
 
 /* goes through the list and returns the highest frequency */
@@ -81,7 +73,7 @@ unsigned long get_min_available_freq(struct cpufreq_available_frequencies *freqs
 	unsigned long min = 0;
 	struct cpufreq_available_frequencies *tmp = freqs;
 	while(tmp != NULL) {
-		if (min > tmp->frequency)
+		if (min > tmp->frequency || min == 0)
 			min = tmp->frequency;
 		tmp = tmp->next;
 	}
@@ -118,3 +110,76 @@ unsigned int get_cpu_num(void) {
 
 	return n > 0 ? n : 1;
 }
+
+/* unsigned int get_possible_cpu_num(void)
+ *
+ * Gets the number of CPUs that might ever come online (the highest
+ * possible CPU + 1) from sysfs, so that per-CPU data can be sized once
+ * and survive hotplug. Falls back to get_cpu_num().
+ */
+unsigned int get_possible_cpu_num(void) {
+	FILE *fp;
+	char line[256];
+	char *s, *end;
+	unsigned long n, max = 0;
+	int found = 0;
+
+	fp = fopen(CPU_POSSIBLE, "r");
+	if (!fp)
+		return get_cpu_num();
+	s = fgets(line, sizeof(line), fp);
+	fclose(fp);
+
+	/* e.g. "0-3,8-11" */
+	while (s != NULL && *s != '\0') {
+		n = strtoul(s, &end, 10);
+		if (end == s) {
+			s++;
+			continue;
+		}
+		max = n > max ? n : max;
+		found = 1;
+		s = end;
+	}
+	if (!found)
+		return get_cpu_num();
+
+	clog(LOG_DEBUG, "found %lu possible CPUs\n", max + 1);
+	return (unsigned int)max + 1;
+}
+
+/* int cpu_is_online(unsigned int cpu)
+ *
+ * Tells whether cpu is online, CPUs that can't be offlined (no online
+ * attribute) always are, CPUs not present never are.
+ */
+int cpu_is_online(unsigned int cpu) {
+	char path[MAX_PATH_LEN];
+	struct sysfs_attr *attr = NULL;
+	int online = 1;
+
+	snprintf(path, sizeof(path), CPU_ONLINE, cpu);
+	if (access(path, F_OK) != 0) {
+		snprintf(path, sizeof(path), CPU_DIR, cpu);
+		return access(path, F_OK) == 0 || access(SYS_CPU_DIR, F_OK) != 0;
+	}
+	if ((attr = sysfs_attr_open(path, O_RDONLY)) == NULL)
+		return 1;
+	if (sysfs_attr_read_int(attr, &online) != 0)
+		online = 1;
+	sysfs_attr_close(attr);
+	return online != 0;
+}
+
+/* double monotonic_time(void)
+ *
+ * Seconds from an arbitrary point, not affected by clock changes.
+ * Exported for the plugins as well.
+ */
+double monotonic_time(void) {
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+		return 0.0;
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0;
+}
@@ -19,14 +19,22 @@
 
 #include <cpufreq.h>
 #include "config_parser.h"
+#include "freq_table.h"
 
 #define CPUINFO_PROC  "/proc/cpuinfo"
+#define SYS_CPU_DIR   "/sys/devices/system/cpu"
+#define CPU_POSSIBLE  SYS_CPU_DIR "/possible"
+#define CPU_DIR       SYS_CPU_DIR "/cpu%u"
+#define CPU_ONLINE    CPU_DIR "/online"
 
 unsigned long normalize_frequency (struct cpufreq_limits *limits,
-                                   struct cpufreq_available_frequencies *freqs,
+                                   struct freq_table *table,
                                    unsigned long user_freq);
 unsigned long percent_to_absolute(unsigned long max_freq, unsigned long user_freq);
 unsigned long get_max_available_freq(struct cpufreq_available_frequencies *freqs);
 unsigned long get_min_available_freq(struct cpufreq_available_frequencies *freqs);
 unsigned int get_cpu_num(void);
+unsigned int get_possible_cpu_num(void);
+int cpu_is_online(unsigned int cpu);
+double monotonic_time(void);
 
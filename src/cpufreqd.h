@@ -52,6 +52,7 @@
 
 #define DEFAULT_POLL		1
 #define DEFAULT_VERBOSITY	3
+#define DEFAULT_STATE_INTERVAL	60
 
 #define MAX_STRING_LEN		255
 
@@ -17,10 +17,13 @@
  */
 
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "cpufreqd_plugin.h"
+#include "cpufreq_utils.h"
 #include "cpufreqd_acpi.h"
 #include "cpufreqd_acpi_ac.h"
 #include "cpufreqd_acpi_battery.h"
@@ -33,6 +36,12 @@ static short int acpi_ev_failed;
 static short int acpi_temp_failed;
 struct acpi_configuration acpi_config;
 
+/* event sources might show up later (acpid started after us) */
+#define EVENT_RETRY_MIN		10.0	/* s */
+#define EVENT_RETRY_MAX		600.0
+static double ev_retry_delay;
+static double ev_retry_at;
+
 /*
  * init default values
  */
@@ -78,6 +87,8 @@ static int acpi_post_conf (void) {
 	acpi_temp_failed = acpi_temperature_init();
 	clog(LOG_DEBUG, "Initializing EVENT\n");
 	acpi_ev_failed = acpi_event_init();
+	ev_retry_delay = EVENT_RETRY_MIN;
+	ev_retry_at = monotonic_time() + ev_retry_delay;
 	/* return error _only_ if all components failed */
 	return acpi_ev_failed && acpi_ac_failed && acpi_batt_failed && acpi_temp_failed;
 }
@@ -103,17 +114,40 @@ static int acpi_exit (void) {
 	return ret;
 }
 
+/* tries the event sources again, waiting longer after each failure */
+static void acpi_event_retry(void) {
+	double now = monotonic_time();
+
+	if (now < ev_retry_at)
+		return;
+	clog(LOG_DEBUG, "Retrying EVENT\n");
+	acpi_ev_failed = acpi_event_init();
+	if (!acpi_ev_failed) {
+		clog(LOG_NOTICE, "acpi events available.\n");
+		return;
+	}
+	ev_retry_delay *= 2;
+	if (ev_retry_delay > EVENT_RETRY_MAX)
+		ev_retry_delay = EVENT_RETRY_MAX;
+	ev_retry_at = now + ev_retry_delay;
+}
+
 static int acpi_update(void) {
 
+	if (acpi_ev_failed)
+		acpi_event_retry();
+
+	/* acpid events, uevents are dispatched by the core */
+	if (!acpi_ev_failed)
+		acpi_event_update();
+
 	if (!acpi_ac_failed)
 		acpi_ac_update();
 
-	acpi_event_lock();
 	if (!acpi_batt_failed)
 		acpi_battery_update();
 
 	reset_event();
-	acpi_event_unlock();
 
 	if (!acpi_temp_failed)
 		acpi_temperature_update();
@@ -121,10 +155,24 @@ static int acpi_update(void) {
 	return 0;
 }
 
+static int acpi_save(FILE *fp) {
+	return acpi_batt_failed ? -1 : acpi_battery_save(fp);
+}
+
+static int acpi_restore(const char *snapshot) {
+	return acpi_batt_failed ? -1 : acpi_battery_restore(snapshot);
+}
+
 static struct cpufreqd_keyword kw[] = {
 	{ .word = "ac", .parse = &acpi_ac_parse, .evaluate = &acpi_ac_evaluate },
 	{ .word = "battery_interval", .parse = &acpi_battery_parse, .evaluate = &acpi_battery_evaluate },
+	{ .word = "battery_time", .parse = &acpi_battery_parse, .evaluate = &acpi_battery_time_evaluate },
 	{ .word = "acpi_temperature", .parse = &acpi_temperature_parse,   .evaluate = &acpi_temperature_evaluate },
+	{ .word = "temperature_slope", .parse = &acpi_temperature_slope_parse, .evaluate = &acpi_temperature_slope_evaluate },
+	{ .word = "temperature_trip_time", .parse = &acpi_temperature_parse, .evaluate = &acpi_temperature_trip_evaluate },
+	{ .word = "temperature_target", .parse = &acpi_temperature_target_parse,
+		.profile_post_change = &acpi_temperature_target_change,
+		.free = &acpi_temperature_target_free },
 	{ .word = NULL, .parse = NULL, .evaluate = NULL, .free = NULL }
 };
 
@@ -136,6 +184,8 @@ static struct cpufreqd_plugin acpi = {
 	.plugin_update	= &acpi_update,		/* plugin_update */
 	.plugin_conf	= &acpi_conf,
 	.plugin_post_conf = &acpi_post_conf,
+	.plugin_save	= &acpi_save,
+	.plugin_restore	= &acpi_restore,
 };
 
 struct cpufreqd_plugin *create_plugin (void) {
@@ -149,38 +199,30 @@ struct cpufreqd_plugin *create_plugin (void) {
 
 /* read_value
  *
- * read the value and perform no conversion, requires an open sysfs attribute
+ * read the value into buf (len bytes long) and perform no conversion,
+ * requires an open attribute
  */
-int read_value(struct sysfs_attribute *attr)
+int read_value(struct sysfs_attr *attr, char *buf, size_t len)
 {
-	if (sysfs_read_attribute(attr)) {
-		clog(LOG_NOTICE, "couldn't read %s (%s)\n",
-				attr->path, strerror(errno));
-		return -1;
-	}
-	return 0;
+	return sysfs_attr_read(attr, buf, len) < 0 ? -1 : 0;
 }
 
 /* read_int
  *
- * read char value into an integer, requires an open sysfs attribute
+ * read char value into an integer, requires an open attribute
  */
-int read_int(struct sysfs_attribute *attr, int *value)
+int read_int(struct sysfs_attr *attr, int *value)
 {
-	if (read_value(attr) != 0)
-		return -1;
-	sscanf(attr->value, "%d\n", value);
-	return 0;
+	return sysfs_attr_read_int(attr, value);
 }
 
 /* put_attribute
  *
- * closes a sysfs_attribute previously obtained through
+ * closes an attribute previously obtained through
  * get_class_device_attribute.
  */
-void put_attribute(struct sysfs_attribute *attr) {
-	clog(LOG_DEBUG, "closing %s.\n", attr->path);
-	sysfs_close_attribute(attr);
+void put_attribute(struct sysfs_attr *attr) {
+	sysfs_attr_close(attr);
 }
 
 /* get_class_device_attribute
@@ -189,31 +231,118 @@ void put_attribute(struct sysfs_attribute *attr) {
  * The attribute is returned on success, NULL on failure.
  * The attribute can be closed with put_attribute.
  */
-struct sysfs_attribute *get_class_device_attribute(struct sysfs_class_device *clsdev,
+struct sysfs_attr *get_class_device_attribute(struct sysfs_class_device *clsdev,
 		const char *attrname)
 {
 
 	char path[SYSFS_PATH_MAX];
-	struct sysfs_attribute *attr = NULL;
+	char value[SYSFS_PATH_MAX];
+	struct sysfs_attr *attr = NULL;
 
 	snprintf(path, SYSFS_PATH_MAX, "%s/%s", clsdev->path, attrname);
-	attr = sysfs_open_attribute(path);
+	attr = sysfs_attr_open(path, O_RDONLY);
 	if (!attr) {
 		clog(LOG_WARNING, "couldn't open %s (%s)\n", path,
 				strerror(errno));
 		return NULL;
 	}
-	if (sysfs_read_attribute(attr)) {
-		clog(LOG_WARNING, "cannot read %s (%s)\n", path,
-				strerror(errno));
-		sysfs_close_attribute(attr);
+	if (sysfs_attr_read(attr, value, sizeof(value)) < 0) {
+		clog(LOG_WARNING, "cannot read %s\n", path);
+		sysfs_attr_close(attr);
 		return NULL;
 	}
-	clog(LOG_INFO, "found %s - path %s\n", attr->name, attr->path);
+	clog(LOG_INFO, "found %s - path %s\n", attrname, path);
 	return attr;
 
 }
 
+/* name hashing for the registries (FNV-1a) */
+static unsigned int registry_hash(const char *name) {
+	unsigned int h = 2166136261u;
+
+	while (*name)
+		h = (h ^ (unsigned char)*name++) * 16777619u;
+	return h;
+}
+
+void acpi_registry_init(struct acpi_registry *reg, size_t entry_size) {
+	memset(reg, 0, sizeof(struct acpi_registry));
+	reg->entry_size = entry_size;
+}
+
+void acpi_registry_free(struct acpi_registry *reg) {
+	free(reg->entries);
+	free(reg->index);
+	acpi_registry_init(reg, reg->entry_size);
+}
+
+/* linear probing, the index is kept at most half full */
+static unsigned int *registry_slot(const struct acpi_registry *reg,
+		const char *name) {
+	unsigned int mask = reg->index_size - 1;
+	unsigned int i = registry_hash(name) & mask;
+	unsigned int *slot = NULL;
+
+	for (;; i = (i + 1) & mask) {
+		slot = &reg->index[i];
+		if (*slot == 0 || strncmp(acpi_registry_get(reg, *slot - 1),
+					name, SYSFS_NAME_LEN) == 0)
+			return slot;
+	}
+}
+
+int acpi_registry_find(const struct acpi_registry *reg, const char *name) {
+	unsigned int *slot = NULL;
+
+	if (reg->index_size == 0)
+		return -1;
+	slot = registry_slot(reg, name);
+	return (int)*slot - 1;
+}
+
+static int registry_grow(struct acpi_registry *reg) {
+	unsigned int size = reg->size ? reg->size * 2 : 8;
+	unsigned int index_size = size * 2;
+	unsigned int i = 0;
+	char *entries = NULL;
+	unsigned int *index = NULL;
+
+	entries = realloc(reg->entries, size * reg->entry_size);
+	if (entries == NULL)
+		return -1;
+	reg->entries = entries;
+
+	index = calloc(index_size, sizeof(unsigned int));
+	if (index == NULL)
+		return -1;
+	reg->size = size;
+	free(reg->index);
+	reg->index = index;
+	reg->index_size = index_size;
+	for (i = 0; i < reg->count; i++)
+		*registry_slot(reg, acpi_registry_get(reg, i)) = i + 1;
+	return 0;
+}
+
+int acpi_registry_add(struct acpi_registry *reg, const char *name) {
+	int idx = acpi_registry_find(reg, name);
+	char *entry = NULL;
+
+	if (idx >= 0)
+		return idx;
+
+	if (reg->count == reg->size && registry_grow(reg) != 0) {
+		clog(LOG_ERR, "couldn't make enough room for %s (%s)\n", name,
+				strerror(errno));
+		return -1;
+	}
+	entry = acpi_registry_get(reg, reg->count);
+	memset(entry, 0, reg->entry_size);
+	snprintf(entry, SYSFS_NAME_LEN, "%s", name);
+	*registry_slot(reg, entry) = ++reg->count;
+	return (int)reg->count - 1;
+}
+
 /* put_class_device
  *
  * Close class devices previously discovered with find_class_device
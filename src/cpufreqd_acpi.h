@@ -18,6 +18,7 @@
 
 #include <sysfs/libsysfs.h>
 #include "cpufreqd.h"
+#include "sysfs_utils.h"
 
 struct acpi_configuration {
 	int battery_update_interval;
@@ -28,14 +29,43 @@ struct acpi_configuration {
 	char acpid_sock_path[MAX_PATH_LEN];
 };
 
-int read_value(struct sysfs_attribute *attr);
-int read_int(struct sysfs_attribute *attr, int *value);
+int read_value(struct sysfs_attr *attr, char *buf, size_t len);
+int read_int(struct sysfs_attr *attr, int *value);
 
 
-void put_attribute(struct sysfs_attribute *attr);
-struct sysfs_attribute *get_class_device_attribute(struct sysfs_class_device *clsdev,
+void put_attribute(struct sysfs_attr *attr);
+struct sysfs_attr *get_class_device_attribute(struct sysfs_class_device *clsdev,
 		const char *attrname);
 
+/*
+ *  Growable set of devices keyed by name. Entries are entry_size bytes
+ *  long, stored contiguously and MUST begin with their name
+ *  (char name[SYSFS_NAME_LEN]).
+ *  Entries are never removed, a device that goes away is only marked as
+ *  such by its owner so that indexes held by rules stay valid and the
+ *  same entry is used again if the device comes back.
+ *  Entries move when the registry grows, don't keep pointers to them.
+ */
+struct acpi_registry {
+	char *entries;
+	size_t entry_size;
+	unsigned int count;
+	unsigned int size;
+	unsigned int *index;	/* entry + 1, 0 if the slot is empty */
+	unsigned int index_size;
+};
+
+void acpi_registry_init(struct acpi_registry *reg, size_t entry_size);
+void acpi_registry_free(struct acpi_registry *reg);
+/* Returns the index of `name` or -1 */
+int acpi_registry_find(const struct acpi_registry *reg, const char *name);
+/* Returns the index of `name`, a zeroed entry is added if not found.
+ * -1 on allocation failures.
+ */
+int acpi_registry_add(struct acpi_registry *reg, const char *name);
+#define acpi_registry_get(reg, i) \
+	((void *)((reg)->entries + (size_t)(i) * (reg)->entry_size))
+
 void put_class_device(struct sysfs_class_device *clsdev);
 int find_class_device(const char *clsname, const char *devtype,
 		int (*clsdev_callback)(struct sysfs_class_device *cls));
@@ -25,6 +25,7 @@
 #include "cpufreqd_plugin.h"
 #include "cpufreqd_acpi.h"
 #include "cpufreqd_acpi_ac.h"
+#include "cpufreqd_acpi_event.h"
 
 #define POWER_SUPPLY "power_supply"
 #define AC_TYPE "Mains"
@@ -33,17 +34,42 @@
 #define PLUGGED   1
 #define UNPLUGGED 0
 
-static struct sysfs_attribute *mains[64];
+struct ac_adapter {
+	char name[SYSFS_NAME_LEN];	/* registry key */
+	struct sysfs_attr *online_attr;
+	int online;
+	int valid;	/* online could be read */
+	int present;
+	int seen;	/* found by the last scan */
+};
+
+static struct acpi_registry adapters;
+static struct sysfs_batch *mains_batch;
 static int ac_state;
-static int ac_dir_num;
+static int ac_poll;	/* read the adapters at the next update */
+static int ac_rescan;	/* adapters came or went */
+
+static void close_adapter(struct ac_adapter *ac) {
+	if (ac->online_attr)
+		put_attribute(ac->online_attr);
+	ac->online_attr = NULL;
+	ac->present = ac->valid = 0;
+}
 
 static int mains_callback(struct sysfs_class_device *cdev) {
-	struct sysfs_attribute *attr = get_class_device_attribute(cdev,
-			AC_ONLINE);
-	if (attr) {
-		/* success */
-		mains[ac_dir_num] = attr;
-		ac_dir_num++;
+	struct ac_adapter *ac = NULL;
+	int idx = acpi_registry_add(&adapters, cdev->name);
+
+	if (idx < 0)
+		return 1;
+	ac = acpi_registry_get(&adapters, idx);
+	ac->seen = 1;
+	if (!ac->present) {
+		ac->online_attr = get_class_device_attribute(cdev, AC_ONLINE);
+		if (ac->online_attr) {
+			clog(LOG_DEBUG, "adding %s\n", ac->name);
+			ac->present = 1;
+		}
 	}
 	/* we don't care about the class_device
 	 * returning 1 will force find_class_device
@@ -52,44 +78,128 @@ static int mains_callback(struct sysfs_class_device *cdev) {
 	return 1;
 }
 
+/* (re)reads the available adapters, the ones already known are left
+ * untouched, the ones gone are closed. The batch is rebuilt.
+ */
+static int scan_adapters(void) {
+	struct ac_adapter *ac = NULL;
+	unsigned int i = 0;
+	int count = 0;
+
+	for (i = 0; i < adapters.count; i++)
+		((struct ac_adapter *)acpi_registry_get(&adapters, i))->seen = 0;
+
+	find_class_device(POWER_SUPPLY, AC_TYPE, mains_callback);
+
+	sysfs_batch_free(mains_batch);
+	if ((mains_batch = sysfs_batch_new()) == NULL)
+		return -1;
+	for (i = 0; i < adapters.count; i++) {
+		ac = acpi_registry_get(&adapters, i);
+		if (ac->present && !ac->seen) {
+			clog(LOG_INFO, "%s is gone\n", ac->name);
+			close_adapter(ac);
+		}
+		if (!ac->present)
+			continue;
+		if (sysfs_batch_add(mains_batch, ac->online_attr, &ac->online,
+					&ac->valid) != 0)
+			return -1;
+		count++;
+	}
+	ac_poll = 1;
+	return count;
+}
+
 /*  static int acpi_ac_init(void)
  *
- *  test if AC dirs are present
+ *  test if AC dirs are present, an AC adapter can be plugged later
  */
 short int acpi_ac_init(void) {
+	int count = 0;
 
-	find_class_device(POWER_SUPPLY, AC_TYPE, mains_callback);
-	if (ac_dir_num <= 0) {
-		clog(LOG_INFO, "No AC adapters found\n");
+	acpi_registry_init(&adapters, sizeof(struct ac_adapter));
+	if ((count = scan_adapters()) < 0) {
+		acpi_ac_exit();
 		return -1;
 	}
+	if (count == 0)
+		clog(LOG_INFO, "No AC adapters found\n");
 	return 0;
 }
 
 short int acpi_ac_exit(void) {
-	while (--ac_dir_num >= 0)
-		put_attribute(mains[ac_dir_num]);
+	unsigned int i = 0;
+
+	for (i = 0; i < adapters.count; i++)
+		close_adapter(acpi_registry_get(&adapters, i));
+	acpi_registry_free(&adapters);
+	sysfs_batch_free(mains_batch);
+	mains_batch = NULL;
 	clog(LOG_INFO, "exited.\n");
 	return 0;
 }
 
+/*  void acpi_ac_uevent(const struct acpi_uevent *ev)
+ *
+ *  take the adapter state from a power_supply uevent, the adapters
+ *  are only read again if the event doesn't carry the online value
+ */
+void acpi_ac_uevent(const struct acpi_uevent *ev) {
+	const char *type = acpi_uevent_get(ev, "POWER_SUPPLY_TYPE");
+	const char *online = acpi_uevent_get(ev, "POWER_SUPPLY_ONLINE");
+	struct ac_adapter *ac = NULL;
+	int idx = 0;
+
+	if (strcmp(ev->action, "add") == 0 || strcmp(ev->action, "remove") == 0) {
+		if (type == NULL || strcmp(type, AC_TYPE) == 0)
+			ac_rescan = 1;
+		return;
+	}
+	idx = acpi_registry_find(&adapters, ev->name);
+	if (idx < 0 || !(ac = acpi_registry_get(&adapters, idx))->present) {
+		/* not one we know about */
+		if (type != NULL && strcmp(type, AC_TYPE) == 0)
+			ac_rescan = 1;
+		return;
+	}
+	if (online != NULL) {
+		ac->online = atoi(online);
+		ac->valid = 1;
+		clog(LOG_DEBUG, "%s is %s\n", ev->name, online);
+	} else
+		ac_poll = 1;
+}
+
 /*  static int acpi_ac_update(void)
  *
- *  reads temperature valuse ant compute a medium value
+ *  computes the ac state, adapters are read at each update only if
+ *  the kernel doesn't tell about changes
  */
 int acpi_ac_update(void) {
-	int value;
-	int i = 0;
+	struct ac_adapter *ac = NULL;
+	unsigned int i = 0;
 
-	ac_state = UNPLUGGED;
 	clog(LOG_DEBUG, "called\n");
-	for (i = 0; i < ac_dir_num; i++) {
-		/* check power_supply type */
-		if (read_int(mains[i], &value))
-				continue;
+	if (ac_rescan) {
+		clog(LOG_NOTICE, "Re-scanning available AC adapters\n");
+		ac_rescan = 0;
+		scan_adapters();
+	}
+	if (mains_batch != NULL &&
+			(ac_poll || is_event_pending() || !acpi_uevents_active())) {
+		sysfs_batch_read(mains_batch);
+		ac_poll = 0;
+	}
+
+	ac_state = UNPLUGGED;
+	for (i = 0; i < adapters.count; i++) {
+		ac = acpi_registry_get(&adapters, i);
+		if (!ac->present || !ac->valid)
+			continue;
 
-		clog(LOG_DEBUG, "read %s:%d\n", mains[i]->path, value);
-		ac_state |= value ? PLUGGED : UNPLUGGED;
+		clog(LOG_DEBUG, "read %s:%d\n", ac->name, ac->online);
+		ac_state |= ac->online ? PLUGGED : UNPLUGGED;
 	}
 
 	clog(LOG_INFO, "ac_adapter is %s\n",
@@ -17,9 +17,11 @@
  *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
+struct acpi_uevent;
 
 short int acpi_ac_init(void);
 short int acpi_ac_exit(void);
 int acpi_ac_update(void);
+void acpi_ac_uevent(const struct acpi_uevent *ev);
 int acpi_ac_parse(const char *ev, void **obj);
 int acpi_ac_evaluate(const void *s);
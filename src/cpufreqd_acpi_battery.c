@@ -23,6 +23,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "cpufreqd_plugin.h"
+#include "cpufreq_utils.h"
 #include "cpufreqd_acpi.h"
 #include "cpufreqd_acpi_event.h"
 #include "cpufreqd_acpi_battery.h"
@@ -36,48 +37,61 @@
 #define PRESENT		"present"
 #define STATUS		"status"
 #define CURRENT_NOW	"current_now"
+#define POWER_NOW	"power_now"
+
+/* seconds, time constant of the discharge rate average */
+#define RATE_TIME_CONSTANT	120.0
+/* minutes, the time estimate must move this much to be reported */
+#define TIME_DEADBAND		2
 
 struct battery_info {
+	char name[SYSFS_NAME_LEN];	/* registry key */
 	int capacity;
 	int remaining;
 	int present_rate;
 	int level; /* computed percentage */
 	int is_present;
+	double rate;		/* smoothed discharge rate */
+	double rate_stamp;	/* when rate was last sampled */
+	int minutes;		/* time left while discharging, -1 if unknown */
+
+	char status_value[32];
 
-	struct sysfs_class_device *cdev;
-	struct sysfs_attribute *energy_full; /* last full capacity */
-	struct sysfs_attribute *energy_now; /* remaining capacity */
-	struct sysfs_attribute *present;
-	struct sysfs_attribute *status;
-	struct sysfs_attribute *current_now; /* present rate */
+	struct sysfs_class_device *cdev;	/* NULL while not there */
+	struct sysfs_attr *energy_full; /* last full capacity */
+	struct sysfs_attr *energy_now; /* remaining capacity */
+	struct sysfs_attr *present;
+	struct sysfs_attr *status;
+	struct sysfs_attr *current_now; /* present rate, power_now or current_now */
 
 	int open;
+	int stale;	/* changed, read at the next update */
+	int seen;	/* found by the last scan */
 };
 
 struct battery_interval {
 	int min, max;
-	struct battery_info *bat;
+	int bat;	/* battery index, -1 for the average */
 };
 
-/* don't want to handle more than 8 batteries... yet */
-static struct battery_info info[8];
-static int bat_dir_num;
+static struct acpi_registry batteries;
 static int avg_battery_level;
+static int avg_battery_time = -1;
 static double check_timeout;
 static double old_time;
+static int battery_rescan;
 extern struct acpi_configuration acpi_config;
 
-/* validate if the requested battery exists */
+/* the battery called name if it's there, NULL otherwise */
 static struct battery_info *get_battery_info(const char *name)
 {
-	int i;
+	int idx = acpi_registry_find(&batteries, name);
 	struct battery_info *ret = NULL;
 
-	for (i = 0; i < bat_dir_num; i++) {
-		if (strncmp(info[i].cdev->name, name, SYSFS_NAME_LEN) == 0) {
-			ret = &info[i];
-			break;
-		}
+	if (idx >= 0) {
+		ret = acpi_registry_get(&batteries, idx);
+		if (ret->cdev == NULL)
+			ret = NULL;
 	}
 	return ret;
 }
@@ -97,27 +111,31 @@ static void close_battery(struct battery_info *binfo) {
 		put_attribute(binfo->status);
 	if (binfo->current_now)
 		put_attribute(binfo->current_now);
+	binfo->energy_full = binfo->energy_now = binfo->present = NULL;
+	binfo->status = binfo->current_now = NULL;
 
 	binfo->open = 0;
 }
 /* read battery levels as reported by hw */
 static int read_battery(struct battery_info *binfo) {
-	clog(LOG_DEBUG, "%s - reading battery levels\n", binfo->cdev->name);
+	clog(LOG_DEBUG, "%s - reading battery levels\n", binfo->name);
 
 	if (read_int(binfo->current_now, &binfo->present_rate) != 0) {
-		clog(LOG_ERR, "Skipping %s\n", binfo->cdev->name);
+		clog(LOG_ERR, "Skipping %s\n", binfo->name);
 		return -1;
 	}
 	if (read_int(binfo->energy_now, &binfo->remaining) != 0) {
-		clog(LOG_ERR, "Skipping %s\n", binfo->cdev->name);
+		clog(LOG_ERR, "Skipping %s\n", binfo->name);
 		return -1;
 	}
-	if (read_value(binfo->status) != 0) {
-		clog(LOG_ERR, "Skipping %s\n", binfo->cdev->name);
+	if (read_value(binfo->status, binfo->status_value,
+				sizeof(binfo->status_value)) != 0) {
+		clog(LOG_ERR, "Skipping %s\n", binfo->name);
 		return -1;
 	}
+	binfo->stale = 0;
 	clog(LOG_DEBUG, "%s - remaining capacity: %d\n",
-			binfo->cdev->name, binfo->remaining);
+			binfo->name, binfo->remaining);
 	return 0;
 }
 /* open all the required attributes and set the open status */
@@ -133,7 +151,10 @@ static int open_battery(struct battery_info *binfo) {
 			return -1;
 	}
 	binfo->energy_now = get_class_device_attribute(binfo->cdev, ENERGY_NOW);
-	if (!binfo->energy_now) {
+	if (binfo->energy_now) {
+		/* the rate must be in the same units */
+		binfo->current_now = get_class_device_attribute(binfo->cdev, POWER_NOW);
+	} else {
 		/* try the "charge_now" name */
 		binfo->energy_now = get_class_device_attribute(binfo->cdev, CHARGE_NOW);
 		if (!binfo->energy_now)
@@ -145,7 +166,8 @@ static int open_battery(struct battery_info *binfo) {
 	binfo->status = get_class_device_attribute(binfo->cdev, STATUS);
 	if (!binfo->status)
 		return -1;
-	binfo->current_now = get_class_device_attribute(binfo->cdev, CURRENT_NOW);
+	if (!binfo->current_now)
+		binfo->current_now = get_class_device_attribute(binfo->cdev, CURRENT_NOW);
 	if (!binfo->current_now)
 		return -1;
 
@@ -153,20 +175,72 @@ static int open_battery(struct battery_info *binfo) {
 	 * very often, so no need to poke it later */
 	if (read_int(binfo->energy_full, &binfo->capacity) != 0) {
 		clog(LOG_WARNING, "Couldn't read %s capacity (%s)\n",
-				binfo->cdev->name, strerror(errno));
+				binfo->name, strerror(errno));
 		return -1;
 	}
+	if (read_int(binfo->present, &binfo->is_present) != 0)
+		return -1;
+	binfo->stale = 1;
 	return 0;
 }
 
-/* set the battery class device into the battery_info array */
+/* keep the class device of new batteries and open their attributes */
 static int clsdev_callback(struct sysfs_class_device *cdev) {
+	struct battery_info *binfo = NULL;
+	int idx = acpi_registry_add(&batteries, cdev->name);
+
+	if (idx < 0)
+		return 1;
+	binfo = acpi_registry_get(&batteries, idx);
+	binfo->seen = 1;
+	/* already known, let find_class_device close this one */
+	if (binfo->cdev != NULL)
+		return 1;
+
 	clog(LOG_DEBUG, "Got device %s\n", cdev->name);
-	info[bat_dir_num].cdev = cdev;
-	bat_dir_num++;
+	binfo->cdev = cdev;
+	binfo->rate = 0.0;
+	binfo->minutes = -1;
+	if (open_battery(binfo) != 0) {
+		clog(LOG_WARNING, "Couldn't open %s attributes\n", binfo->name);
+		close_battery(binfo);
+	}
 	return 0;
 }
 
+/* forget about a battery that went away, its entry is kept */
+static void remove_battery(struct battery_info *binfo) {
+	close_battery(binfo);
+	put_class_device(binfo->cdev);
+	binfo->cdev = NULL;
+	binfo->is_present = 0;
+}
+
+/* (re)reads the available batteries, the ones already known are left
+ * untouched, the ones gone are closed
+ */
+static int scan_batteries(void) {
+	struct battery_info *binfo = NULL;
+	unsigned int i = 0;
+	int count = 0;
+
+	for (i = 0; i < batteries.count; i++)
+		((struct battery_info *)acpi_registry_get(&batteries, i))->seen = 0;
+
+	find_class_device(POWER_SUPPLY, BATTERY_TYPE, &clsdev_callback);
+
+	for (i = 0; i < batteries.count; i++) {
+		binfo = acpi_registry_get(&batteries, i);
+		if (binfo->cdev != NULL && !binfo->seen) {
+			clog(LOG_INFO, "%s is gone\n", binfo->name);
+			remove_battery(binfo);
+		}
+		if (binfo->cdev != NULL)
+			count++;
+	}
+	return count;
+}
+
 /*  int acpi_battery_init(void)
  *
  *  this never fails since batteries are hotpluggable and
@@ -174,74 +248,75 @@ static int clsdev_callback(struct sysfs_class_device *cdev) {
  *  when an event is pending)
  */
 short int acpi_battery_init(void) {
-	int i;
+	int count = 0;
 
-	find_class_device(POWER_SUPPLY, BATTERY_TYPE, &clsdev_callback);
-	if (bat_dir_num <= 0) {
+	acpi_registry_init(&batteries, sizeof(struct battery_info));
+	count = scan_batteries();
+	if (count <= 0) {
 		clog(LOG_INFO, "No Batteries found\n");
 		return 0;
 	}
-	/* open the required attributes */
-	for (i = 0; i < bat_dir_num; i++) {
-		clog(LOG_DEBUG, "Opening %s attributes\n", info[i].cdev->name);
-		if (open_battery(&info[i]) != 0) {
-			clog(LOG_WARNING, "Couldn't open %s attributes\n",
-					info[i].cdev->name);
-			close_battery(&info[i]);
-		}
-	}
-	clog(LOG_INFO, "found %d Batter%s\n", bat_dir_num,
-			bat_dir_num > 1 ? "ies" : "y");
+	clog(LOG_INFO, "found %d Batter%s\n", count, count > 1 ? "ies" : "y");
 	return 0;
 }
 short int acpi_battery_exit(void) {
-	/* also reset values since this is called on pending
-	 * acpi events to rescan batteries
-	 */
-	while (--bat_dir_num >= 0) {
-		close_battery(&info[bat_dir_num]);
-		put_class_device(info[bat_dir_num].cdev);
-		info[bat_dir_num].cdev = NULL;
+	unsigned int i = 0;
+	struct battery_info *binfo = NULL;
+
+	for (i = 0; i < batteries.count; i++) {
+		binfo = acpi_registry_get(&batteries, i);
+		if (binfo->cdev != NULL)
+			remove_battery(binfo);
 	}
-	bat_dir_num = 0;
+	acpi_registry_free(&batteries);
 	clog(LOG_INFO, "exited.\n");
 	return 0;
 }
+
+/* batteries named in rules might not be there yet, they're
+ * added to the registry and will be used when plugged
+ */
+static int parse_battery(const char *name) {
+	int idx = acpi_registry_find(&batteries, name);
+
+	if (idx < 0) {
+		clog(LOG_WARNING, "battery %s not found (yet)\n", name);
+		idx = acpi_registry_add(&batteries, name);
+	}
+	return idx;
+}
 /*
  *  Parses entries of the form %d-%d (min-max)
  */
 int acpi_battery_parse(const char *ev, void **obj) {
-	char battery_name[32];
+	char battery_name[SYSFS_NAME_LEN];
 	struct battery_interval *ret = calloc(1, sizeof(struct battery_interval));
 	if (ret == NULL) {
 		clog(LOG_ERR, "couldn't make enough room for battery_interval (%s)\n",
 				strerror(errno));
 		return -1;
 	}
+	ret->bat = -1;
 
 	clog(LOG_DEBUG, "called with: %s\n", ev);
 
 	/* try to parse the %[a-zA-Z0-9]:%d-%d format first */
-	if (sscanf(ev, "%32[a-zA-Z0-9]:%d-%d", battery_name, &(ret->min), &(ret->max)) == 3) {
-		/* validate battery name and assign pointer to struct battery_info */
-		if ((ret->bat = get_battery_info(battery_name)) == NULL) {
-			clog(LOG_ERR, "non existent battery %s!\n",
-					battery_name);
+	if (sscanf(ev, "%63[a-zA-Z0-9]:%d-%d", battery_name, &(ret->min), &(ret->max)) == 3) {
+		/* look up the battery and keep its index */
+		if ((ret->bat = parse_battery(battery_name)) < 0) {
 			free(ret);
 			return -1;
 		}
-		clog(LOG_INFO, "parsed %s %d-%d\n", ret->bat->cdev->name, ret->min, ret->max);
+		clog(LOG_INFO, "parsed %s %d-%d\n", battery_name, ret->min, ret->max);
 
-	} else if (sscanf(ev, "%32[a-zA-Z0-9]:%d", battery_name, &(ret->min)) == 2) {
-		/* validate battery name and assign pointer to struct battery_info */
-		if ((ret->bat = get_battery_info(battery_name)) == NULL) {
-			clog(LOG_ERR, "non existent battery %s!\n",
-					battery_name);
+	} else if (sscanf(ev, "%63[a-zA-Z0-9]:%d", battery_name, &(ret->min)) == 2) {
+		/* look up the battery and keep its index */
+		if ((ret->bat = parse_battery(battery_name)) < 0) {
 			free(ret);
 			return -1;
 		}
 		ret->max = ret->min;
-		clog(LOG_INFO, "parsed %s %d\n", ret->bat->cdev->name, ret->min);
+		clog(LOG_INFO, "parsed %s %d\n", battery_name, ret->min);
 
 	} else if (sscanf(ev, "%d-%d", &(ret->min), &(ret->max)) == 2) {
 		clog(LOG_INFO, "parsed %d-%d\n", ret->min, ret->max);
@@ -268,100 +343,198 @@ int acpi_battery_parse(const char *ev, void **obj) {
 
 int acpi_battery_evaluate(const void *s) {
 	const struct battery_interval *bi = (const struct battery_interval *)s;
+	const struct battery_info *binfo = NULL;
 	int level = avg_battery_level;
 
-	if (bi != NULL && bi->bat != NULL) {
-		level = bi->bat->present->value ? bi->bat->level : -1;
+	if (bi->bat >= 0) {
+		binfo = acpi_registry_get(&batteries, bi->bat);
+		level = binfo->cdev != NULL && binfo->is_present ? binfo->level : -1;
 	}
 
 	clog(LOG_DEBUG, "called %d-%d [%s:%d]\n", bi->min, bi->max,
-			bi != NULL && bi->bat != NULL ? bi->bat->cdev->name : "Avg", level);
+			binfo != NULL ? binfo->name : "Avg", level);
 
 	return (level >= bi->min && level <= bi->max) ? MATCH : DONT_MATCH;
 }
 
+/*
+ *  Same as battery_interval, but the values are minutes left
+ */
+int acpi_battery_time_evaluate(const void *s) {
+	const struct battery_interval *bi = (const struct battery_interval *)s;
+	const struct battery_info *binfo = NULL;
+	int minutes = avg_battery_time;
+
+	if (bi->bat >= 0) {
+		binfo = acpi_registry_get(&batteries, bi->bat);
+		minutes = binfo->cdev != NULL && binfo->is_present ? binfo->minutes : -1;
+	}
+
+	clog(LOG_DEBUG, "called %d-%d [%s:%d]\n", bi->min, bi->max,
+			binfo != NULL ? binfo->name : "Avg", minutes);
+
+	/* unknown while charging or if the rate isn't known yet */
+	if (minutes < 0)
+		return DONT_MATCH;
+
+	return (minutes >= bi->min && minutes <= bi->max) ? MATCH : DONT_MATCH;
+}
+
+static int is_discharging(const struct battery_info *binfo) {
+	return strncmp(binfo->status_value, "Discharging", 11) == 0;
+}
+
+/* feeds the rate just read from hw to the exponentially weighted
+ * moving average, the weight depends on the time since the last sample
+ * so that irregular reads (events) don't skew it
+ */
+static void update_rate(struct battery_info *binfo, double now) {
+	double sample = abs(binfo->present_rate);
+	double dt = now - binfo->rate_stamp;
+
+	if (!is_discharging(binfo) || sample <= 0) {
+		binfo->rate = 0.0;
+	} else if (binfo->rate <= 0.0) {
+		binfo->rate = sample;
+	} else {
+		binfo->rate += (sample - binfo->rate) * dt / (RATE_TIME_CONSTANT + dt);
+	}
+	binfo->rate_stamp = now;
+}
+
+/* only report changes larger than TIME_DEADBAND minutes so that
+ * a noisy rate doesn't make rules flip
+ */
+static void report_minutes(int *reported, int estimate) {
+	if (estimate < 0 || *reported < 0 || abs(estimate - *reported) >= TIME_DEADBAND)
+		*reported = estimate;
+}
+
+/*  void acpi_battery_uevent(const struct acpi_uevent *ev)
+ *
+ *  batteries coming and going trigger a rescan, changes
+ *  force the battery to be read at the next update
+ */
+void acpi_battery_uevent(const struct acpi_uevent *ev) {
+	const char *type = acpi_uevent_get(ev, "POWER_SUPPLY_TYPE");
+	const char *value = NULL;
+	struct battery_info *binfo = NULL;
+
+	if (strcmp(ev->action, "add") == 0 || strcmp(ev->action, "remove") == 0) {
+		if (type == NULL || strcmp(type, BATTERY_TYPE) == 0)
+			battery_rescan = 1;
+		return;
+	}
+	if ((binfo = get_battery_info(ev->name)) == NULL) {
+		if (type != NULL && strcmp(type, BATTERY_TYPE) == 0)
+			battery_rescan = 1;
+		return;
+	}
+	if ((value = acpi_uevent_get(ev, "POWER_SUPPLY_PRESENT")) != NULL)
+		binfo->is_present = atoi(value);
+	if ((value = acpi_uevent_get(ev, "POWER_SUPPLY_STATUS")) != NULL)
+		snprintf(binfo->status_value, sizeof(binfo->status_value),
+				"%s", value);
+	/* levels and rate are read again at the next update */
+	binfo->stale = 1;
+	clog(LOG_DEBUG, "%s changed (%s)\n", ev->name, binfo->status_value);
+}
+
 /*  static int acpi_battery_update(void)
  *
  *  reads temperature valuse ant compute a medium value
  */
 int acpi_battery_update(void) {
-	int i = 0, total_capacity = 0, total_remaining = 0, n_read = 0;
+	struct battery_info *binfo = NULL;
+	unsigned int i = 0;
+	int total_capacity = 0, total_remaining = 0, n_read = 0;
+	int drain_remaining = 0, estimate = 0;
+	double drain_rate = 0.0;
 	double elapsed_time = 0.0;
-	double current_time = 0.0;
-#if 0
-	int remaining_hours=0, remaining_minutes=0;
-	double remaining_secs = 0.0;
-#endif
-	struct cpufreqd_info * cinfo = get_cpufreqd_info();
+	double current_time = monotonic_time();
 
-	current_time = (double)cinfo->timestamp.tv_sec + (cinfo->timestamp.tv_usec/1000000.0);
 	elapsed_time = current_time - old_time;
 	old_time = current_time;
 	/* decrement timeout */
 	check_timeout -= elapsed_time;
 
 	/* if there is a pending event rescan batteries */
-	if (is_event_pending()) {
+	if (is_event_pending() || battery_rescan) {
 		clog(LOG_NOTICE, "Re-scanning available batteries\n");
-		acpi_battery_exit();
-		acpi_battery_init();
+		battery_rescan = 0;
+		scan_batteries();
 		/* force timeout expiration */
 		check_timeout = -1;
 	}
 
 	/* Read battery informations */
-	for (i = 0; i < bat_dir_num; i++) {
+	for (i = 0; i < batteries.count; i++) {
+		binfo = acpi_registry_get(&batteries, i);
+
+		/* not plugged */
+		if (binfo->cdev == NULL)
+			continue;
 
-		if (read_int(info[i].present, &info[i].is_present) != 0) {
-			clog(LOG_INFO, "Skipping %s\n", info[i].cdev->name);
+		if (!binfo->open) {
+			clog(LOG_INFO, "Skipping %s\n", binfo->name);
+			continue;
+		}
+		/* without uevents insertion and removal must be polled */
+		if (!acpi_uevents_active() &&
+				read_int(binfo->present, &binfo->is_present) != 0) {
+			clog(LOG_INFO, "Skipping %s\n", binfo->name);
 			continue;
 		}
 
 		/* if battery not open or not present skip to the next one */
-		if (!info[i].open || !info[i].is_present || info[i].capacity <= 0) {
+		if (!binfo->open || !binfo->is_present || binfo->capacity <= 0) {
 			continue;
 		}
-		clog(LOG_INFO, "%s - present\n", info[i].cdev->name);
+		clog(LOG_INFO, "%s - present\n", binfo->name);
 
-		/* if check_timeout is expired */
-		if (check_timeout <= 0) {
-			if (read_battery(&info[i]) == 0)
+		/* if check_timeout is expired or the kernel told about a change */
+		if (check_timeout <= 0 || binfo->stale) {
+			if (read_battery(binfo) == 0) {
+				update_rate(binfo, current_time);
 				n_read++;
-			else
+			} else
 				clog(LOG_INFO, "Unable to read battery %s\n",
-						info[i].cdev->name);
+						binfo->name);
 		} else {
 			/* estimate battery life */
 			clog(LOG_DEBUG, "%s - estimating battery life (timeout: %0.2f"
 					" - status: %s)\n",
-					info[i].cdev->name, check_timeout,
-					info[i].status->value);
+					binfo->name, check_timeout,
+					binfo->status_value);
 
-			if (strncmp(info[i].status->value, "Discharging", 11) == 0)
-				info[i].remaining -= ((float)info[i].present_rate * elapsed_time) / 3600.0;
+			if (is_discharging(binfo))
+				binfo->remaining -= (binfo->rate * elapsed_time) / 3600.0;
 
-			else if (strncmp(info[i].status->value, "Full", 4) != 0 &&
-					(int)info[i].remaining < info[i].capacity)
-				info[i].remaining += ((float)info[i].present_rate * elapsed_time) / 3600.0;
+			else if (strncmp(binfo->status_value, "Full", 4) != 0 &&
+					(int)binfo->remaining < binfo->capacity)
+				binfo->remaining += ((float)binfo->present_rate * elapsed_time) / 3600.0;
 
 			clog(LOG_DEBUG, "%s - remaining capacity: %d\n",
-					info[i].cdev->name, info[i].remaining);
+					binfo->name, binfo->remaining);
 		}
 		n_read++;
-		total_remaining += info[i].remaining;
-		total_capacity += info[i].capacity;
+		total_remaining += binfo->remaining;
+		total_capacity += binfo->capacity;
 
-		info[i].level = 100 * (info[i].remaining / (double)info[i].capacity);
-		clog(LOG_INFO, "battery life for %s is %d%%\n", info[i].cdev->name, info[i].level);
-#if 0
-		if (info[i].present_rate > 0) {
-			remaining_secs = 3600 * info[i].remaining / info[i].present_rate;
-			remaining_hours = (int) remaining_secs / 3600;
-			remaining_minutes = (remaining_secs - (remaining_hours * 3600)) / 60;
-			clog(LOG_INFO, "battery time for %s is %d:%0.2d\n",
-					info[i].cdev->name, remaining_hours, remaining_minutes);
+		binfo->level = 100 * (binfo->remaining / (double)binfo->capacity);
+		clog(LOG_INFO, "battery life for %s is %d%%\n", binfo->name, binfo->level);
+
+		estimate = -1;
+		if (is_discharging(binfo) && binfo->rate > 0.0) {
+			estimate = (int)(60.0 * binfo->remaining / binfo->rate);
+			drain_remaining += binfo->remaining;
+			drain_rate += binfo->rate;
 		}
-#endif
+		report_minutes(&binfo->minutes, estimate);
+		if (binfo->minutes >= 0)
+			clog(LOG_INFO, "battery time for %s is %d:%0.2d\n",
+					binfo->name, binfo->minutes / 60,
+					binfo->minutes % 60);
 	} /* end info loop */
 
 	/* check_timeout is global for all batteries, so update it after all batteries got updated */
@@ -377,9 +550,53 @@ int acpi_battery_update(void) {
 
 	clog(LOG_INFO, "average battery life %d%%\n", avg_battery_level);
 
+	/* all the discharging batteries drain together */
+	report_minutes(&avg_battery_time,
+			drain_rate > 0.0 ? (int)(60.0 * drain_remaining / drain_rate) : -1);
+	if (avg_battery_time >= 0)
+		clog(LOG_INFO, "battery time left %d minutes\n", avg_battery_time);
+
 	return 0;
 }
 
+/* warm start: the smoothed discharge rates, so that the time left
+ * isn't estimated again from a single reading
+ */
+int acpi_battery_save(FILE *fp) {
+	struct battery_info *binfo = NULL;
+	unsigned int i = 0;
+	int n = 0;
+
+	for (i = 0; i < batteries.count; i++) {
+		binfo = acpi_registry_get(&batteries, i);
+		if (binfo->cdev == NULL || binfo->rate <= 0.0)
+			continue;
+		fprintf(fp, "%s%s:%.1f", n++ > 0 ? " " : "", binfo->name, binfo->rate);
+	}
+	return n > 0 ? 0 : -1;
+}
+
+/* the rates of batteries still there are taken as just sampled */
+int acpi_battery_restore(const char *snapshot) {
+	struct battery_info *binfo = NULL;
+	char *copy = strdup(snapshot), *token = NULL, *rate = NULL;
+	double now = monotonic_time();
+
+	if (copy == NULL)
+		return -1;
+	for (token = strtok(copy, " "); token != NULL; token = strtok(NULL, " ")) {
+		if ((rate = strrchr(token, ':')) == NULL)
+			continue;
+		*rate++ = '\0';
+		if ((binfo = get_battery_info(token)) == NULL)
+			continue;
+		binfo->rate = strtod(rate, NULL);
+		binfo->rate_stamp = now;
+		clog(LOG_DEBUG, "%s - discharge rate %.1f\n", binfo->name, binfo->rate);
+	}
+	free(copy);
+	return 0;
+}
 
 #if 0
 static struct cpufreqd_keyword kw[] = {
@@ -17,8 +17,16 @@
  *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
+#include <stdio.h>
+
+struct acpi_uevent;
+
 short int acpi_battery_init(void);
 short int acpi_battery_exit(void);
 int acpi_battery_parse(const char *ev, void **obj);
 int acpi_battery_evaluate(const void *s);
+int acpi_battery_time_evaluate(const void *s);
 int acpi_battery_update(void);
+void acpi_battery_uevent(const struct acpi_uevent *ev);
+int acpi_battery_save(FILE *fp);
+int acpi_battery_restore(const char *snapshot);
@@ -19,258 +19,202 @@
  *  -----------------
  *  This plugin allows cpufreqd to monitor acpi events and process them.
  *
- *  It supports both direct /proc/acpi/event and acpid socket reading.
+ *  Power supply and thermal changes are read from the kernel uevents
+ *  the core cpufreqd listens to (see uevent.h), power supply ones ask
+ *  for a Rule pass. The acpid socket is only used as a fallback where
+ *  uevents are not available, it is set up to raise SIGALRM when data
+ *  arrives so that cpufreqd wakes up immediately, and drained from the
+ *  plugin update.
  */
 #include <errno.h>
 #include <fcntl.h>
-#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/poll.h>
 #include <sys/socket.h>
-#include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/un.h>
-#include <sys/wait.h>
-#include <time.h>
 #include <unistd.h>
 #include "cpufreqd_plugin.h"
 #include "cpufreqd_acpi.h"
+#include "cpufreqd_acpi_ac.h"
+#include "cpufreqd_acpi_battery.h"
 #include "cpufreqd_acpi_event.h"
+#include "cpufreqd_acpi_temperature.h"
+#include "uevent.h"
 
-struct acpi_event {
-	char *device_class;
-	char *bus_id;
-	unsigned int type;
-	unsigned int data;
-	struct acpi_event *next;
-};
+#define ACPID_BUF_SIZE		8192
+#define POWER_SUPPLY		"power_supply"
+#define THERMAL			"thermal"
 
-static int acpi_event_active;
-
-static pthread_t event_thread;
-static pthread_mutex_t event_mutex = PTHREAD_MUTEX_INITIALIZER;
-static int event_fd;
+static short uevents;	/* subscribed to the core uevents */
+static int acpid_fd = -1;
 static short event_pending;
+static char event_buf[ACPID_BUF_SIZE];
 extern struct acpi_configuration acpi_config;
 
-static void close_acpi_event(void) {
-	if (event_fd) {
-		clog(LOG_DEBUG, "closing event handle.\n");
-		if (close(event_fd))
-			clog(LOG_ERR, "Couldn't close the ACPI event handler (%s).\n",
-					strerror(errno));
+/* deliver SIGALRM to cpufreqd whenever fd becomes readable */
+static int set_async(int fd) {
+	if (fcntl(fd, F_SETOWN, getpid()) == -1
+			|| fcntl(fd, F_SETSIG, SIGALRM) == -1
+			|| fcntl(fd, F_SETFL, O_NONBLOCK | O_ASYNC) == -1) {
+		clog(LOG_ERR, "Couldn't set up asynchronous notification (%s).\n",
+				strerror(errno));
+		return -1;
 	}
-	event_fd = 0;
+	return 0;
 }
 
-static int open_acpi_event (void) {
-#if 0
-	/* try to open /proc/acpi/event */
-	event_fd = open("/proc/acpi/event", O_RDONLY);
-#endif
-	/* or fallback to the acpid socket */
-	if (event_fd <= 0 && acpi_config.acpid_sock_path[0]) {
-		struct sockaddr_un sck;
-		sck.sun_family = AF_UNIX;
-		strncpy(sck.sun_path, acpi_config.acpid_sock_path, 108);
-		sck.sun_path[107] = '\0';
+static void close_acpid(void) {
+	if (acpid_fd != -1) {
+		clog(LOG_DEBUG, "closing acpid socket.\n");
+		close(acpid_fd);
+	}
+	acpid_fd = -1;
+}
 
-		if ((event_fd = socket(PF_UNIX, SOCK_STREAM, 0)) == -1) {
-			clog(LOG_ERR, "Couldn't open acpid socket (%s).\n",
-					strerror(errno));
-			event_fd = 0;
-			return -1;
-		}
+static int open_acpid(void) {
+	struct sockaddr_un sck;
 
-		if (connect(event_fd, (struct sockaddr *)&sck, sizeof(sck)) == -1) {
-			clog(LOG_NOTICE, "Couldn't connect to acpid socket %s (%s).\n",
-					acpi_config.acpid_sock_path, strerror(errno));
-			close_acpi_event();
-			return -1;
-		}
-	} else if (event_fd <= 0) {
-		clog(LOG_ERR, "Couldn't open ACPI event device (%s).\n",
-				strerror(errno));
-		event_fd = 0;
-		return -1;
-	} else if (!acpi_config.acpid_sock_path[0]) {
-		clog(LOG_ERR, "No acpid socket given (%s).\n", acpi_config.acpid_sock_path);
-		return -1;
-	} else {
-		clog(LOG_ERR, "Unknown error (%d)-(%s).\n", event_fd, acpi_config.acpid_sock_path);
+	if (!acpi_config.acpid_sock_path[0])
 		return -1;
 
-	}
+	sck.sun_family = AF_UNIX;
+	strncpy(sck.sun_path, acpi_config.acpid_sock_path, 108);
+	sck.sun_path[107] = '\0';
 
-	if (fcntl(event_fd, F_SETFL, O_NONBLOCK) == -1) {
-		clog(LOG_ERR, "Couldn't set O_NONBLOCK on ACPI event handler (%s).\n",
+	if ((acpid_fd = socket(PF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1) {
+		clog(LOG_ERR, "Couldn't open acpid socket (%s).\n",
 				strerror(errno));
-		close(event_fd);
 		return -1;
 	}
+	if (connect(acpid_fd, (struct sockaddr *)&sck, sizeof(sck)) == -1) {
+		clog(LOG_NOTICE, "Couldn't connect to acpid socket %s (%s).\n",
+				acpi_config.acpid_sock_path, strerror(errno));
+		close_acpid();
+		return -1;
+	}
+	if (set_async(acpid_fd) != 0) {
+		close_acpid();
+		return -1;
+	}
+	clog(LOG_INFO, "connected to acpid (%s).\n", acpi_config.acpid_sock_path);
 	return 0;
 }
 
-/*  Waits for ACPI events on the file descriptor opened previously.
- *  This function uses poll(2) to wait for readable data in order
- *  to only wake cpufreqd once in case multiple events are available.
- */
-static void *event_wait (void __UNUSED__ *arg) {
-	struct pollfd rfd;
-	char buf[MAX_STRING_LEN];
-	int read_chars = 0, ret = 0;
-
-	clog(LOG_DEBUG, "event thread running.\n");
-	pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, NULL);
-	pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+/* looks up `key` in the KEY=VALUE environment of the event */
+const char *acpi_uevent_get(const struct acpi_uevent *ev, const char *key) {
+	return uevent_get(ev->uevent, key);
+}
 
-	rfd.events = POLLIN | POLLPRI;
+static void make_acpi_uevent(const struct uevent *uev, struct acpi_uevent *ev) {
+	ev->uevent = uev;
+	ev->action = uev->action;
+	ev->name = uevent_get(uev, "POWER_SUPPLY_NAME");
+	if (ev->name == NULL) {
+		/* older kernels don't export the name, use the devpath */
+		ev->name = strrchr(uev->devpath, '/');
+		ev->name = ev->name ? ev->name + 1 : uev->devpath;
+	}
+	clog(LOG_DEBUG, "%s %s\n", ev->action, ev->name);
+}
 
-	while (1) {
-		while (!event_fd && open_acpi_event() != 0) {
-			struct timespec req = { .tv_sec = 5, .tv_nsec = 0 };
-			nanosleep(&req, NULL);
-		}
+/* ac and battery changes may select another Rule */
+static int power_supply_uevent(const struct uevent *uev) {
+	struct acpi_uevent ev;
 
-		rfd.fd = event_fd;
-		rfd.revents = 0;
-		ret = poll(&rfd, 1, -1);
+	if (uev == NULL) {
+		/* dropped some, rescan everything */
+		event_pending = 1;
+		return 1;
+	}
+	make_acpi_uevent(uev, &ev);
+	acpi_ac_uevent(&ev);
+	acpi_battery_uevent(&ev);
+	return 1;
+}
 
-		if (ret < 0) {
-			clog(LOG_ERR, "Error polling ACPI Event handler: %s\n",
-					strerror(errno));
-			if (errno == EINTR)
-				close_acpi_event();
-			continue;
-		}
+/* temperatures are read at each update anyway */
+static int thermal_uevent(const struct uevent *uev) {
+	struct acpi_uevent ev;
 
-		/* barf and exit on any error condition */
-		/* close the FD and try too reopen it every 5 seconds */
-		if (rfd.revents & ~POLLIN) {
-			clog(LOG_ERR, "Error polling ACPI Event handler (0x%.4x).\n",
-					rfd.revents);
-			close_acpi_event();
-			continue;
-		}
-		while ((read_chars = read(event_fd, buf, MAX_STRING_LEN-1)) > 0) {
-			buf[read_chars-1] = '\0';
-			clog(LOG_DEBUG, "%s (%d)\n", buf, read_chars);
-		}
+	if (uev == NULL)
+		return 0;
+	make_acpi_uevent(uev, &ev);
+	acpi_temperature_uevent(&ev);
+	return 0;
+}
 
-		if (read_chars < 0 && errno != EAGAIN && errno != EINTR) {
-			clog(LOG_DEBUG, "Error reading the ACPI event handler (%d)\n",
-					strerror(errno), read_chars);
-			close_acpi_event();
-			continue;
-		} else if (read_chars == 0) {
-			clog(LOG_DEBUG, "ACPI event handler disappeared.\n");
-			close_acpi_event();
-			continue;
-		}
+static void read_acpid(void) {
+	ssize_t len = 0;
+	int got_event = 0;
 
-		/* mark pending event */
-		acpi_event_lock();
-		event_pending = 1;
-		acpi_event_unlock();
-		/* Ring the bell!! */
-		wake_cpufreqd();
+	while ((len = read(acpid_fd, event_buf, ACPID_BUF_SIZE - 1)) > 0) {
+		event_buf[len - 1] = '\0';
+		clog(LOG_DEBUG, "%s (%d)\n", event_buf, (int)len);
+		got_event = 1;
+	}
+	if (len == 0 || (len < 0 && errno != EAGAIN && errno != EINTR)) {
+		clog(LOG_NOTICE, "acpid socket disappeared.\n");
+		close_acpid();
 	}
+	/* acpid events carry nothing useful to us, reread everything */
+	if (got_event)
+		event_pending = 1;
+}
 
-	/* set acpi_event as inactive */
-	acpi_event_active = 0;
+/* Drains the pending acpid events, called from the plugin update */
+int acpi_event_update(void) {
+	if (uevents)
+		return 0;
+	/* acpid might have been restarted */
+	if (acpid_fd == -1 && open_acpid() == 0)
+		event_pending = 1;
+	if (acpid_fd != -1)
+		read_acpid();
+	return 0;
+}
 
-	return NULL;
+/* tells whether ac and battery changes are pushed by the kernel */
+int acpi_uevents_active(void) {
+	return uevents;
 }
 
 int is_event_pending(void) {
-	return event_pending && acpi_event_active;
+	return event_pending;
 }
 
 void reset_event(void) {
 	event_pending = 0;
 }
 
-int acpi_event_lock (void) {
-	return pthread_mutex_lock(&event_mutex);
-}
-
-int acpi_event_unlock (void) {
-	return pthread_mutex_unlock(&event_mutex);
-}
-
-/* Launch the thread that will wait for acpi events
- */
 short int acpi_event_init (void) {
-	int ret = 0;
-
+	/* rescan at the first update */
 	event_pending = 1;
 
-	/* launch exec thread */
-	if ((ret = pthread_create(&event_thread, NULL, &event_wait, NULL)) != 0) {
-		clog(LOG_ERR, "Unable to launch thread: %s\n", strerror(ret));
-		return -1;
+	if (uevent_subscribe(POWER_SUPPLY, &power_supply_uevent) == 0
+			&& uevent_subscribe(THERMAL, &thermal_uevent) == 0) {
+		clog(LOG_INFO, "listening to power supply uevents.\n");
+		uevents = 1;
+		return 0;
 	}
-	acpi_event_active = 1;
-	return 0;
+	uevent_unsubscribe(&power_supply_uevent);
+	if (open_acpid() == 0)
+		return 0;
+
+	clog(LOG_NOTICE, "No event source available, polling.\n");
+	return -1;
 }
 
 short int acpi_event_exit (void) {
-	int ret = 0;
-
-	if (event_thread) {
-		clog(LOG_DEBUG, "killing event thread.\n");
-		ret = pthread_cancel(event_thread);
-		if (ret != 0)
-			clog(LOG_ERR, "Couldn't cancel event thread (%s).\n",
-					strerror(ret));
-
-		/* cleanup */
-		ret = pthread_join(event_thread, NULL);
-		if (ret != 0)
-			clog(LOG_ERR, "Couldn't join event thread (%s).\n",
-					strerror(ret));
-		event_thread = 0;
+	if (uevents) {
+		uevent_unsubscribe(&power_supply_uevent);
+		uevent_unsubscribe(&thermal_uevent);
+		uevents = 0;
 	}
-
-	/* just in case the event thread missed it */
-	close_acpi_event();
+	close_acpid();
 
 	clog(LOG_INFO, "acpi_event exited.\n");
 	return 0;
 }
-
-#if 0
-static int acpi_event_update(void) {
-	if (!event_fd && !event_thread) {
-		acpi_event_exit();
-		acpi_event_init();
-	}
-	return 0;
-}
-#endif
-
-#if 0
-static struct cpufreqd_keyword kw[] =  {
-	{ .word = NULL, }
-};
-
-static struct cpufreqd_plugin plugin =  {
-	.plugin_name = "acpi_event",
-	.keywords = kw,
-	.plugin_init = NULL,
-	.plugin_exit = &acpi_event_exit,
-	.plugin_update = NULL, /*&acpi_event_update,*/
-	.plugin_conf = &acpi_event_conf,
-	.plugin_post_conf = &acpi_event_init,
-};
-
-/*
- *  A cpufreqd plugin MUST define the following function to provide the
- *  core cpufreqd with the correct struct cpufreqd_plugin structure
- */
-struct cpufreqd_plugin *create_plugin(void) {
-	return &plugin;
-}
-#endif
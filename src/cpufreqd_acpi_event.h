@@ -19,13 +19,28 @@
  *  -----------------
  *  This plugin allows cpufreqd to monitor acpi events and process them.
  *
- *  It supports both direct /proc/acpi/event and acpid socket reading.
+ *  It supports both kernel uevents and acpid socket reading.
  */
 
-int acpi_event_conf (const char *key, const char *value);
+#ifndef __CPUFREQD_ACPI_EVENT_H__
+#define __CPUFREQD_ACPI_EVENT_H__ 1
+
+struct uevent;
+
+/* a power_supply or thermal uevent, valid only during the dispatch */
+struct acpi_uevent {
+	const char *action;	/* add, remove, change... */
+	const char *name;	/* power supply name (AC, BAT0...) */
+	const struct uevent *uevent;
+};
+
+const char *acpi_uevent_get(const struct acpi_uevent *ev, const char *key);
+
 short int acpi_event_init (void);
 short int acpi_event_exit (void);
-int acpi_event_lock (void);
-int acpi_event_unlock (void);
+int acpi_event_update(void);
+int acpi_uevents_active(void);
 int is_event_pending(void);
 void reset_event(void);
+
+#endif
@@ -19,12 +19,20 @@
 
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <float.h>
+#include <fnmatch.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "cpufreqd_plugin.h"
+#include "cpufreq_utils.h"
 #include "cpufreqd_acpi.h"
+#include "cpufreqd_acpi_event.h"
 #include "cpufreqd_acpi_temperature.h"
+#include "sensor_aggregate.h"
+#include "thermal_control.h"
 
 #define THERMAL			"thermal"
 #define THERMAL_TYPE		"acpitz"
@@ -32,46 +40,221 @@
 #define THERMAL_TYPE_ALT	"ACPI thermal zone"
 #define THERMAL_TEMP		"temp"
 
+/* samples kept per zone and the span (seconds) the slope is computed on */
+#define TEMP_HISTORY		16
+#define SLOPE_WINDOW		10.0
+/* °C/s, below this the zone isn't considered to be heating up */
+#define SLOPE_MIN		0.01
+
+struct temp_sample {
+	double time;
+	double temp;	/* °C */
+};
+
 struct thermal_zone {
+	char name[SYSFS_NAME_LEN];	/* registry key */
+	int temperature;
+	int valid;	/* temperature read at the last update */
+	int present;
+	int seen;	/* found by the last scan */
+	struct sysfs_attr *temp;
+	char path[SYSFS_PATH_MAX];
+
+	int trip;		/* lowest passive/hot/critical trip point, 0 if none */
+	int trips_stale;	/* read the trip points again */
+
+	struct temp_sample history[TEMP_HISTORY];	/* ring buffer */
+	unsigned int hist_len, hist_pos;
+	double slope;		/* °C/s, valid if slope_valid */
+	int slope_valid;
+	int trip_time;		/* seconds to trip, -1 if not heading there */
+};
+
+/* zones matching a pattern, aggregated once per update */
+struct zone_group {
+	char name[SYSFS_NAME_LEN];	/* registry key, pattern:aggregation */
+	char pattern[SYSFS_NAME_LEN];
+	int how;	/* enum sensor_aggregate */
 	int temperature;
-	struct sysfs_class_device *cdev;
-	struct sysfs_attribute *temp;
+	int valid;
+	double slope;	/* °C/s, aggregated over the zones having one */
+	int slope_valid;
 };
 
 struct temperature_interval {
 	int min, max;
-	struct thermal_zone *tz;
+	int tz;		/* zone index, -1 for the average */
+	int group;	/* group index, -1 if none */
 };
 
-static struct thermal_zone atz_list[64];
-static int atz_dir_num;
-static long int temp_avg;
+struct slope_interval {
+	double min, max;
+	int tz;		/* zone index, -1 for the fastest heating zone */
+	int group;	/* group index, -1 if none */
+};
+
+/* temperature_target Profile directives */
+struct temperature_target {
+	struct thermal_control *ctl;
+	int tz;		/* zone index, -1 for the hottest zone */
+	int group;	/* group index, -1 if none */
+	struct temperature_target *next;
+};
 
-static struct thermal_zone *get_thermal_zone(const char *name)
+static struct acpi_registry zones;
+static long int temp_avg;
+static struct sysfs_batch *atz_batch;
+static int atz_rescan;
+static struct temperature_target *targets;
+static struct acpi_registry groups;
+static double *group_values;	/* scratch for the aggregation */
+static unsigned int group_values_size;
+
+static void close_zone(struct thermal_zone *tz)
 {
-	int i;
-	struct thermal_zone *ret = NULL;
+	if (tz->temp)
+		put_attribute(tz->temp);
+	tz->temp = NULL;
+	tz->present = tz->valid = 0;
+	tz->hist_len = tz->hist_pos = 0;
+	tz->slope_valid = 0;
+	tz->trip_time = -1;
+}
 
-	for (i = 0; i < atz_dir_num; i++) {
-		if (strncmp(atz_list[i].cdev->name, name, 32) == 0) {
-			ret = &atz_list[i];
+/* reads trip_point_N_{type,temp} looking for the lowest trip point where
+ * the platform starts throttling (passive) or worse, active trip points
+ * only turn fans on
+ */
+static void read_trip_points(struct thermal_zone *tz)
+{
+	char path[SYSFS_PATH_MAX];
+	char type[32];
+	struct sysfs_attr *attr = NULL;
+	int i = 0, temp = 0, ok = 0;
+
+	tz->trip = 0;
+	tz->trips_stale = 0;
+	for (i = 0; ; i++) {
+		snprintf(path, sizeof(path), "%s/trip_point_%d_type", tz->path, i);
+		if (access(path, R_OK) != 0)
 			break;
-		}
+		if ((attr = sysfs_attr_open(path, O_RDONLY)) == NULL)
+			continue;
+		ok = sysfs_attr_read(attr, type, sizeof(type)) >= 0;
+		sysfs_attr_close(attr);
+		if (!ok || strcmp(type, "active") == 0)
+			continue;
+
+		snprintf(path, sizeof(path), "%s/trip_point_%d_temp", tz->path, i);
+		if ((attr = sysfs_attr_open(path, O_RDONLY)) == NULL)
+			continue;
+		ok = sysfs_attr_read_int(attr, &temp) == 0;
+		sysfs_attr_close(attr);
+		if (ok && temp > 0 && (tz->trip == 0 || temp < tz->trip))
+			tz->trip = temp;
 	}
-	return ret;
+	if (tz->trip > 0)
+		clog(LOG_DEBUG, "%s trips at %.1fC\n", tz->name,
+				(float)tz->trip / 1000);
+}
+
+/* records the last reading and fits a line through the samples of the
+ * last SLOPE_WINDOW seconds (least squares), the time to trip follows
+ */
+static void update_trend(struct thermal_zone *tz, double now)
+{
+	struct temp_sample *smp = NULL;
+	double st = 0.0, sv = 0.0, stt = 0.0, stv = 0.0, dt = 0.0, den = 0.0;
+	unsigned int i = 0, n = 0;
+
+	smp = &tz->history[tz->hist_pos];
+	smp->time = now;
+	smp->temp = tz->temperature / 1000.0;
+	tz->hist_pos = (tz->hist_pos + 1) % TEMP_HISTORY;
+	if (tz->hist_len < TEMP_HISTORY)
+		tz->hist_len++;
+
+	/* times relative to now keep the sums small */
+	for (i = 0; i < tz->hist_len; i++) {
+		smp = &tz->history[i];
+		dt = smp->time - now;
+		if (dt < -SLOPE_WINDOW)
+			continue;
+		st += dt;
+		sv += smp->temp;
+		stt += dt * dt;
+		stv += dt * smp->temp;
+		n++;
+	}
+	den = n * stt - st * st;
+	tz->slope_valid = n >= 2 && den > DBL_EPSILON;
+	tz->slope = tz->slope_valid ? (n * stv - st * sv) / den : 0.0;
+
+	tz->trip_time = -1;
+	if (tz->trip > 0 && tz->temperature >= tz->trip)
+		tz->trip_time = 0;
+	else if (tz->trip > 0 && tz->slope_valid && tz->slope > SLOPE_MIN)
+		tz->trip_time = (int)((tz->trip - tz->temperature) / 1000.0 / tz->slope);
 }
 
 static int atz_callback(struct sysfs_class_device *cdev)
 {
-	atz_list[atz_dir_num].cdev = cdev;
-	atz_list[atz_dir_num].temp = get_class_device_attribute(cdev,
-			THERMAL_TEMP);
-	if (!atz_list[atz_dir_num].temp)
+	struct thermal_zone *tz = NULL;
+	int idx = acpi_registry_add(&zones, cdev->name);
+
+	if (idx < 0)
 		return 1;
+	tz = acpi_registry_get(&zones, idx);
+	tz->seen = 1;
+	if (!tz->present) {
+		tz->temp = get_class_device_attribute(cdev, THERMAL_TEMP);
+		if (tz->temp) {
+			clog(LOG_DEBUG, "Found %s\n", cdev->name);
+			tz->present = 1;
+			tz->hist_len = tz->hist_pos = 0;
+			tz->slope_valid = 0;
+			tz->trip_time = -1;
+			snprintf(tz->path, sizeof(tz->path), "%s", cdev->path);
+			read_trip_points(tz);
+		}
+	}
+	/* only the attribute is needed */
+	return 1;
+}
 
-	clog(LOG_DEBUG, "Found %s\n", cdev->name);
-	atz_dir_num++;
-	return 0;
+/* (re)reads the available zones, the ones already known are left
+ * untouched, the ones gone are closed. The batch is rebuilt.
+ */
+static int scan_zones(void)
+{
+	struct thermal_zone *tz = NULL;
+	unsigned int i = 0;
+	int count = 0;
+
+	for (i = 0; i < zones.count; i++)
+		((struct thermal_zone *)acpi_registry_get(&zones, i))->seen = 0;
+
+	find_class_device(THERMAL, THERMAL_TYPE, atz_callback);
+	/* try with the old type name */
+	find_class_device(THERMAL, THERMAL_TYPE_ALT, atz_callback);
+
+	sysfs_batch_free(atz_batch);
+	if ((atz_batch = sysfs_batch_new()) == NULL)
+		return -1;
+	for (i = 0; i < zones.count; i++) {
+		tz = acpi_registry_get(&zones, i);
+		if (tz->present && !tz->seen) {
+			clog(LOG_INFO, "%s is gone\n", tz->name);
+			close_zone(tz);
+		}
+		if (!tz->present)
+			continue;
+		if (sysfs_batch_add(atz_batch, tz->temp, &tz->temperature,
+					&tz->valid) != 0)
+			return -1;
+		count++;
+	}
+	return count;
 }
 
 /*  static int acpi_temperature_init(void)
@@ -81,61 +264,157 @@ static int atz_callback(struct sysfs_class_device *cdev)
  */
 short int acpi_temperature_init(void)
 {
-	find_class_device(THERMAL, THERMAL_TYPE, atz_callback);
-	/* try with the old type name */
-	if (atz_dir_num <= 0)
-		find_class_device(THERMAL, THERMAL_TYPE_ALT, atz_callback);
-	if (atz_dir_num <= 0) {
-		clog(LOG_INFO, "No thermal zones found\n");
+	int count = 0;
+
+	acpi_registry_init(&zones, sizeof(struct thermal_zone));
+	acpi_registry_init(&groups, sizeof(struct zone_group));
+	if ((count = scan_zones()) < 0) {
+		acpi_temperature_exit();
 		return -1;
 	}
-	clog(LOG_NOTICE, "found %d ACPI Thermal Zone%s\n", atz_dir_num,
-			atz_dir_num > 1 ? "s" : "");
+	if (count == 0)
+		clog(LOG_INFO, "No thermal zones found\n");
+	else
+		clog(LOG_NOTICE, "found %d ACPI Thermal Zone%s\n", count,
+				count > 1 ? "s" : "");
 	return 0;
 }
 
 short int acpi_temperature_exit(void)
 {
-	while (--atz_dir_num >= 0) {
-		put_attribute(atz_list[atz_dir_num].temp);
-		put_class_device(atz_list[atz_dir_num].cdev);
-	}
+	unsigned int i = 0;
+
+	for (i = 0; i < zones.count; i++)
+		close_zone(acpi_registry_get(&zones, i));
+	acpi_registry_free(&zones);
+	acpi_registry_free(&groups);
+	free(group_values);
+	group_values = NULL;
+	group_values_size = 0;
+	sysfs_batch_free(atz_batch);
+	atz_batch = NULL;
 	clog(LOG_INFO, "exited.\n");
 	return 0;
 }
 
+/* zones coming and going trigger a rescan at the next update,
+ * trip points are read again when a zone changes
+ */
+void acpi_temperature_uevent(const struct acpi_uevent *ev)
+{
+	int idx = 0;
+
+	if (strcmp(ev->action, "add") == 0 || strcmp(ev->action, "remove") == 0) {
+		atz_rescan = 1;
+		return;
+	}
+	if ((idx = acpi_registry_find(&zones, ev->name)) >= 0)
+		((struct thermal_zone *)acpi_registry_get(&zones, idx))->trips_stale = 1;
+}
+
+/* zones named in rules might not be there yet, they're
+ * added to the registry and will be used when they show up.
+ * Adding may move the registry entries the batch points to,
+ * so it is rebuilt before the next read.
+ */
+static int parse_zone(const char *name)
+{
+	int idx = acpi_registry_find(&zones, name);
+
+	if (idx < 0) {
+		clog(LOG_WARNING, "thermal zone %s not found (yet)\n", name);
+		idx = acpi_registry_add(&zones, name);
+		atz_rescan = 1;
+	}
+	return idx;
+}
+
+/* parses pattern:aggregation: at the beginning of ev, groups are shared
+ * by the directives using the same pattern and aggregation.
+ * Returns 1 and the group index if found, 0 if ev doesn't start with a
+ * group, -1 on errors
+ */
+static int parse_group(const char *ev, int *group, const char **rest)
+{
+	char key[SYSFS_NAME_LEN];
+	const char *colon = strchr(ev, ':');
+	const char *next = NULL;
+	struct zone_group *zg = NULL;
+	int how = -1, idx = -1;
+
+	if (colon == NULL || (next = strchr(colon + 1, ':')) == NULL ||
+			(how = sensor_aggregate_parse(colon + 1,
+					(size_t)(next - colon - 1))) < 0)
+		return 0;
+
+	if ((size_t)snprintf(key, sizeof(key), "%.*s", (int)(next - ev), ev)
+			>= sizeof(key)) {
+		clog(LOG_ERR, "pattern too long (%s)\n", ev);
+		return -1;
+	}
+	if ((idx = acpi_registry_find(&groups, key)) < 0) {
+		if ((idx = acpi_registry_add(&groups, key)) < 0)
+			return -1;
+		zg = acpi_registry_get(&groups, idx);
+		snprintf(zg->pattern, sizeof(zg->pattern), "%.*s",
+				(int)(colon - ev), ev);
+		zg->how = how;
+	}
+	*group = idx;
+	*rest = next + 1;
+	return 1;
+}
+
 int acpi_temperature_parse(const char *ev, void **obj)
 {
-	char atz_name[32];
+	char atz_name[SYSFS_NAME_LEN];
+	const char *range = NULL;
+	int grouped = 0;
 	struct temperature_interval *ret = calloc(1, sizeof(struct temperature_interval));
 	if (ret == NULL) {
 		clog(LOG_ERR, "couldn't make enough room for temperature_interval (%s)\n",
 				strerror(errno));
 		return -1;
 	}
+	ret->tz = -1;
+	ret->group = -1;
 
 	clog(LOG_DEBUG, "called with: %s\n", ev);
 
+	/* pattern:aggregation:%d-%d or pattern:aggregation:%d */
+	if ((grouped = parse_group(ev, &(ret->group), &range)) < 0) {
+		free(ret);
+		return -1;
+	}
+	if (grouped) {
+		if (sscanf(range, "%d-%d", &(ret->min), &(ret->max)) != 2) {
+			if (sscanf(range, "%d", &(ret->min)) != 1) {
+				free(ret);
+				return -1;
+			}
+			ret->max = ret->min;
+		}
+		clog(LOG_INFO, "parsed %s %d-%d\n", ((struct zone_group *)
+					acpi_registry_get(&groups, ret->group))->name,
+				ret->min, ret->max);
+
 	/* try to parse the %[a-zA-Z0-9]:%d-%d format first */
-	if (sscanf(ev, "%32[a-zA-Z0-9_]:%d-%d", atz_name, &(ret->min), &(ret->max)) == 3) {
-		/* validate zone name and assign pointer to struct thermal_zone */
-		if ((ret->tz = get_thermal_zone(atz_name)) == NULL) {
-			clog(LOG_ERR, "non existent thermal zone %s!\n", atz_name);
+	} else if (sscanf(ev, "%63[a-zA-Z0-9_]:%d-%d", atz_name, &(ret->min), &(ret->max)) == 3) {
+		/* look up the zone and keep its index */
+		if ((ret->tz = parse_zone(atz_name)) < 0) {
 			free(ret);
 			return -1;
 		}
-		clog(LOG_INFO, "parsed %s %d-%d\n",
-				ret->tz->cdev->name, ret->min, ret->max);
+		clog(LOG_INFO, "parsed %s %d-%d\n", atz_name, ret->min, ret->max);
 
-	} else if (sscanf(ev, "%32[a-zA-Z0-9_]:%d", atz_name, &(ret->min)) == 2) {
-		/* validate zone name and assign pointer to struct thermal_zone */
-		if ((ret->tz = get_thermal_zone(atz_name)) == NULL) {
-			clog(LOG_ERR, "non existent thermal zone %s!\n", atz_name);
+	} else if (sscanf(ev, "%63[a-zA-Z0-9_]:%d", atz_name, &(ret->min)) == 2) {
+		/* look up the zone and keep its index */
+		if ((ret->tz = parse_zone(atz_name)) < 0) {
 			free(ret);
 			return -1;
 		}
 		ret->max = ret->min;
-		clog(LOG_INFO, "parsed %s %d\n", ret->tz->cdev->name, ret->min);
+		clog(LOG_INFO, "parsed %s %d\n", atz_name, ret->min);
 
 	} else if (sscanf(ev, "%d-%d", &(ret->min), &(ret->max)) == 2) {
 		clog(LOG_INFO, "parsed %d-%d\n", ret->min, ret->max);
@@ -162,39 +441,371 @@ int acpi_temperature_parse(const char *ev, void **obj)
 int acpi_temperature_evaluate(const void *s)
 {
 	const struct temperature_interval *ti = (const struct temperature_interval *)s;
+	const struct thermal_zone *tz = NULL;
+	const struct zone_group *zg = NULL;
 	long int temp = temp_avg;
 
-	if (ti != NULL && ti->tz != NULL)
-		temp = ti->tz->temperature;
+	if (ti->group >= 0) {
+		zg = acpi_registry_get(&groups, ti->group);
+		if (!zg->valid)
+			return DONT_MATCH;
+		clog(LOG_DEBUG, "called %d-%d [%s:%.1f]\n", ti->min, ti->max,
+				zg->name, (float)zg->temperature / 1000);
+		return (zg->temperature <= (ti->max * 1000) &&
+				zg->temperature >= (ti->min * 1000)) ? MATCH : DONT_MATCH;
+	}
+	if (ti->tz >= 0) {
+		tz = acpi_registry_get(&zones, ti->tz);
+		/* a zone that isn't there doesn't match */
+		if (!tz->present || !tz->valid)
+			return DONT_MATCH;
+		temp = tz->temperature;
+	}
 
 	clog(LOG_DEBUG, "called %d-%d [%s:%.1f]\n", ti->min, ti->max,
-			ti != NULL && ti->tz != NULL ? ti->tz->cdev->name : "Avg",
-			(float)temp / 1000);
+			tz != NULL ? tz->name : "Avg", (float)temp / 1000);
 
 	return (temp <= (ti->max * 1000) && temp >= (ti->min * 1000)) ? MATCH : DONT_MATCH;
 }
 
+/* parses min-max or min- (no upper bound), e.g. 0.5- or -1-0.5.
+ * A lone value is refused: -0.5 could either be a negative bound or an
+ * upper bound of 0.5, the latter is written -inf-0.5
+ */
+static int parse_float_range(const char *s, double *min, double *max)
+{
+	char *end = NULL;
+	double v = strtod(s, &end);
+
+	*min = -DBL_MAX;
+	*max = DBL_MAX;
+	if (end == s)
+		return -1;
+	if (*end == '\0') {
+		clog(LOG_ERR, "%s is not a range, use min-max, min- or -inf-max\n", s);
+		return -1;
+	}
+	if (*end != '-')
+		return -1;
+	*min = v;
+	s = end + 1;
+	if (*s == '\0')
+		return 0;
+	*max = strtod(s, &end);
+	return (end == s || *end != '\0') ? -1 : 0;
+}
+
+int acpi_temperature_slope_parse(const char *ev, void **obj)
+{
+	char atz_name[SYSFS_NAME_LEN];
+	const char *range = ev;
+	int grouped = 0;
+	struct slope_interval *ret = calloc(1, sizeof(struct slope_interval));
+	if (ret == NULL) {
+		clog(LOG_ERR, "couldn't make enough room for slope_interval (%s)\n",
+				strerror(errno));
+		return -1;
+	}
+	ret->tz = -1;
+	ret->group = -1;
+
+	clog(LOG_DEBUG, "called with: %s\n", ev);
+
+	if ((grouped = parse_group(ev, &ret->group, &range)) < 0) {
+		free(ret);
+		return -1;
+	}
+	if (grouped) {
+		snprintf(atz_name, sizeof(atz_name), "%s", ((struct zone_group *)
+					acpi_registry_get(&groups, ret->group))->name);
+	} else if (sscanf(ev, "%63[a-zA-Z0-9_]", atz_name) == 1 &&
+			ev[strlen(atz_name)] == ':') {
+		if ((ret->tz = parse_zone(atz_name)) < 0) {
+			free(ret);
+			return -1;
+		}
+		range = ev + strlen(atz_name) + 1;
+	}
+	if (parse_float_range(range, &ret->min, &ret->max) != 0) {
+		clog(LOG_ERR, "couldn't parse %s\n", ev);
+		free(ret);
+		return -1;
+	}
+	if (ret->min > ret->max) {
+		clog(LOG_ERR, "Min higher than Max?\n");
+		free(ret);
+		return -1;
+	}
+	clog(LOG_INFO, "parsed %s %g-%g\n", grouped || ret->tz >= 0 ?
+			atz_name : "Max", ret->min, ret->max);
+
+	*obj = ret;
+	return 0;
+}
+
+int acpi_temperature_slope_evaluate(const void *s)
+{
+	const struct slope_interval *si = (const struct slope_interval *)s;
+	const struct thermal_zone *tz = NULL;
+	const struct zone_group *zg = NULL;
+	double slope = -DBL_MAX;
+	unsigned int i = 0;
+	int found = 0;
+
+	if (si->group >= 0) {
+		zg = acpi_registry_get(&groups, si->group);
+		if (!zg->slope_valid)
+			return DONT_MATCH;
+		clog(LOG_DEBUG, "called %g-%g [%s:%.3f]\n", si->min, si->max,
+				zg->name, zg->slope);
+		return (zg->slope >= si->min && zg->slope <= si->max) ?
+			MATCH : DONT_MATCH;
+	}
+	if (si->tz >= 0) {
+		tz = acpi_registry_get(&zones, si->tz);
+		found = tz->present && tz->slope_valid;
+		slope = tz->slope;
+	} else {
+		/* the zone heating up faster */
+		for (i = 0; i < zones.count; i++) {
+			tz = acpi_registry_get(&zones, i);
+			if (tz->present && tz->slope_valid && tz->slope > slope) {
+				slope = tz->slope;
+				found = 1;
+			}
+		}
+		tz = NULL;
+	}
+	if (!found)
+		return DONT_MATCH;
+
+	clog(LOG_DEBUG, "called %g-%g [%s:%.3f]\n", si->min, si->max,
+			tz != NULL ? tz->name : "Max", slope);
+
+	return (slope >= si->min && slope <= si->max) ? MATCH : DONT_MATCH;
+}
+
+static int in_group(int group, const struct thermal_zone *tz)
+{
+	const struct zone_group *zg = acpi_registry_get(&groups, group);
+	return fnmatch(zg->pattern, tz->name, 0) == 0;
+}
+
+/* seconds before reaching the lowest throttling trip point at the
+ * current pace, nothing matches if the zone isn't heading there
+ */
+int acpi_temperature_trip_evaluate(const void *s)
+{
+	const struct temperature_interval *ti = (const struct temperature_interval *)s;
+	const struct thermal_zone *tz = NULL;
+	int trip_time = -1;
+	unsigned int i = 0;
+
+	if (ti->tz >= 0) {
+		tz = acpi_registry_get(&zones, ti->tz);
+		if (tz->present)
+			trip_time = tz->trip_time;
+	} else {
+		/* the first zone to trip (in the group) */
+		for (i = 0; i < zones.count; i++) {
+			tz = acpi_registry_get(&zones, i);
+			if (ti->group >= 0 && !in_group(ti->group, tz))
+				continue;
+			if (tz->present && tz->trip_time >= 0 &&
+					(trip_time < 0 || tz->trip_time < trip_time))
+				trip_time = tz->trip_time;
+		}
+		tz = NULL;
+	}
+
+	clog(LOG_DEBUG, "called %d-%d [%s:%d]\n", ti->min, ti->max,
+			tz != NULL ? tz->name : "Min", trip_time);
+
+	if (trip_time < 0)
+		return DONT_MATCH;
+	return (trip_time >= ti->min && trip_time <= ti->max) ? MATCH : DONT_MATCH;
+}
+
+int acpi_temperature_target_parse(const char *ev, void **obj)
+{
+	char atz_name[SYSFS_NAME_LEN];
+	const char *target = ev;
+	int grouped = 0;
+	struct temperature_target *ret = calloc(1, sizeof(struct temperature_target));
+	if (ret == NULL) {
+		clog(LOG_ERR, "couldn't make enough room for temperature_target (%s)\n",
+				strerror(errno));
+		return -1;
+	}
+	ret->tz = -1;
+	ret->group = -1;
+
+	clog(LOG_DEBUG, "called with: %s\n", ev);
+
+	if ((grouped = parse_group(ev, &ret->group, &target)) < 0) {
+		free(ret);
+		return -1;
+	}
+	if (!grouped && sscanf(ev, "%63[a-zA-Z0-9_]", atz_name) == 1 &&
+			ev[strlen(atz_name)] == ':') {
+		if ((ret->tz = parse_zone(atz_name)) < 0) {
+			free(ret);
+			return -1;
+		}
+		target = ev + strlen(atz_name) + 1;
+	}
+	if ((ret->ctl = thermal_control_parse(target)) == NULL) {
+		free(ret);
+		return -1;
+	}
+	clog(LOG_INFO, "parsed %s %.1f\n", grouped ? ((struct zone_group *)
+				acpi_registry_get(&groups, ret->group))->name :
+			(ret->tz >= 0 ? atz_name : "Max"),
+			thermal_control_target(ret->ctl));
+
+	ret->next = targets;
+	targets = ret;
+	*obj = ret;
+	return 0;
+}
+
+void acpi_temperature_target_change(void *obj, const struct cpufreq_policy *old,
+		const struct cpufreq_policy *new, const unsigned int cpu)
+{
+	thermal_control_activate(((struct temperature_target *)obj)->ctl,
+			old, new, cpu);
+}
+
+void acpi_temperature_target_free(void *obj)
+{
+	struct temperature_target *tt = (struct temperature_target *)obj;
+	struct temperature_target **t = &targets;
+
+	while (*t != NULL && *t != tt)
+		t = &(*t)->next;
+	if (*t != NULL)
+		*t = tt->next;
+	thermal_control_free(tt->ctl);
+	free(tt);
+}
+
+/* aggregates the zones of each group, once for all the directives */
+static void update_groups(void)
+{
+	struct zone_group *zg = NULL;
+	struct thermal_zone *tz = NULL;
+	double *values = NULL;
+	double temp = 0.0;
+	unsigned int i = 0, j = 0, count = 0;
+
+	if (groups.count == 0)
+		return;
+	if (group_values_size < zones.count) {
+		values = realloc(group_values, zones.count * sizeof(double));
+		if (values == NULL) {
+			clog(LOG_ERR, "couldn't make enough room for %u zones (%s)\n",
+					zones.count, strerror(errno));
+			return;
+		}
+		group_values = values;
+		group_values_size = zones.count;
+	}
+
+	for (i = 0; i < groups.count; i++) {
+		zg = acpi_registry_get(&groups, i);
+		count = 0;
+		for (j = 0; j < zones.count; j++) {
+			tz = acpi_registry_get(&zones, j);
+			if (tz->present && tz->valid && in_group((int)i, tz))
+				group_values[count++] = tz->temperature;
+		}
+		zg->valid = count > 0;
+		if (zg->valid) {
+			temp = sensor_aggregate(group_values, count, zg->how);
+			zg->temperature = (int)temp;
+			clog(LOG_INFO, "temperature for %s is %.1fC (%u)\n", zg->name,
+					(float)zg->temperature / 1000, count);
+		}
+
+		count = 0;
+		for (j = 0; j < zones.count; j++) {
+			tz = acpi_registry_get(&zones, j);
+			if (tz->present && tz->valid && tz->slope_valid
+					&& in_group((int)i, tz))
+				group_values[count++] = tz->slope;
+		}
+		zg->slope_valid = count > 0;
+		if (zg->slope_valid)
+			zg->slope = sensor_aggregate(group_values, count, zg->how);
+	}
+}
+
+/* the zone temperature or the hottest one, -1 if there's none to read */
+static int target_temperature(const struct temperature_target *tt, int *temp)
+{
+	const struct thermal_zone *tz = NULL;
+	const struct zone_group *zg = NULL;
+	unsigned int i = 0;
+	int found = 0;
+
+	if (tt->group >= 0) {
+		zg = acpi_registry_get(&groups, tt->group);
+		*temp = zg->temperature;
+		return zg->valid ? 0 : -1;
+	}
+	if (tt->tz >= 0) {
+		tz = acpi_registry_get(&zones, tt->tz);
+		*temp = tz->temperature;
+		return tz->present && tz->valid ? 0 : -1;
+	}
+	for (i = 0; i < zones.count; i++) {
+		tz = acpi_registry_get(&zones, i);
+		if (tz->present && tz->valid && (!found || tz->temperature > *temp)) {
+			*temp = tz->temperature;
+			found = 1;
+		}
+	}
+	return found ? 0 : -1;
+}
+
 /*  static int acpi_temperature_update(void)
  *
  *  reads temperature valuse ant compute a medium value
  */
 int acpi_temperature_update(void)
 {
-	int count = 0, i = 0;
+	struct thermal_zone *tz = NULL;
+	struct temperature_target *tt = NULL;
+	unsigned int i = 0;
+	int count = 0, temp = 0;
+	double now = monotonic_time();
 
 	clog(LOG_DEBUG, "called\n");
 
+	if (atz_rescan) {
+		clog(LOG_NOTICE, "Re-scanning available thermal zones\n");
+		atz_rescan = 0;
+		scan_zones();
+	}
+
 	temp_avg = 0;
-	for (i = 0; i < atz_dir_num; i++) {
+	if (atz_batch != NULL)
+		sysfs_batch_read(atz_batch);
+	for (i = 0; i < zones.count; i++) {
+		tz = acpi_registry_get(&zones, i);
 
-		if (read_int(atz_list[i].temp, &atz_list[i].temperature)) {
+		if (!tz->present || !tz->valid) {
 			continue;
 		}
 		count++;
-		temp_avg += atz_list[i].temperature;
-		clog(LOG_INFO, "temperature for %s is %.1fC\n",
-				atz_list[i].cdev->name,
-				(float)atz_list[i].temperature / 1000);
+		temp_avg += tz->temperature;
+		if (tz->trips_stale)
+			read_trip_points(tz);
+		update_trend(tz, now);
+		clog(LOG_INFO, "temperature for %s is %.1fC (%+.2fC/s)\n",
+				tz->name, (float)tz->temperature / 1000, tz->slope);
+		if (tz->trip_time >= 0)
+			clog(LOG_INFO, "%s trips in %ds\n", tz->name, tz->trip_time);
 	}
 
 	/* compute global medium value */
@@ -202,6 +813,13 @@ int acpi_temperature_update(void)
 		temp_avg = (float)temp_avg / (float)count;
 	}
 	clog(LOG_INFO, "temperature average is %.1fC\n", (float)temp_avg / 1000);
+
+	update_groups();
+
+	for (tt = targets; tt != NULL; tt = tt->next) {
+		if (target_temperature(tt, &temp) == 0)
+			thermal_control_update(tt->ctl, (double)temp / 1000);
+	}
 	return 0;
 }
 
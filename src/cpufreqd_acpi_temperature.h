@@ -16,8 +16,19 @@
  *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
+struct acpi_uevent;
+struct cpufreq_policy;
+
 short int acpi_temperature_init(void);
 short int acpi_temperature_exit(void) ;
 int acpi_temperature_parse(const char *ev, void **obj);
 int acpi_temperature_evaluate(const void *s);
+int acpi_temperature_slope_parse(const char *ev, void **obj);
+int acpi_temperature_slope_evaluate(const void *s);
+int acpi_temperature_trip_evaluate(const void *s);
+int acpi_temperature_target_parse(const char *ev, void **obj);
+void acpi_temperature_target_change(void *obj, const struct cpufreq_policy *old,
+		const struct cpufreq_policy *new, const unsigned int cpu);
+void acpi_temperature_target_free(void *obj);
 int acpi_temperature_update(void);
+void acpi_temperature_uevent(const struct acpi_uevent *ev);
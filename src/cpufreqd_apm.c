@@ -18,13 +18,14 @@
  */
 
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
-#include <sys/stat.h>
 #include <unistd.h>
 #include "cpufreqd_plugin.h"
+#include "sysfs_utils.h"
 
 #define APM_PROC_FILE "/proc/apm"
 #define PLUGGED   1
@@ -37,17 +38,15 @@ struct battery_interval {
 static int battery_present;
 static int battery_percent;
 static unsigned int ac_state;
+static struct sysfs_attr *apm_file;
 
 /*  static int apm_init(void)
  *
  *  test if apm file id present
  */
 static int apm_init(void) {
-	struct stat sb;
-	int rc;
-
-	rc = stat(APM_PROC_FILE, &sb);
-	if (rc < 0) {
+	apm_file = sysfs_attr_open(APM_PROC_FILE, O_RDONLY);
+	if (apm_file == NULL) {
 		clog(LOG_INFO, "%s: %s\n", APM_PROC_FILE, strerror(errno));
 		return -1;
 	}
@@ -55,6 +54,8 @@ static int apm_init(void) {
 }
 
 static int apm_exit(void) {
+	sysfs_attr_close(apm_file);
+	apm_file = NULL;
 	return 0;
 }
 
@@ -63,7 +64,6 @@ static int apm_exit(void) {
  *  reads temperature valuse ant compute a medium value
  */
 static int apm_update(void) {
-	FILE *fp;
 	char buf[101];
 
 	/***** APM SCAN *****/
@@ -74,14 +74,7 @@ static int apm_update(void) {
 
 	clog(LOG_DEBUG, "called\n");
 
-	fp = fopen(APM_PROC_FILE , "r");
-	if (!fp) {
-		clog(LOG_ERR, "%s: %s\n", APM_PROC_FILE, strerror(errno));
-		return -1;
-	}
-
-	if (!fgets(buf, 100, fp)) {
-		fclose(fp);
+	if (sysfs_attr_read(apm_file, buf, sizeof(buf)) < 0) {
 		clog(LOG_ERR, "%s: %s\n", APM_PROC_FILE, strerror(errno));
 		return -1;
 	}
@@ -97,8 +90,6 @@ static int apm_update(void) {
 
 	battery_present = batt_flag < 128;
 
-	fclose(fp);
-
 	clog(LOG_INFO, "battery %s - %d - ac: %s\n",
 			battery_present?"present":"absent",
 			battery_percent,
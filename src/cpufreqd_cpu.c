@@ -22,6 +22,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include "cpufreqd_plugin.h"
+#include "cpufreqd_cpu_governor.h"
+#include "cpufreqd_cpu_parking.h"
 
 #define CPU_ANY		0xffffffff
 #define CPU_ALL		0xfffffffe
@@ -42,6 +44,7 @@ struct cpu_usage {
 	unsigned int c_sys;
 	unsigned int c_time;
 	unsigned int delta_time;
+	int online;	/* listed in /proc/stat this time */
 };
 
 static struct cpu_usage *cusage;
@@ -85,6 +88,8 @@ static int cpufreqd_cpu_init(void) {
 
 static int cpufreqd_cpu_exit(void) {
 	clog(LOG_INFO, "called\n");
+	cpu_parking_exit();
+	cpu_governor_exit();
 	free(cusage);
 	free(cusage_old);
 	return 0;
@@ -220,6 +225,9 @@ static int cpu_evaluate(const void *s) {
 		/* special handling for CPU_ALL and CPU_ANY */
 		if (c->cpu == CPU_ANY || c->cpu == CPU_ALL) {
 			for (i = 0; i < cinfo->cpus; i++) {
+				/* parked or unplugged */
+				if (!cusage[i].online)
+					continue;
 				clog(LOG_DEBUG, "CPU%d user=%d nice=%d sys=%d\n", i,
 						cusage[i].c_user, cusage[i].c_nice, cusage[i].c_sys);
 				cpu_percent = calculate_cpu_usage(&cusage[i], &cusage_old[i], c->nice_scale);
@@ -247,7 +255,8 @@ static int cpu_evaluate(const void *s) {
 		/* cacluate weighted activity for the requested CPU */
 		clog(LOG_DEBUG, "CPU%d user=%d nice=%d sys=%d\n", c->cpu, cusage[c->cpu].c_user,
 				cusage[c->cpu].c_nice, cusage[c->cpu].c_sys);
-		cpu_percent = calculate_cpu_usage(&cusage[c->cpu], &cusage_old[c->cpu], c->nice_scale);
+		cpu_percent = cusage[c->cpu].online ? calculate_cpu_usage(&cusage[c->cpu],
+				&cusage_old[c->cpu], c->nice_scale) : 0;
 		clog(LOG_DEBUG, "CPU%d %d%% - min=%d max=%d scale=%.2f\n", c->cpu, cpu_percent,
 				c->min, c->max, c->nice_scale);
 		/* return MATCH if any of the intervals match as multiple
@@ -266,7 +275,7 @@ static int get_cpu(void) {
 	FILE* fp = NULL;
 	char line[256];
 	int f = 0;
-	unsigned int cpu_num = 0, c_user = 0, c_nice = 0, c_sys = 0, i = 0;
+	unsigned int cpu_num = 0, c_user = 0, c_nice = 0, c_sys = 0, i = 0, online = 0;
 	unsigned long int c_idle=0, c_iowait=0, c_irq=0, c_softirq=0; /* for linux 2.6 only */
 	struct cpufreqd_info *cinfo = get_cpufreqd_info();
 	struct cpu_usage *temp_usage = cusage_old;
@@ -277,6 +286,10 @@ static int get_cpu(void) {
 	cusage_old = cusage;
 	cusage = temp_usage;
 
+	for (i = 0; i < cinfo->cpus; i++)
+		cusage[i].online = 0;
+	i = 0;
+
 	/* read raw jiffies... */
 	fp = fopen ("/proc/stat", "r");
 	if (!fp) {
@@ -284,7 +297,9 @@ static int get_cpu(void) {
 		return -1;
 	}
 	while (i < cinfo->cpus && !feof(fp)) {
-		fgets(line, 256, fp);
+		/* the cpu lines come first */
+		if (fgets(line, 256, fp) == NULL || strncmp(line, "cpu", 3) != 0)
+			break;
 		if (strstr(line, "cpu ") == line) {
 			f = sscanf (line,
 					"cpu %u %u %u %lu %lu %lu %lu%*s\n",
@@ -301,10 +316,12 @@ static int get_cpu(void) {
 					&cpu_num, &c_user, &c_nice, &c_sys,
 					&c_idle, &c_iowait, &c_irq, &c_softirq);
 
-			if (f != 8)
+			if (f != 8 || cpu_num >= cinfo->cpus)
 				continue;
-			/* got a CPU stats */
+			/* got a CPU stats, offline CPUs are not listed */
 			i++;
+			online++;
+			cusage[cpu_num].online = 1;
 		}
 
 		clog(LOG_INFO, "CPU%d c_user=%d c_nice=%d c_sys=%d c_idle=%d "
@@ -323,11 +340,56 @@ static int get_cpu(void) {
 			cusage[cpu_num].c_time - cusage_old[cpu_num].c_time;
 	}
 	fclose(fp);
+
+	cpu_parking_update(calculate_cpu_usage(&cusage[cinfo->cpus],
+				&cusage_old[cinfo->cpus], 1.0), online);
+	return 0;
+}
+
+/* warm start: the last jiffies read, so that the first usage after a
+ * restart isn't the average since boot
+ */
+static int cpu_save(FILE *fp) {
+	struct cpufreqd_info *cinfo = get_cpufreqd_info();
+	unsigned int i = 0;
+
+	/* nothing read yet */
+	if (cusage[cinfo->cpus].c_time == 0)
+		return -1;
+	fprintf(fp, "%u", cinfo->cpus);
+	for (i = 0; i <= cinfo->cpus; i++) {
+		fprintf(fp, " %u,%u,%u,%u,%u", cusage[i].c_user, cusage[i].c_nice,
+				cusage[i].c_sys, cusage[i].c_idle, cusage[i].c_time);
+	}
+	return 0;
+}
+
+/* the jiffies saved become the old ones at the first update */
+static int cpu_restore(const char *snapshot) {
+	struct cpufreqd_info *cinfo = get_cpufreqd_info();
+	struct cpu_usage *c = NULL;
+	unsigned int i = 0, cpus = 0;
+	int n = 0;
+
+	if (sscanf(snapshot, "%u%n", &cpus, &n) != 1 || cpus != cinfo->cpus)
+		return -1;
+	for (i = 0; i <= cpus; i++) {
+		snapshot += n;
+		c = &cusage[i];
+		if (sscanf(snapshot, " %u,%u,%u,%u,%u%n", &c->c_user, &c->c_nice,
+					&c->c_sys, &c->c_idle, &c->c_time, &n) != 5) {
+			memset(cusage, 0, (cpus + 1) * sizeof(struct cpu_usage));
+			return -1;
+		}
+	}
 	return 0;
 }
 
 static struct cpufreqd_keyword kw[] = {
 	{ .word = "cpu_interval", .parse = &cpu_parse, .evaluate = &cpu_evaluate, .free = &free_cpu_intervals, },
+	{ .word = "cpu_parking", .parse = &cpu_parking_parse, .profile_post_change = &cpu_parking_change, .free = &cpu_parking_free, },
+	{ .word = "cpu_governor", .parse = &cpu_governor_parse, .profile_post_change = &cpu_governor_change, .free = &cpu_governor_free, },
+	{ .word = "autocpu", .parse = &autocpu_parse, .profile_post_change = &cpu_governor_change, .free = &cpu_governor_free, },
 	{ .word = NULL, .parse = NULL, .evaluate = NULL, .free = NULL }
 };
 
@@ -336,7 +398,10 @@ static struct cpufreqd_plugin cpu_plugin = {
 	.keywords         = kw,			/* config_keywords */
 	.plugin_init      = &cpufreqd_cpu_init,	/* plugin_init */
 	.plugin_exit      = &cpufreqd_cpu_exit,	/* plugin_exit */
-	.plugin_update    = &get_cpu		/* plugin_update */
+	.plugin_update    = &get_cpu,		/* plugin_update */
+	.plugin_conf      = &cpu_parking_conf,	/* plugin_conf */
+	.plugin_save      = &cpu_save,		/* plugin_save */
+	.plugin_restore   = &cpu_restore,	/* plugin_restore */
 };
 
 /* MUST DEFINE THIS ONE */
@@ -0,0 +1,561 @@
+/*
+ *  Copyright (C) 2002-2008  Mattia Dongili <malattia@linux.it>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  In-daemon governor
+ *  ------------------
+ *  While a Profile with cpu_governor and the userspace governor is set,
+ *  cpu usage is sampled every few ms (see sampler.h) and
+ *  scaling_setspeed is written by cpufreqd, once per cpufreq policy
+ *  (the busiest cpu of the policy decides). Like ondemand, the Profile
+ *  max frequency is set as soon as the usage goes above the threshold,
+ *  otherwise the frequency is proportional to the usage between the
+ *  Profile min and max.
+ *  Each cpufreq policy follows the Profile set there, so a Rule setting
+ *  different Profiles per cpu gets each policy governed by its own.
+ *  The sampler runs at the shortest interval in use, policies with a
+ *  longer one are sampled every few runs.
+ *  /proc/stat counts USER_HZ ticks so short samples are coarse: the usage
+ *  is taken at once when going up and decays in DOWN_TAU going down.
+ *  Everything is allocated when the Profile is set, sampling reads
+ *  /proc/stat through a descriptor kept open.
+ *
+ *  autocpu
+ *  -------
+ *  Same sampling, but a feedback controller instead of the ondemand-like
+ *  ramp: the demand (smoothed usage * current frequency) plus the headroom
+ *  gives the target frequency. Changes within the hysteresis band are
+ *  ignored, each move is bounded to a step of the Profile range and the
+ *  target is rounded up through the available frequencies. The Profile
+ *  min and max are the bounds, so Rules can still narrow or widen them:
+ *  the smoothed usage and current frequency survive the Profile change.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "cpufreqd_plugin.h"
+#include "sampler.h"
+#include "sysfs_utils.h"
+#include "cpufreqd_cpu_governor.h"
+
+#define PROC_STAT		"/proc/stat"
+#define SCALING_SETSPEED	"/sys/devices/system/cpu/cpu%u/cpufreq/scaling_setspeed"
+#define USERSPACE		"userspace"
+#define DEFAULT_UP		80	/* % */
+#define DEFAULT_HEADROOM	20	/* % */
+#define DEFAULT_STEP		25	/* % of the Profile range */
+#define DEFAULT_HYSTERESIS	5	/* % */
+#define MAX_INTERVAL		1000	/* ms */
+#define DOWN_TAU		100.0	/* ms */
+#define SMOOTH_TAU		100.0	/* ms, autocpu */
+#define STAT_LINE_LEN		256	/* room for each cpu line */
+#define STAT_FIELDS		8	/* user nice system idle iowait irq softirq steal */
+
+struct cpu_governor {
+	unsigned int interval;	/* ms */
+	double up;		/* 0 - 1 */
+	int autocpu;
+	double headroom;	/* 0 - 1, autocpu only */
+	double step;
+	double hysteresis;
+	double decay;	/* per sample, or smoothing factor for autocpu */
+	int warned;
+	const struct cpufreq_policy *policy;	/* Profile it belongs to */
+};
+
+struct governed_cpu {
+	unsigned long long busy;	/* ticks at the last sample */
+	unsigned long long total;
+	unsigned int leader;		/* lowest cpu of its cpufreq policy */
+	unsigned char governed;		/* the Profile is set there */
+	unsigned char primed;		/* busy and total are valid */
+};
+
+struct governed_policy {
+	const struct cpu_governor *gov;	/* of the Profile set there */
+	struct sysfs_attr *setspeed;
+	unsigned int governed;	/* cpus */
+	unsigned int wait;	/* ms until the next sample */
+	unsigned char due;	/* sampled this run */
+	unsigned long written;
+	unsigned long cur;	/* frequency in effect, autocpu */
+	double usage;		/* 0 - 1, decayed or smoothed */
+	double sample;		/* 0 - 1, busiest cpu in the last sample */
+};
+
+static unsigned int cpus;
+static struct governed_cpu *gcpus;
+static struct governed_policy *gpolicies;	/* indexed by leader */
+static unsigned int tick;	/* ms, sampler interval, 0 if stopped */
+
+static int stat_fd = -1;
+static char *stat_buf;
+static size_t stat_len;
+
+static void cpu_governor_sample(void);
+
+static int alloc_cpus(void) {
+	if (gcpus != NULL)
+		return 0;
+	cpus = get_cpufreqd_info()->cpus;
+	stat_len = (cpus + 2) * STAT_LINE_LEN;
+	gcpus = calloc(cpus, sizeof(struct governed_cpu));
+	gpolicies = calloc(cpus, sizeof(struct governed_policy));
+	stat_buf = malloc(stat_len);
+	if (gcpus == NULL || gpolicies == NULL || stat_buf == NULL) {
+		clog(LOG_ERR, "couldn't make enough room for %u cpus (%s)\n",
+				cpus, strerror(errno));
+		goto out_free;
+	}
+	if ((stat_fd = open(PROC_STAT, O_RDONLY | O_CLOEXEC)) == -1) {
+		clog(LOG_ERR, "couldn't open %s (%s)\n", PROC_STAT, strerror(errno));
+		goto out_free;
+	}
+	return 0;
+
+out_free:
+	free(gcpus);
+	free(gpolicies);
+	free(stat_buf);
+	gcpus = NULL;
+	gpolicies = NULL;
+	stat_buf = NULL;
+	return -1;
+}
+
+/* cpu_governor=<interval ms>[:<up threshold %>] */
+int cpu_governor_parse(const char *ev, void **obj) {
+	struct cpu_governor *ret = NULL;
+	unsigned long interval = 0, up = DEFAULT_UP;
+	const char *s = ev;
+	char *end = NULL;
+
+	interval = strtoul(s, &end, 10);
+	if (end != s && *end == ':') {
+		s = end + 1;
+		up = strtoul(s, &end, 10);
+	}
+	if (end == s || *end != '\0' || interval < SAMPLER_MIN_INTERVAL
+			|| interval > MAX_INTERVAL || up == 0 || up > 100) {
+		clog(LOG_ERR, "couldn't parse cpu_governor=%s, interval[:up] expected "
+				"(%u-%ums, 1-100%%)\n", ev, SAMPLER_MIN_INTERVAL,
+				MAX_INTERVAL);
+		return -1;
+	}
+
+	ret = calloc(1, sizeof(struct cpu_governor));
+	if (ret == NULL) {
+		clog(LOG_ERR, "couldn't make enough room for cpu_governor (%s)\n",
+				strerror(errno));
+		return -1;
+	}
+	ret->interval = (unsigned int)interval;
+	ret->up = (double)up / 100.0;
+	ret->decay = DOWN_TAU / (DOWN_TAU + (double)interval);
+	clog(LOG_INFO, "in-daemon governor every %lums, up threshold %lu%%\n",
+			interval, up);
+	*obj = ret;
+	return 0;
+}
+
+/* autocpu=<interval ms>[:<headroom %>[:<step %>[:<hysteresis %>]]] */
+int autocpu_parse(const char *ev, void **obj) {
+	struct cpu_governor *ret = NULL;
+	unsigned long v[4] = { 0, DEFAULT_HEADROOM, DEFAULT_STEP, DEFAULT_HYSTERESIS };
+	const char *s = ev;
+	char *end = NULL;
+	unsigned int i = 0;
+
+	for (i = 0; i < 4; i++) {
+		v[i] = strtoul(s, &end, 10);
+		if (end == s || *end != ':')
+			break;
+		s = end + 1;
+	}
+	if (end == s || *end != '\0' || v[0] < SAMPLER_MIN_INTERVAL
+			|| v[0] > MAX_INTERVAL || v[1] == 0 || v[1] > 90
+			|| v[2] == 0 || v[2] > 100 || v[3] >= v[1]) {
+		clog(LOG_ERR, "couldn't parse autocpu=%s, "
+				"interval[:headroom[:step[:hysteresis]]] expected "
+				"(%u-%ums, 1-90%%, 1-100%%, below the headroom)\n",
+				ev, SAMPLER_MIN_INTERVAL, MAX_INTERVAL);
+		return -1;
+	}
+
+	ret = calloc(1, sizeof(struct cpu_governor));
+	if (ret == NULL) {
+		clog(LOG_ERR, "couldn't make enough room for autocpu (%s)\n",
+				strerror(errno));
+		return -1;
+	}
+	ret->interval = (unsigned int)v[0];
+	ret->autocpu = 1;
+	ret->headroom = (double)v[1] / 100.0;
+	ret->step = (double)v[2] / 100.0;
+	ret->hysteresis = (double)v[3] / 100.0;
+	ret->decay = (double)v[0] / (SMOOTH_TAU + (double)v[0]);
+	clog(LOG_INFO, "autocpu every %lums, headroom %lu%%, step %lu%%, "
+			"hysteresis %lu%%\n", v[0], v[1], v[2], v[3]);
+	*obj = ret;
+	return 0;
+}
+
+static int is_current(const struct cpufreq_policy *policy, unsigned int cpu) {
+	const struct profile *p = get_cpufreqd_info()->current_profiles[cpu];
+	return p != NULL && &p->policy == policy;
+}
+
+/* back within the Profile range, on an available frequency */
+static unsigned long bound(const struct cpufreq_policy *policy,
+		const struct freq_table *t, unsigned long freq) {
+	if (freq > policy->max)
+		freq = freq_table_floor(t, policy->max);
+	if (freq < policy->min)
+		freq = freq_table_ceil(t, policy->min);
+	return freq;
+}
+
+/* the available frequency closest to freq within the Profile range */
+static unsigned long pick_frequency(const struct cpufreq_policy *policy,
+		unsigned int cpu, unsigned long freq) {
+	const struct freq_table *t = get_cpufreqd_info()->sys_info[cpu].table;
+
+	if (t == NULL)
+		return freq;
+	return bound(policy, t, freq_table_nearest(t, freq));
+}
+
+/* the lowest available frequency >= freq within the Profile range */
+static unsigned long ceil_frequency(const struct cpufreq_policy *policy,
+		unsigned int cpu, unsigned long freq) {
+	const struct freq_table *t = get_cpufreqd_info()->sys_info[cpu].table;
+
+	if (freq < policy->min)
+		freq = policy->min;
+	if (freq > policy->max)
+		freq = policy->max;
+	if (t == NULL)
+		return freq;
+	return bound(policy, t, freq_table_ceil(t, freq));
+}
+
+/* the highest available frequency below freq within the Profile range */
+static unsigned long lower_frequency(const struct cpufreq_policy *policy,
+		unsigned int cpu, unsigned long freq) {
+	const struct freq_table *t = get_cpufreqd_info()->sys_info[cpu].table;
+	unsigned int i = 0;
+
+	if (t == NULL || (i = freq_table_index(t, freq)) == 0
+			|| t->freq[i - 1] < policy->min)
+		return freq;
+	return t->freq[i - 1];
+}
+
+static void sample_cpu(unsigned int cpu, unsigned long long busy,
+		unsigned long long total) {
+	struct governed_cpu *c = &gcpus[cpu];
+	struct governed_policy *p = &gpolicies[c->leader];
+	double usage = 0.0;
+
+	/* iowait may go backwards */
+	if (c->primed && total > c->total && busy >= c->busy)
+		usage = (double)(busy - c->busy) / (double)(total - c->total);
+	c->busy = busy;
+	c->total = total;
+	if (!c->primed) {
+		c->primed = 1;
+		return;
+	}
+	if (usage > p->sample)
+		p->sample = usage;
+}
+
+/* parses the cpu lines of /proc/stat, no allocations */
+static void read_stat(void) {
+	unsigned long long v[STAT_FIELDS], total = 0;
+	ssize_t len = pread(stat_fd, stat_buf, stat_len - 1, 0);
+	char *s = stat_buf, *end = NULL, *eol = NULL;
+	unsigned int cpu = 0, i = 0;
+
+	if (len <= 0)
+		return;
+	stat_buf[len] = '\0';
+	for (; (eol = strchr(s, '\n')) != NULL && strncmp(s, "cpu", 3) == 0;
+			s = eol + 1) {
+		/* the first line is the sum of all the cpus */
+		s += 3;
+		if (!isdigit((unsigned char)*s))
+			continue;
+		cpu = (unsigned int)strtoul(s, &end, 10);
+		if (cpu >= cpus || !gcpus[cpu].governed
+				|| !gpolicies[gcpus[cpu].leader].due)
+			continue;
+		s = end;
+		memset(v, 0, sizeof(v));
+		for (i = 0, total = 0; i < STAT_FIELDS; i++, s = end) {
+			v[i] = strtoull(s, &end, 10);
+			if (end == s || end > eol) {
+				v[i] = 0;
+				break;
+			}
+			total += v[i];
+		}
+		sample_cpu(cpu, total - v[3] - v[4], total);
+	}
+}
+
+/* the autocpu controller, returns the frequency to be set */
+static unsigned long autocpu_target(unsigned int leader, struct governed_policy *p) {
+	const struct cpu_governor *g = p->gov;
+	const struct cpufreq_policy *policy = g->policy;
+	double range = (double)(policy->max - policy->min);
+	double cur = (double)p->cur, target = 0.0, step = g->step * range;
+	unsigned long freq = 0;
+	int down = 0;
+
+	/* a Profile with different bounds has been set */
+	if (p->cur < policy->min || p->cur > policy->max || p->cur == 0)
+		return ceil_frequency(policy, leader, p->cur);
+
+	target = p->usage * cur / (1.0 - g->headroom);
+	if (target > cur * (1.0 - g->hysteresis)
+			&& target < cur * (1.0 + g->hysteresis))
+		return p->cur;
+	if (target > cur + step) {
+		target = cur + step;
+	} else if (target < cur - step) {
+		target = cur - step;
+		down = 1;
+	}
+	freq = ceil_frequency(policy, leader,
+			target < 0.0 ? 0 : (unsigned long)target);
+	/* the table is coarser than the step, move by one frequency at least */
+	if (down && freq == p->cur)
+		return lower_frequency(policy, leader, p->cur);
+	return freq;
+}
+
+static void set_speed(unsigned int leader, struct governed_policy *p) {
+	const struct cpufreq_policy *policy = p->gov->policy;
+	unsigned long freq = policy->max;
+
+	if (p->gov->autocpu)
+		freq = autocpu_target(leader, p);
+	else if (p->usage < p->gov->up)
+		freq = pick_frequency(policy, leader, policy->min + (unsigned long)
+				(p->usage * (double)(policy->max - policy->min)));
+	if (freq == p->written)
+		return;
+	if (sysfs_attr_write_long(p->setspeed, (long)freq) != 0)
+		return;
+	p->written = freq;
+	p->cur = freq;
+	clog(LOG_DEBUG, "CPU%u set to %lu (%.0f%% busy)\n", leader, freq,
+			p->usage * 100.0);
+}
+
+/* the last cpu released closes its policy */
+static void ungovern(unsigned int cpu) {
+	struct governed_cpu *c = &gcpus[cpu];
+	struct governed_policy *p = &gpolicies[c->leader];
+
+	if (!c->governed)
+		return;
+	c->governed = 0;
+	clog(LOG_DEBUG, "released CPU%u\n", cpu);
+	if (--p->governed > 0)
+		return;
+	clog(LOG_INFO, "%s released the policy of CPU%u\n", p->gov->autocpu ?
+			"autocpu" : "in-daemon governor", c->leader);
+	sysfs_attr_close(p->setspeed);
+	p->setspeed = NULL;
+	p->gov = NULL;
+}
+
+/* the sampler follows the shortest interval in use */
+static int update_sampler(void) {
+	unsigned int i = 0, interval = 0;
+
+	for (i = 0; i < cpus; i++) {
+		if (gpolicies[i].gov != NULL && (interval == 0
+					|| gpolicies[i].gov->interval < interval))
+			interval = gpolicies[i].gov->interval;
+	}
+	if (interval == tick)
+		return 0;
+	if (interval == 0) {
+		sampler_stop(&cpu_governor_sample);
+		tick = 0;
+		return 0;
+	}
+	if (sampler_start(&cpu_governor_sample, interval) != 0)
+		return -1;
+	tick = interval;
+	clog(LOG_INFO, "governor sampling every %ums\n", tick);
+	return 0;
+}
+
+static void release(void) {
+	unsigned int i = 0;
+
+	for (i = 0; i < cpus; i++)
+		ungovern(i);
+	update_sampler();
+}
+
+/* the sampler, runs every tick ms */
+static void cpu_governor_sample(void) {
+	struct governed_policy *p = NULL;
+	unsigned int i = 0;
+
+	for (i = 0; i < cpus; i++) {
+		/* another Profile has been set there */
+		if (gcpus[i].governed && !is_current(
+					gpolicies[gcpus[i].leader].gov->policy, i))
+			ungovern(i);
+	}
+	if (update_sampler() != 0 || tick == 0)
+		return;
+
+	for (i = 0; i < cpus; i++) {
+		p = &gpolicies[i];
+		p->sample = -1.0;
+		p->due = 0;
+		if (p->gov == NULL)
+			continue;
+		if (p->wait > tick) {
+			p->wait -= tick;
+			continue;
+		}
+		p->wait = p->gov->interval;
+		p->due = 1;
+	}
+
+	read_stat();
+	for (i = 0; i < cpus; i++) {
+		p = &gpolicies[i];
+		/* nothing to compare with yet */
+		if (!p->due || p->setspeed == NULL || p->sample < 0.0)
+			continue;
+		if (p->gov->autocpu) {
+			p->usage += p->gov->decay * (p->sample - p->usage);
+		} else {
+			p->usage *= p->gov->decay;
+			if (p->sample > p->usage)
+				p->usage = p->sample;
+		}
+		set_speed(i, p);
+	}
+}
+
+static unsigned int find_leader(unsigned int cpu) {
+	struct cpufreq_affected_cpus *a =
+		get_cpufreqd_info()->sys_info[cpu].affected_cpus;
+	unsigned int leader = cpu;
+
+	for (; a != NULL; a = a->next) {
+		if (a->cpu < leader)
+			leader = a->cpu;
+	}
+	return leader;
+}
+
+static void govern(unsigned int cpu, const struct cpu_governor *g) {
+	char path[MAX_PATH_LEN];
+	struct governed_cpu *c = &gcpus[cpu];
+	struct governed_policy *p = &gpolicies[c->leader];
+
+	if (p->setspeed == NULL) {
+		snprintf(path, sizeof(path), SCALING_SETSPEED, cpu);
+		if ((p->setspeed = sysfs_attr_open(path, O_WRONLY)) == NULL) {
+			clog(LOG_WARNING, "can't set CPU%u speed\n", cpu);
+			return;
+		}
+		p->usage = 0.0;
+		p->cur = cpufreq_get_freq_kernel(c->leader);
+	}
+	if (p->gov != g) {
+		/* hand over to the new Profile, keeping the usage and
+		 * the current frequency, which gets written anyway */
+		p->gov = g;
+		p->wait = 0;
+		p->written = 0;
+		clog(LOG_INFO, "%s on the policy of CPU%u every %ums\n",
+				g->autocpu ? "autocpu" : "in-daemon governor",
+				c->leader, g->interval);
+	}
+	if (!c->governed) {
+		c->governed = 1;
+		c->primed = 0;
+		p->governed++;
+		clog(LOG_DEBUG, "governing CPU%u (policy of CPU%u)\n", cpu, c->leader);
+	}
+}
+
+void cpu_governor_change(void *obj, const struct cpufreq_policy __UNUSED__ *old,
+		const struct cpufreq_policy *new, const unsigned int cpu) {
+	struct cpu_governor *g = (struct cpu_governor *)obj;
+
+	g->policy = new;
+	if (strcmp(new->governor, USERSPACE) != 0) {
+		if (!g->warned)
+			clog(LOG_WARNING, "%s needs the %s governor, not %s\n",
+					g->autocpu ? "autocpu" : "cpu_governor",
+					USERSPACE, new->governor);
+		g->warned = 1;
+		return;
+	}
+	if (alloc_cpus() != 0 || cpu >= cpus)
+		return;
+
+	if (!gcpus[cpu].governed)
+		gcpus[cpu].leader = find_leader(cpu);
+	govern(cpu, g);
+	if (update_sampler() != 0)
+		ungovern(cpu);
+}
+
+void cpu_governor_free(void *obj) {
+	unsigned int i = 0;
+
+	/* free_configuration() runs before the plugin exit */
+	for (i = 0; gcpus != NULL && i < cpus; i++) {
+		if (gcpus[i].governed && gpolicies[gcpus[i].leader].gov == obj)
+			ungovern(i);
+	}
+	if (gcpus != NULL)
+		update_sampler();
+	free(obj);
+}
+
+void cpu_governor_exit(void) {
+	if (gcpus == NULL)
+		return;
+	release();
+	close(stat_fd);
+	stat_fd = -1;
+	free(gcpus);
+	free(gpolicies);
+	free(stat_buf);
+	gcpus = NULL;
+	gpolicies = NULL;
+	stat_buf = NULL;
+}
@@ -0,0 +1,31 @@
+/*
+ *  Copyright (C) 2002-2008  Mattia Dongili <malattia@linux.it>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __CPUFREQD_CPU_GOVERNOR_H__
+#define __CPUFREQD_CPU_GOVERNOR_H__ 1
+
+#include <cpufreq.h>
+
+int cpu_governor_parse(const char *ev, void **obj);
+int autocpu_parse(const char *ev, void **obj);
+void cpu_governor_change(void *obj, const struct cpufreq_policy *old,
+		const struct cpufreq_policy *new, const unsigned int cpu);
+void cpu_governor_free(void *obj);
+void cpu_governor_exit(void);
+
+#endif
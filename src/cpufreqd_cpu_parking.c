@@ -0,0 +1,298 @@
+/*
+ *  Copyright (C) 2002-2008  Mattia Dongili <malattia@linux.it>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  CPU parking
+ *  -----------
+ *  While a Profile with cpu_parking is set, CPUs are taken offline when
+ *  the smoothed load can be served by fewer of them, one at a time, and
+ *  brought back all at once as soon as the load of the last poll needs
+ *  them. The CPUs listed in never_park, and those that can't be
+ *  offlined (usually CPU0), stay online.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cpufreqd_plugin.h"
+#include "cpufreq_utils.h"
+#include "sysfs_utils.h"
+#include "cpufreqd_cpu_parking.h"
+
+#define DEFAULT_USAGE	75	/* % of the online CPUs */
+#define PARK_TAU	30.0	/* s, load smoothing */
+#define PARK_HOLD	10.0	/* s between two parkings or after an unpark */
+#define DT_MAX		10.0
+
+struct cpu_parking {
+	unsigned int min;	/* CPUs, or % if percent */
+	int percent;
+	double usage;		/* 0 - 1, target usage of the online CPUs */
+	const struct cpufreq_policy *policy;	/* Profile it belongs to */
+};
+
+static unsigned int cpus;
+static unsigned char *never_park;
+static unsigned char *parked;	/* offlined by us */
+static struct sysfs_attr **online_attr;
+
+static struct cpu_parking *active;
+static double smoothed = -1.0;	/* busy CPUs, < 0 until the first update */
+static double last_time;
+static double last_change;
+
+static int alloc_cpus(void) {
+	if (parked != NULL)
+		return 0;
+	cpus = get_cpufreqd_info()->cpus;
+	never_park = calloc(cpus, sizeof(unsigned char));
+	parked = calloc(cpus, sizeof(unsigned char));
+	online_attr = calloc(cpus, sizeof(struct sysfs_attr *));
+	if (never_park == NULL || parked == NULL || online_attr == NULL) {
+		clog(LOG_ERR, "couldn't make enough room for %u cpus (%s)\n",
+				cpus, strerror(errno));
+		free(never_park);
+		free(parked);
+		free(online_attr);
+		never_park = parked = NULL;
+		online_attr = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+/* never_park=0,2-3 */
+int cpu_parking_conf(const char *key, const char *value) {
+	const char *s = value;
+	char *end = NULL;
+	unsigned long first = 0, last = 0;
+
+	if (strncmp(key, "never_park", 10) != 0 || alloc_cpus() != 0)
+		return -1;
+
+	while (*s != '\0') {
+		first = last = strtoul(s, &end, 10);
+		if (end != s && *end == '-') {
+			s = end + 1;
+			last = strtoul(s, &end, 10);
+		}
+		if (end == s || (*end != ',' && *end != '\0') || first > last) {
+			clog(LOG_ERR, "couldn't parse never_park=%s, CPU list expected\n",
+					value);
+			return -1;
+		}
+		for (; first <= last && first < cpus; first++)
+			never_park[first] = 1;
+		s = *end == ',' ? end + 1 : end;
+	}
+	return 0;
+}
+
+/* cpu_parking=<min>[%][:<usage>] */
+int cpu_parking_parse(const char *ev, void **obj) {
+	struct cpu_parking *ret = NULL;
+	unsigned long min = 0, usage = DEFAULT_USAGE;
+	const char *s = ev;
+	char *end = NULL;
+	int percent = 0;
+
+	if (alloc_cpus() != 0)
+		return -1;
+	min = strtoul(s, &end, 10);
+	if (end != s && *end == '%') {
+		percent = 1;
+		end++;
+	}
+	if (end != s && *end == ':') {
+		s = end + 1;
+		usage = strtoul(s, &end, 10);
+	}
+	if (end == s || *end != '\0' || (percent && min > 100)
+			|| usage == 0 || usage > 100) {
+		clog(LOG_ERR, "couldn't parse cpu_parking=%s, min[%%][:usage] "
+				"expected\n", ev);
+		return -1;
+	}
+
+	ret = calloc(1, sizeof(struct cpu_parking));
+	if (ret == NULL) {
+		clog(LOG_ERR, "couldn't make enough room for cpu_parking (%s)\n",
+				strerror(errno));
+		return -1;
+	}
+	ret->min = (unsigned int)min;
+	ret->percent = percent;
+	ret->usage = (double)usage / 100.0;
+	clog(LOG_INFO, "cpu parking down to %lu%s CPUs, %lu%% usage\n", min,
+			percent ? "%" : "", usage);
+	*obj = ret;
+	return 0;
+}
+
+static struct sysfs_attr *get_online_attr(unsigned int cpu) {
+	char path[MAX_PATH_LEN];
+
+	if (online_attr[cpu] == NULL) {
+		snprintf(path, sizeof(path), CPU_ONLINE, cpu);
+		if (access(path, F_OK) != 0) {
+			clog(LOG_INFO, "CPU%u can't be parked\n", cpu);
+			never_park[cpu] = 1;
+			return NULL;
+		}
+		online_attr[cpu] = sysfs_attr_open(path, O_RDWR);
+	}
+	return online_attr[cpu];
+}
+
+/* parks the highest numbered CPU that can be */
+static void park_one(void) {
+	struct sysfs_attr *attr = NULL;
+	unsigned int i = cpus;
+
+	while (i-- > 0) {
+		if (parked[i] || never_park[i] || !cpu_is_online(i)
+				|| (attr = get_online_attr(i)) == NULL)
+			continue;
+		if (sysfs_attr_write(attr, "0") != 0) {
+			clog(LOG_NOTICE, "CPU%u refused to go offline, "
+					"won't park it again\n", i);
+			never_park[i] = 1;
+			continue;
+		}
+		parked[i] = 1;
+		clog(LOG_INFO, "CPU%u parked (%.2f CPUs busy)\n", i, smoothed);
+		return;
+	}
+}
+
+/* brings back up to count parked CPUs, lowest numbered first */
+static void unpark(unsigned int count) {
+	unsigned int i = 0;
+
+	for (i = 0; i < cpus && count > 0; i++) {
+		if (!parked[i])
+			continue;
+		if (sysfs_attr_write(online_attr[i], "1") != 0)
+			continue;
+		parked[i] = 0;
+		count--;
+		clog(LOG_INFO, "CPU%u unparked\n", i);
+	}
+}
+
+void cpu_parking_change(void *obj, const struct cpufreq_policy __UNUSED__ *old,
+		const struct cpufreq_policy *new, const unsigned int __UNUSED__ cpu) {
+	struct cpu_parking *p = (struct cpu_parking *)obj;
+
+	p->policy = new;
+	if (active == p)
+		return;
+	if (active == NULL) {
+		smoothed = -1.0;
+		last_change = monotonic_time();
+	}
+	active = p;
+}
+
+void cpu_parking_free(void *obj) {
+	/* free_configuration() runs before the plugin exit */
+	if (obj == active) {
+		unpark(cpus);
+		active = NULL;
+	}
+	free(obj);
+}
+
+static unsigned int min_online(const struct cpu_parking *p) {
+	unsigned int min = p->percent ? (p->min * cpus + 99) / 100 : p->min;
+	return min < 1 ? 1 : (min > cpus ? cpus : min);
+}
+
+/* CPUs needed to keep the usage of the online ones at the target */
+static unsigned int needed(const struct cpu_parking *p, double busy) {
+	double wanted = busy / p->usage - 0.001;
+	unsigned int n = wanted > 0.0 ? (unsigned int)wanted : 0;
+	unsigned int min = min_online(p);
+
+	if ((double)n < wanted)
+		n++;
+	return n < min ? min : (n > cpus ? cpus : n);
+}
+
+static int is_current(const struct cpufreq_policy *policy, unsigned int cpu) {
+	const struct profile *p = get_cpufreqd_info()->current_profiles[cpu];
+	return p != NULL && &p->policy == policy;
+}
+
+void cpu_parking_update(int usage, unsigned int online) {
+	unsigned int i = 0, up = 0;
+	double now = monotonic_time(), dt = now - last_time, busy = 0.0;
+
+	last_time = now;
+	if (active == NULL)
+		return;
+
+	/* another Profile has been set on the CPUs left */
+	for (i = 0; i < cpus && (parked[i] || !is_current(active->policy, i)); i++);
+	if (i == cpus) {
+		clog(LOG_INFO, "cpu parking released\n");
+		unpark(cpus);
+		active = NULL;
+		return;
+	}
+
+	busy = (double)usage / 100.0 * (double)online;
+	if (dt > DT_MAX)
+		dt = DT_MAX;
+	if (smoothed < 0.0 || dt < 0.0)
+		smoothed = busy;
+	else
+		smoothed += (busy - smoothed) * dt / (PARK_TAU + dt);
+	clog(LOG_DEBUG, "%u CPUs online, %.2f busy (%.2f smoothed)\n", online,
+			busy, smoothed);
+
+	/* load is back, don't wait */
+	up = needed(active, busy);
+	if (up > online) {
+		unpark(up - online);
+		if (smoothed < busy)
+			smoothed = busy;
+		last_change = now;
+		return;
+	}
+	if (needed(active, smoothed) < online && now - last_change >= PARK_HOLD) {
+		park_one();
+		last_change = now;
+	}
+}
+
+void cpu_parking_exit(void) {
+	unsigned int i = 0;
+
+	if (parked == NULL)
+		return;
+	unpark(cpus);
+	for (i = 0; i < cpus; i++)
+		sysfs_attr_close(online_attr[i]);
+	free(never_park);
+	free(parked);
+	free(online_attr);
+	never_park = parked = NULL;
+	online_attr = NULL;
+	active = NULL;
+}
@@ -0,0 +1,441 @@
+/*
+ *  Copyright (C) 2002-2008  Mattia Dongili <malattia@linux.it>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  CPU Idle Plugin
+ *  ---------------
+ *  Keeps CPUs out of deep idle states while a Profile is set, either by
+ *  disabling the idle states of each CPU whose exit latency is above a
+ *  bound (idle_max_latency) or by holding a PM QoS request on
+ *  /dev/cpu_dma_latency (dma_latency) that applies to all the CPUs.
+ *
+ *  Both are set from the profile_post_change event of the Profile having
+ *  them and given back from the profile_pre_change event of the next
+ *  Profile having one of them, or at the first update after a Profile
+ *  without them has been set: the idle states get their previous disable
+ *  value back and the PM QoS request is dropped by closing its file.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "cpufreqd_plugin.h"
+#include "sysfs_utils.h"
+
+#define CPUIDLE_DIR	"/sys/devices/system/cpu/cpu%u/cpuidle"
+#define CPUIDLE_STATE	CPUIDLE_DIR "/state%u"
+#define DMA_LATENCY	"/dev/cpu_dma_latency"
+
+struct idle_state {
+	char name[16];
+	long latency;		/* us */
+	long saved;		/* disable value found */
+	int disabled;		/* as last written by us */
+	struct sysfs_attr *disable;
+};
+
+struct idle_cpu {
+	int scanned;
+	unsigned int count;
+	struct idle_state *states;
+	const struct idle_limit *limit;	/* NULL if the states are as found */
+};
+
+/* idle_max_latency directive */
+struct idle_limit {
+	long latency;		/* us */
+	const struct cpufreq_policy *policy;	/* Profile it belongs to */
+};
+
+/* dma_latency directive */
+struct dma_latency {
+	int32_t latency;	/* us */
+	int fd;			/* the request lasts as long as it's open */
+	const struct cpufreq_policy *policy;
+};
+
+static unsigned int cpus;
+static struct idle_cpu *idle_cpus;
+
+/* the dma_latency directives holding a request */
+static struct dma_latency **requests;
+static unsigned int request_count;
+
+static int is_current(const struct cpufreq_policy *policy, unsigned int cpu) {
+	const struct profile *p = get_cpufreqd_info()->current_profiles[cpu];
+	return p != NULL && &p->policy == policy;
+}
+
+static int is_current_anywhere(const struct cpufreq_policy *policy) {
+	unsigned int i = 0;
+
+	for (i = 0; i < cpus; i++) {
+		if (is_current(policy, i))
+			return 1;
+	}
+	return 0;
+}
+
+static int read_state_attr(unsigned int cpu, unsigned int state,
+		const char *name, char *buf, size_t len) {
+	char path[MAX_PATH_LEN];
+	struct sysfs_attr *attr = NULL;
+	ssize_t ret = 0;
+
+	snprintf(path, sizeof(path), CPUIDLE_STATE "/%s", cpu, state, name);
+	if (access(path, F_OK) != 0 || (attr = sysfs_attr_open(path, O_RDONLY)) == NULL)
+		return -1;
+	ret = sysfs_attr_read(attr, buf, len);
+	sysfs_attr_close(attr);
+	return ret < 0 ? -1 : 0;
+}
+
+/* Finds the idle states of cpu, opening their disable attribute and
+ * saving its value to restore it later.
+ */
+static int scan_cpu(unsigned int cpu) {
+	struct idle_cpu *c = &idle_cpus[cpu];
+	struct idle_state *s = NULL;
+	char path[MAX_PATH_LEN], buf[32];
+	unsigned int i = 0;
+
+	/* not there until the cpu comes online, try again then */
+	snprintf(path, sizeof(path), CPUIDLE_DIR, cpu);
+	if (access(path, F_OK) != 0) {
+		clog(LOG_DEBUG, "CPU%u: no cpuidle directory\n", cpu);
+		return -1;
+	}
+	c->scanned = 1;
+	for (i = 0; ; i++) {
+		snprintf(path, sizeof(path), CPUIDLE_STATE "/disable", cpu, i);
+		if (access(path, F_OK) != 0)
+			break;
+
+		s = realloc(c->states, (c->count + 1) * sizeof(struct idle_state));
+		if (s == NULL) {
+			clog(LOG_ERR, "couldn't make enough room for CPU%u idle states (%s)\n",
+					cpu, strerror(errno));
+			break;
+		}
+		c->states = s;
+		s = &c->states[c->count];
+		memset(s, 0, sizeof(struct idle_state));
+
+		if (read_state_attr(cpu, i, "latency", buf, sizeof(buf)) != 0
+				|| sysfs_parse_long(buf, &s->latency) != 0)
+			continue;
+		if (read_state_attr(cpu, i, "name", s->name, sizeof(s->name)) != 0)
+			snprintf(s->name, sizeof(s->name), "state%u", i);
+		if ((s->disable = sysfs_attr_open(path, O_RDWR)) == NULL)
+			continue;
+		if (sysfs_attr_read_long(s->disable, &s->saved) != 0) {
+			sysfs_attr_close(s->disable);
+			continue;
+		}
+		s->disabled = s->saved != 0;
+		clog(LOG_DEBUG, "CPU%u: %s, exit latency %ldus%s\n", cpu, s->name,
+				s->latency, s->saved ? " (disabled)" : "");
+		c->count++;
+	}
+	if (c->count == 0) {
+		clog(LOG_WARNING, "CPU%u: no idle states found\n", cpu);
+		return -1;
+	}
+	return 0;
+}
+
+static void set_disabled(unsigned int cpu, struct idle_state *s, int disabled) {
+	if (s->disabled == disabled)
+		return;
+	if (sysfs_attr_write_long(s->disable, disabled) != 0)
+		return;
+	s->disabled = disabled;
+	clog(LOG_DEBUG, "CPU%u: %s %s\n", cpu, s->name,
+			disabled ? "disabled" : "enabled");
+}
+
+/* gives back the idle states of cpu as they were found */
+static void release_cpu(unsigned int cpu) {
+	struct idle_cpu *c = &idle_cpus[cpu];
+	unsigned int i = 0;
+
+	if (c->limit == NULL)
+		return;
+	for (i = 0; i < c->count; i++)
+		set_disabled(cpu, &c->states[i], c->states[i].saved != 0);
+	c->limit = NULL;
+	clog(LOG_INFO, "CPU%u: idle states restored\n", cpu);
+}
+
+static int add_request(struct dma_latency *d) {
+	struct dma_latency **tmp = NULL;
+
+	tmp = realloc(requests, (request_count + 1) * sizeof(struct dma_latency *));
+	if (tmp == NULL) {
+		clog(LOG_ERR, "couldn't make enough room for a request (%s)\n",
+				strerror(errno));
+		return -1;
+	}
+	requests = tmp;
+	requests[request_count++] = d;
+	return 0;
+}
+
+static void drop_request(struct dma_latency *d) {
+	unsigned int i = 0;
+
+	if (d->fd == -1)
+		return;
+	close(d->fd);
+	d->fd = -1;
+	for (i = 0; i < request_count && requests[i] != d; i++);
+	if (i < request_count)
+		requests[i] = requests[--request_count];
+	clog(LOG_INFO, "dropped dma latency request (%dus)\n", d->latency);
+}
+
+/*
+ *  parse the 'idle_max_latency' keyword, us
+ */
+static int idle_max_latency_parse(const char *ev, void **obj) {
+	struct idle_limit *ret = NULL;
+	long latency = 0;
+
+	if (sysfs_parse_long(ev, &latency) != 0 || latency < 0) {
+		clog(LOG_ERR, "couldn't parse idle_max_latency=%s, microseconds "
+				"expected\n", ev);
+		return -1;
+	}
+
+	ret = calloc(1, sizeof(struct idle_limit));
+	if (ret == NULL) {
+		clog(LOG_ERR, "couldn't make enough room for idle_max_latency (%s)\n",
+				strerror(errno));
+		return -1;
+	}
+	ret->latency = latency;
+	clog(LOG_INFO, "idle states up to %ldus\n", latency);
+	*obj = ret;
+	return 0;
+}
+
+/*
+ *  parse the 'dma_latency' keyword, us
+ */
+static int dma_latency_parse(const char *ev, void **obj) {
+	struct dma_latency *ret = NULL;
+	long latency = 0;
+
+	if (sysfs_parse_long(ev, &latency) != 0 || latency < 0
+			|| latency > INT32_MAX) {
+		clog(LOG_ERR, "couldn't parse dma_latency=%s, microseconds "
+				"expected\n", ev);
+		return -1;
+	}
+
+	ret = calloc(1, sizeof(struct dma_latency));
+	if (ret == NULL) {
+		clog(LOG_ERR, "couldn't make enough room for dma_latency (%s)\n",
+				strerror(errno));
+		return -1;
+	}
+	ret->latency = (int32_t)latency;
+	ret->fd = -1;
+	clog(LOG_INFO, "dma latency %ldus\n", latency);
+	*obj = ret;
+	return 0;
+}
+
+/* the outgoing Profile lets go of the idle states of cpu */
+static void idle_max_latency_pre_change(void *obj, const struct cpufreq_policy *old,
+		const struct cpufreq_policy __UNUSED__ *new, const unsigned int cpu) {
+	const struct idle_cpu *c = NULL;
+
+	if (cpu >= cpus || old == NULL)
+		return;
+	c = &idle_cpus[cpu];
+	if (c->limit != NULL && c->limit != obj && c->limit->policy == old)
+		release_cpu(cpu);
+}
+
+static void idle_max_latency_change(void *obj, const struct cpufreq_policy __UNUSED__ *old,
+		const struct cpufreq_policy *new, const unsigned int cpu) {
+	struct idle_limit *l = (struct idle_limit *)obj;
+	struct idle_cpu *c = NULL;
+	unsigned int i = 0;
+
+	l->policy = new;
+	if (cpu >= cpus)
+		return;
+	c = &idle_cpus[cpu];
+	if (c->limit == l)
+		return;
+	if (!c->scanned && scan_cpu(cpu) != 0)
+		return;
+
+	/* deeper states get their saved value back if the bound allows them */
+	for (i = 0; i < c->count; i++) {
+		set_disabled(cpu, &c->states[i], c->states[i].latency > l->latency
+				|| c->states[i].saved != 0);
+	}
+	c->limit = l;
+	clog(LOG_INFO, "CPU%u: idle states up to %ldus\n", cpu, l->latency);
+}
+
+/* the outgoing Profile drops its request unless still set elsewhere */
+static void dma_latency_pre_change(void *obj, const struct cpufreq_policy *old,
+		const struct cpufreq_policy __UNUSED__ *new, const unsigned int cpu) {
+	unsigned int i = 0, j = 0;
+
+	if (old == NULL)
+		return;
+	for (i = 0; i < request_count; ) {
+		if (requests[i] == obj || requests[i]->policy != old) {
+			i++;
+			continue;
+		}
+		for (j = 0; j < cpus; j++) {
+			if (j != cpu && is_current(old, j))
+				break;
+		}
+		if (j < cpus)
+			i++;
+		else
+			drop_request(requests[i]);
+	}
+}
+
+static void dma_latency_change(void *obj, const struct cpufreq_policy __UNUSED__ *old,
+		const struct cpufreq_policy *new, const unsigned int __UNUSED__ cpu) {
+	struct dma_latency *d = (struct dma_latency *)obj;
+
+	d->policy = new;
+	if (d->fd != -1)
+		return;
+
+	if ((d->fd = open(DMA_LATENCY, O_RDWR | O_CLOEXEC)) == -1) {
+		clog(LOG_ERR, "couldn't open %s (%s)\n", DMA_LATENCY, strerror(errno));
+		return;
+	}
+	if (write(d->fd, &d->latency, sizeof(d->latency)) != sizeof(d->latency)) {
+		clog(LOG_ERR, "couldn't write to %s (%s)\n", DMA_LATENCY,
+				strerror(errno));
+		close(d->fd);
+		d->fd = -1;
+		return;
+	}
+	if (add_request(d) != 0) {
+		close(d->fd);
+		d->fd = -1;
+		return;
+	}
+	clog(LOG_INFO, "holding dma latency request (%dus)\n", d->latency);
+}
+
+static void idle_max_latency_free(void *obj) {
+	unsigned int i = 0;
+
+	/* free_configuration() runs before cpuidle_exit() */
+	for (i = 0; i < cpus; i++) {
+		if (idle_cpus[i].limit == obj)
+			release_cpu(i);
+	}
+	free(obj);
+}
+
+static void dma_latency_free(void *obj) {
+	drop_request((struct dma_latency *)obj);
+	free(obj);
+}
+
+/* gives back what's held by Profiles no longer set, for the ones
+ * replaced by a Profile without our directives
+ */
+static int cpuidle_update(void) {
+	unsigned int i = 0;
+
+	for (i = 0; i < cpus; i++) {
+		if (idle_cpus[i].limit != NULL
+				&& !is_current(idle_cpus[i].limit->policy, i))
+			release_cpu(i);
+	}
+	for (i = 0; i < request_count; ) {
+		if (is_current_anywhere(requests[i]->policy))
+			i++;
+		else
+			drop_request(requests[i]);
+	}
+	return 0;
+}
+
+static int cpuidle_init(void) {
+	cpus = get_cpufreqd_info()->cpus;
+	idle_cpus = calloc(cpus, sizeof(struct idle_cpu));
+	if (idle_cpus == NULL) {
+		clog(LOG_ERR, "couldn't make enough room for %u cpus (%s)\n",
+				cpus, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+static int cpuidle_exit(void) {
+	unsigned int i = 0, j = 0;
+
+	for (i = 0; i < cpus; i++) {
+		release_cpu(i);
+		for (j = 0; j < idle_cpus[i].count; j++)
+			sysfs_attr_close(idle_cpus[i].states[j].disable);
+		free(idle_cpus[i].states);
+	}
+	free(idle_cpus);
+	idle_cpus = NULL;
+	cpus = 0;
+	while (request_count > 0)
+		drop_request(requests[0]);
+	free(requests);
+	requests = NULL;
+	clog(LOG_INFO, "cpuidle exited.\n");
+	return 0;
+}
+
+static struct cpufreqd_keyword kw[] = {
+	{ .word = "idle_max_latency", .parse = &idle_max_latency_parse,
+		.profile_pre_change = &idle_max_latency_pre_change,
+		.profile_post_change = &idle_max_latency_change,
+		.free = &idle_max_latency_free },
+	{ .word = "dma_latency", .parse = &dma_latency_parse,
+		.profile_pre_change = &dma_latency_pre_change,
+		.profile_post_change = &dma_latency_change,
+		.free = &dma_latency_free },
+	{ .word = NULL, .parse = NULL, .evaluate = NULL, .free = NULL }
+};
+
+static struct cpufreqd_plugin cpuidle = {
+	.plugin_name	= "cpuidle",
+	.keywords	= kw,
+	.plugin_init	= &cpuidle_init,
+	.plugin_exit	= &cpuidle_exit,
+	.plugin_update	= &cpuidle_update,
+};
+
+struct cpufreqd_plugin *create_plugin (void) {
+	return &cpuidle;
+}
@@ -177,6 +177,9 @@ static void exec_profile_post_change(void *obj,
 		const struct cpufreq_policy __UNUSED__ *new,
 		const unsigned int __UNUSED__ cpu) {
 	struct cpufreqd_info *cinfo = get_cpufreqd_info();
+	/* the Profile was set before cpufreqd started, commands already ran */
+	if (cinfo->adopting)
+		return;
 	clog(LOG_DEBUG, "launch counter = %d\n", profile_post_change_calls);
 	if (profile_post_change_calls == 0 || cinfo->cpufreqd_mode == MODE_MANUAL)
 		exec_enqueue((char *)obj);
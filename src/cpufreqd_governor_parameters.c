@@ -18,158 +18,235 @@
 
 /*
  * Governor parameter plugin for cpufreqd
- * Version 0.3
+ * Version 0.4
  */
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
-#include <sysfs/libsysfs.h>
 
 #include "cpufreqd_plugin.h"
+#include "sysfs_utils.h"
 
 #define BUFLEN_PARAMETER_VALUE 24
-#define SYS_CPU_DIR "devices/system/cpu"
-
-static unsigned int number_of_cpus = 1;
-static char syspath_cpu[SYSFS_PATH_MAX];
-
-static const char *supported_governors[] = {
-	"ondemand",
-	"conservative",
-	NULL
-};
+#define SYS_CPU_DIR "/sys/devices/system/cpu"
 
 
 /* Governor parameter object struct.
  */
 struct gov_parameter {
-	char parameter_name[SYSFS_NAME_LEN];
+	char parameter_name[MAX_STRING_LEN];
 	long int parameter_value;
 	short int is_percentage;
 };
 
+/* A governor tunable, opened once and kept open.
+ */
+struct tunable {
+	char name[MAX_STRING_LEN];
+	struct sysfs_attr *attr;
+	long int min, max;
+	short int has_range;	/* <name>_min and <name>_max could be read */
+	struct tunable *next;
+};
+
+/* The tunables directory of a governor: per policy
+ * (cpufreq/policyN/<governor>, cpuN/cpufreq links there) or global
+ * (cpufreq/<governor>). CPUs sharing the policy share the directory.
+ */
+struct gov_dir {
+	char path[MAX_PATH_LEN];
+	struct tunable *tunables;
+	struct gov_dir *next;
+};
+
+/* Which directory holds the tunables of a governor for a CPU.
+ */
+struct cpu_gov {
+	unsigned int cpu;
+	char governor[MAX_STRING_LEN];
+	struct gov_dir *dir;
+	struct cpu_gov *next;
+};
+
+static struct gov_dir *gov_dirs;
+static struct cpu_gov *cpu_govs;
+
 
-/* Opens a sysfs device for the cpufreq governor of a given CPU number.
- * Returns a pointer to the device if successfull, NULL on error.
+/* Finds the directory with the tunables of 'governor' on 'cpu', the
+ * result is cached, symlinks are resolved so that CPUs of the same policy
+ * get the same directory.
+ * Returns NULL if the governor has no tunables.
  */
-static struct sysfs_device *open_governor_device(unsigned int cpu, const char *governor)
+static struct gov_dir *get_governor_dir(unsigned int cpu, const char *governor)
 {
-	char govdev_path[SYSFS_PATH_MAX];
-	struct sysfs_device *govdev = NULL;
+	char path[MAX_PATH_LEN];
+	char resolved[PATH_MAX];
+	struct cpu_gov *cg = NULL;
+	struct gov_dir *dir = NULL;
+
+	for (cg = cpu_govs; cg != NULL; cg = cg->next) {
+		if (cg->cpu == cpu && strcmp(cg->governor, governor) == 0)
+			return cg->dir;
+	}
 
-	/* Construct sysfs path string for governor device of this cpu */
-	snprintf(govdev_path, SYSFS_PATH_MAX, "%s/cpu%u/cpufreq/%s", syspath_cpu, cpu, governor);
-	clog(LOG_DEBUG, "sysfs path governor device = %s\n", govdev_path);
+	snprintf(path, sizeof(path), "%s/cpu%u/cpufreq/%s", SYS_CPU_DIR, cpu, governor);
+	if (realpath(path, resolved) == NULL) {
+		snprintf(path, sizeof(path), "%s/cpufreq/%s", SYS_CPU_DIR, governor);
+		if (realpath(path, resolved) == NULL) {
+			clog(LOG_INFO, "no tunables for governor %s on cpu%u\n", governor, cpu);
+			return NULL;
+		}
+	}
+	clog(LOG_DEBUG, "tunables for %s on cpu%u are in %s\n", governor, cpu, resolved);
 
-	/* Open sysfs governor device */
-	govdev = sysfs_open_device_path(govdev_path);
-	if (govdev == NULL) {
-		clog(LOG_ERR, "ERROR: device for governor %s not found in sysfs for cpu%u.\n", governor, cpu);
-		return NULL;
+	for (dir = gov_dirs; dir != NULL; dir = dir->next) {
+		if (strcmp(dir->path, resolved) == 0)
+			break;
 	}
-	return govdev;
+	if (dir == NULL) {
+		dir = calloc(1, sizeof(struct gov_dir));
+		if (dir == NULL) {
+			clog(LOG_ERR, "ERROR: not enough memory for a governor directory\n");
+			return NULL;
+		}
+		snprintf(dir->path, sizeof(dir->path), "%s", resolved);
+		dir->next = gov_dirs;
+		gov_dirs = dir;
+	}
+
+	cg = calloc(1, sizeof(struct cpu_gov));
+	if (cg == NULL) {
+		clog(LOG_ERR, "ERROR: not enough memory for a governor directory\n");
+		return dir;
+	}
+	cg->cpu = cpu;
+	snprintf(cg->governor, sizeof(cg->governor), "%s", governor);
+	cg->dir = dir;
+	cg->next = cpu_govs;
+	cpu_govs = cg;
+	return dir;
 }
 
 
-/* Reads the value of 'parameter' of the active governor
- * Returns the paramter value, or -1 on error.
+/* Reads <parameter>_min or <parameter>_max once for percentage values.
+ * Returns 0 on success, -1 if the attribute doesn't exist.
  */
-static long int get_parameter(struct sysfs_device *govdev, const char *parameter)
+static int read_limit(const struct gov_dir *dir, const char *parameter,
+		const char *suffix, long int *value)
 {
-	struct sysfs_attribute *govattr = NULL;
+	char path[MAX_PATH_LEN];
+	struct sysfs_attr *attr = NULL;
+	int ret = 0;
 
-	govattr = sysfs_get_device_attr(govdev, parameter);
-	if (govattr == NULL) {
-		clog(LOG_WARNING, "warning: attribute %s not found in sysfs.\n", parameter);
+	snprintf(path, sizeof(path), "%s/%s_%s", dir->path, parameter, suffix);
+	if (access(path, R_OK) != 0 || (attr = sysfs_attr_open(path, O_RDONLY)) == NULL)
 		return -1;
-	}
-	return atol(govattr->value);
+	ret = sysfs_attr_read_long(attr, value);
+	sysfs_attr_close(attr);
+	if (ret == 0)
+		clog(LOG_DEBUG, "%s value for %s: %ld\n", suffix, parameter, *value);
+	return ret;
 }
 
 
-/* Sets the value of 'parameter' of 'governor' to 'value'.
+/* Opens the tunable 'parameter' in 'dir', the handle is cached.
+ * Returns NULL if the governor doesn't have it.
  */
-static void set_parameter(const unsigned int cpu, const char *governor,
-		const char *parameter, long int value, int is_percentage)
+static struct tunable *get_tunable(struct gov_dir *dir, const char *parameter)
 {
-	char value_str[BUFLEN_PARAMETER_VALUE];
-	struct sysfs_device *govdev = NULL;
-	struct sysfs_attribute *govattr = NULL;
+	char path[MAX_PATH_LEN];
+	struct tunable *t = NULL;
+	struct sysfs_attr *attr = NULL;
 
-	/* For each CPU */
-	govdev = open_governor_device(cpu, governor);
-	if (govdev == NULL) {
-		return;
-	}
-	if (is_percentage) {
-		long int min, max;
-		long long int abs_value;
-		char min_name[SYSFS_NAME_LEN];
-		char max_name[SYSFS_NAME_LEN];
-
-		/* Read minimum allowed value */
-		snprintf(min_name, SYSFS_NAME_LEN, "%s_min", parameter);
-		min = get_parameter(govdev, min_name);
-		if (min < 0) {
-			sysfs_close_device(govdev);
-			clog(LOG_WARNING, "warning: minimum value for %s could not be read: ignored.\n", parameter);
-			return;
-		}
-		clog(LOG_DEBUG, "minimum value for %s: %ld\n", parameter, min);
-
-		/* Read maximum allowed value */
-		snprintf(max_name, SYSFS_NAME_LEN, "%s_max", parameter);
-		max = get_parameter(govdev, max_name);
-		if (max < 0) {
-			sysfs_close_device(govdev);
-			clog(LOG_WARNING, "warning: maximum value for %s could not be read: ignored.\n", parameter);
-			return;
-		}
-		clog(LOG_DEBUG, "maximum value for %s: %ld\n", parameter, max);
-
-		/* Convert percentage to absolute value in a string */
-		abs_value = (long long int)value * (max - min) / 100 + min;
-		snprintf(value_str, BUFLEN_PARAMETER_VALUE, "%lu", (long int)abs_value);
-		clog(LOG_DEBUG, "converted percentage %ld to absolute value: %s\n", value, value_str);
-	} else {
-		/* Convert value to string */
-		snprintf(value_str, BUFLEN_PARAMETER_VALUE, "%lu", value);
+	for (t = dir->tunables; t != NULL; t = t->next) {
+		if (strcmp(t->name, parameter) == 0)
+			return t;
 	}
 
-	/* Get sysfs attribute for the parameter */
-	govattr = sysfs_get_device_attr(govdev, parameter);
+	snprintf(path, sizeof(path), "%s/%s", dir->path, parameter);
+	if (access(path, F_OK) == 0)
+		attr = sysfs_attr_open(path, O_RDWR);
 
 	/* Kernel compatibility issue:
 	 * The parameter name "ignore_nice" changed to "ignore_nice_load" in kernel >= 2.6.16.
-	 * We are accepting both names silently, regardless the kernel version by trying to get
-	 * a sysfs device for the other name when the specified name doesn't exist in sysfs.
+	 * We are accepting both names silently, regardless the kernel version by trying
+	 * the other name when the specified name doesn't exist in sysfs.
 	 */
-	if (govattr == NULL) {
+	if (attr == NULL) {
 		if (strcmp(parameter, "ignore_nice") == 0) {
-			govattr = sysfs_get_device_attr(govdev, "ignore_nice_load");
+			snprintf(path, sizeof(path), "%s/%s", dir->path, "ignore_nice_load");
+			attr = sysfs_attr_open(path, O_RDWR);
 		} else if (strcmp(parameter, "ignore_nice_load") == 0) {
-			govattr = sysfs_get_device_attr(govdev, "ignore_nice");
+			snprintf(path, sizeof(path), "%s/%s", dir->path, "ignore_nice");
+			attr = sysfs_attr_open(path, O_RDWR);
+		}
+	}
+	if (attr == NULL) {
+		clog(LOG_WARNING, "warning: attribute %s not found in %s.\n", parameter, dir->path);
+		return NULL;
+	}
+
+	t = calloc(1, sizeof(struct tunable));
+	if (t == NULL) {
+		clog(LOG_ERR, "ERROR: not enough memory for a governor parameter\n");
+		sysfs_attr_close(attr);
+		return NULL;
+	}
+	snprintf(t->name, sizeof(t->name), "%s", parameter);
+	t->attr = attr;
+	t->has_range = read_limit(dir, parameter, "min", &t->min) == 0
+		&& read_limit(dir, parameter, "max", &t->max) == 0;
+	t->next = dir->tunables;
+	dir->tunables = t;
+	return t;
+}
+
+
+/* Sets the value of 'parameter' of 'governor' to 'value'. CPUs sharing
+ * the policy only cause one write: nothing is written if the kernel
+ * already holds the value (switching governor resets the tunables so
+ * the last value written can't be trusted).
+ */
+static void set_parameter(const unsigned int cpu, const char *governor,
+		const char *parameter, long int value, int is_percentage)
+{
+	struct gov_dir *dir = NULL;
+	struct tunable *t = NULL;
+	long int current = 0;
+
+	if ((dir = get_governor_dir(cpu, governor)) == NULL
+			|| (t = get_tunable(dir, parameter)) == NULL)
+		return;
+
+	if (is_percentage) {
+		if (!t->has_range) {
+			clog(LOG_WARNING, "warning: minimum and maximum values for %s "
+					"could not be read: ignored.\n", parameter);
+			return;
 		}
+		/* Convert percentage to absolute value */
+		value = (long int)((long long int)value * (t->max - t->min) / 100 + t->min);
+		clog(LOG_DEBUG, "converted percentage to absolute value: %ld\n", value);
 	}
-	if (govattr == NULL) {
-		sysfs_close_device(govdev);
-		clog(LOG_WARNING, "warning: attribute %s not found in sysfs.\n", parameter);
+
+	if (sysfs_attr_read_long(t->attr, &current) == 0 && current == value) {
+		clog(LOG_DEBUG, "parameter %s already %ld for %s governor on cpu%u\n",
+				parameter, value, governor, cpu);
 		return;
 	}
 
 	/* Write new value to sysfs' parameter attribute */
-	if (sysfs_write_attribute(govattr, value_str, strlen(value_str)) < 0) {
-		clog(LOG_ERR, "ERROR: could not set parameter %s to %s for %s governor on cpu%u: %s\n",
-				parameter, value_str, governor, cpu, strerror(errno));
+	if (sysfs_attr_write_long(t->attr, value) < 0) {
+		clog(LOG_ERR, "ERROR: could not set parameter %s to %ld for %s governor on cpu%u\n",
+				parameter, value, governor, cpu);
+		return;
 	}
-	clog(LOG_DEBUG, "parameter %s set to %s for %s governor on cpu%u\n",
-			parameter, value_str, governor, cpu);
-
-	/* Close governor device. This will free all structures allocated by libsysfs */
-	sysfs_close_device(govdev);
+	clog(LOG_DEBUG, "parameter %s set to %ld for %s governor on cpu%u\n",
+			parameter, value, governor, cpu);
 }
 
 
@@ -202,7 +279,7 @@ static int parameter_parse(const char *keyword, const char *value, void **obj,
 	}
 
 	/* Copy keyword to the object. */
-	snprintf(ret->parameter_name, SYSFS_NAME_LEN, "%s", keyword);
+	snprintf(ret->parameter_name, MAX_STRING_LEN, "%s", keyword);
 
 	/* Make writable copy of the value string */
 	snprintf(strvalue, BUFLEN_PARAMETER_VALUE, "%s", value);
@@ -332,6 +409,22 @@ static int freq_step_parse(const char *value, void **obj)
 	return parameter_parse("freq_step", value, obj, FALSE, FALSE);
 }
 
+/* Any tunable of any governor: governor_parameter=<name>:<value>
+ */
+static int governor_parameter_parse(const char *value, void **obj)
+{
+	char name[MAX_STRING_LEN];
+	size_t len = strspn(value, "abcdefghijklmnopqrstuvwxyz0123456789_");
+
+	if (len == 0 || len >= MAX_STRING_LEN || value[len] != ':') {
+		clog(LOG_WARNING, "governor_parameter must be <name>:<value> (%s)\n", value);
+		return -1;
+	}
+	memcpy(name, value, len);
+	name[len] = '\0';
+	return parameter_parse(name, value + len + 1, obj, TRUE, TRUE);
+}
+
 
 /* Event handler.
  * Called when cpufreqd just changed the profile.
@@ -339,32 +432,16 @@ static int freq_step_parse(const char *value, void **obj)
 static void gov_parameter_post_change(void *obj, const struct cpufreq_policy *not_needed,
 		const struct cpufreq_policy *new_policy, const unsigned int cpu)
 {
-	int i;
-	const char *parameter;
-	long int value;
-	int is_percentage;
+	const struct gov_parameter *gp = (const struct gov_parameter *) obj;
 
 	/* Just preventing compiler warning here */
 	not_needed = not_needed;
 
-	/* Convenience variables */
-	parameter = ((struct gov_parameter *) obj)->parameter_name;
-	value = ((struct gov_parameter *) obj)->parameter_value;
-	is_percentage = ((struct gov_parameter *) obj)->is_percentage;
-
-	/* Check if we support this governor */
-	i = 0;
-	while (supported_governors[i] != NULL) {
-		if (strcmp(supported_governors[i], new_policy->governor) == 0) {
-			clog(LOG_INFO, "setting governor parameter %s = %ld%c\n",
-					parameter, value, is_percentage ? '%' : ' ');
-			set_parameter(cpu, new_policy->governor, parameter, value, is_percentage);
-			return;
-		}
-		++i;
-	}
-	clog(LOG_INFO, "governor parameter %s specified, but %s is not supported by this plugin\n",
-			parameter, new_policy->governor);
+	clog(LOG_INFO, "setting governor parameter %s = %ld%c\n",
+			gp->parameter_name, gp->parameter_value,
+			gp->is_percentage ? '%' : ' ');
+	set_parameter(cpu, new_policy->governor, gp->parameter_name,
+			gp->parameter_value, gp->is_percentage);
 }
 
 
@@ -372,23 +449,7 @@ static void gov_parameter_post_change(void *obj, const struct cpufreq_policy *no
  */
 static int gov_parameter_init(void)
 {
-	char sysfsmountpath[SYSFS_PATH_MAX];
-	struct cpufreqd_info const *info;
-
 	clog(LOG_DEBUG, "called\n");
-
-	/* Get number of CPU's */
-	info = get_cpufreqd_info();
-	number_of_cpus = info->cpus;
-
-	/* Construct sysfs base directory string for cpu device */
-	if (sysfs_get_mnt_path(sysfsmountpath, SYSFS_PATH_MAX) < 0) {
-		clog(LOG_ERR, "ERROR in call to libsysfs. Should not happen. Must be a bug..\n");
-		return -1;
-	}
-	clog(LOG_DEBUG, "sysfs mount path = %s\n", sysfsmountpath);
-	snprintf(syspath_cpu, SYSFS_PATH_MAX, "%s/%s", sysfsmountpath, SYS_CPU_DIR);
-	clog(LOG_DEBUG, "sysfs path cpu device  = %s\n", syspath_cpu);
 	return 0;
 }
 
@@ -397,7 +458,27 @@ static int gov_parameter_init(void)
  */
 static int gov_parameter_exit(void)
 {
+	struct gov_dir *dir = NULL;
+	struct tunable *t = NULL;
+	struct cpu_gov *cg = NULL;
+
 	clog(LOG_DEBUG, "called\n");
+	while (cpu_govs != NULL) {
+		cg = cpu_govs;
+		cpu_govs = cg->next;
+		free(cg);
+	}
+	while (gov_dirs != NULL) {
+		dir = gov_dirs;
+		gov_dirs = dir->next;
+		while (dir->tunables != NULL) {
+			t = dir->tunables;
+			dir->tunables = t->next;
+			sysfs_attr_close(t->attr);
+			free(t);
+		}
+		free(dir);
+	}
 	return 0;
 }
 
@@ -445,6 +526,12 @@ static struct cpufreqd_keyword kw[] = {
 		.profile_post_change = &gov_parameter_post_change
 	},
 
+	{
+		.word = "governor_parameter",
+		.parse = &governor_parameter_parse,
+		.profile_post_change = &gov_parameter_post_change
+	},
+
 	{.word = NULL, .parse = NULL, .evaluate = NULL, .free = NULL}
 };
 
@@ -18,15 +18,17 @@
  */
 
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
-#include <sys/stat.h>
 #include <unistd.h>
 #include "cpufreqd_plugin.h"
+#include "sysfs_utils.h"
 
 static char vcore_path[MAX_PATH_LEN];
+static struct sysfs_attr *vcore_attr;
 static int vcore_default;
 
 static const int min_vcore = 1200;
@@ -48,28 +50,24 @@ static int limit_vcore(int read_vcore)
 static inline void set_vcore(int vcore)
 {
 	if (vcore) {
-		FILE *fp = fopen(vcore_path, "w");
-		if (!fp) {
+		if (sysfs_attr_write_long(vcore_attr, vcore) != 0) {
 			clog(LOG_ERR, "Could not write Vcore %i to vcore_path (%s)!\n",
 					vcore, vcore_path);
 		} else {
-			fprintf(fp, "%i", vcore);
-			fclose(fp);
 			clog(LOG_DEBUG, "Vcore %i set\n", vcore);
 		}
 	}
 }
 
 static int nforce2_post_conf(void) {
-	struct stat sb;
 
 	if (!vcore_path[0]) {
 		clog(LOG_INFO, "Unconfigured, exiting.\n");
 		return -1;
 	}
 	/* check vcore_path */
-	if (stat(vcore_path, &sb) != 0) {
-		clog(LOG_INFO, "Unable to find %s.\n", vcore_path);
+	if ((vcore_attr = sysfs_attr_open(vcore_path, O_WRONLY)) == NULL) {
+		clog(LOG_INFO, "Unable to open %s.\n", vcore_path);
 		return -1;
 	}
 	return 0;
@@ -91,7 +89,11 @@ static int nforce2_conf(const char *key, const char *value) {
 }
 
 static int nforce2_exit(void) {
-	set_vcore(vcore_default);
+	if (vcore_attr != NULL) {
+		set_vcore(vcore_default);
+		sysfs_attr_close(vcore_attr);
+		vcore_attr = NULL;
+	}
 	return 0;
 }
 
@@ -21,6 +21,7 @@
 #define __CPUFREQD_PLUGIN_H__ 1
 
 #include <cpufreq.h>
+#include <stdio.h>
 #include <sys/types.h>
 #include <sys/time.h>
 #include <signal.h>
@@ -29,6 +30,7 @@
 #include "cpufreqd_remote.h"
 #include "config_parser.h"
 #include "cpufreqd_log.h"
+#include "freq_table.h"
 
 #define FALSE	0
 #define TRUE	1
@@ -50,18 +52,23 @@ struct cpufreq_sys_info {
 	struct cpufreq_available_governors *governors;
 	struct cpufreq_available_frequencies *frequencies;
 	struct cpufreq_affected_cpus *affected_cpus;
+	struct freq_table *table; /* sorted frequencies, shared within a policy */
 };
 
 struct cpufreqd_info {
-	unsigned int cpus;
+	unsigned int cpus; /* possible cpus, some may be offline */
+	unsigned char *online; /* per cpu, kept up to date on hotplug */
 	int cpufreqd_mode; /* operation mode (manual / dynamic) */
 	struct cpufreq_limits *limits;
 	struct cpufreq_sys_info *sys_info;
 	struct profile **current_profiles;
 	/* last update, IOW las call to cpufreqd_loop (see main.h)*/
 	struct timeval timestamp;
+	/* set while Profiles found already set at startup are adopted */
+	int adopting;
 };
 extern struct cpufreqd_info *cpufreqd_info;
+struct cpufreqd_info *get_cpufreqd_info(void);
 
 struct cpufreqd_plugin;
 
@@ -118,6 +125,9 @@ struct cpufreqd_keyword {
 	/* function pointer to the profile_post_change event. The same as
 	 * profile_pre_change applies except for the fact that everything is
 	 * referred tto _after_ set_policy() has been called.
+	 * It is also called, with a NULL old policy and cpufreqd_info->adopting
+	 * set, for the Profiles found already set at startup: plugins take hold
+	 * of them but actions meant for a real change should be skipped.
 	 *
 	 * Can be NULL.
 	 */
@@ -196,6 +206,23 @@ struct cpufreqd_plugin {
 	 */
 	int (*plugin_post_conf) (void);
 
+	/* Warm start snapshot (see state.h), writes to fp a single line of
+	 * text (no newline) with the runtime state worth keeping across
+	 * restarts.
+	 * Returns 0 on success, -1 if there's nothing to save.
+	 *
+	 * Can be NULL.
+	 */
+	int (*plugin_save) (FILE *fp);
+
+	/* Restores a snapshot written by plugin_save, called at startup
+	 * after the configuration is read and before the first plugin_update.
+	 * Returns 0 on success, -1 if the snapshot can't be used.
+	 *
+	 * Can be NULL.
+	 */
+	int (*plugin_restore) (const char *snapshot);
+
 	/* Allow plugins to make some data available to others.
 	 * This data can be retrieved using
 	 * void *get_plugin_data(const char *name)
@@ -210,13 +237,12 @@ struct cpufreqd_plugin {
  */
 struct cpufreqd_plugin *create_plugin(void);
 
-#if 0
 /*  This is a hack to enable plugin cooperation. A plugin can read
  *  some status data from another one.
  *  Tha name "core" is reserved for cpufreqd core data (current
  *  policy, current cpu speed, ...)
+ *  Returns NULL if the plugin isn't loaded or has no data.
  */
 extern void *get_plugin_data(const char *name);
-#endif
 
 #endif
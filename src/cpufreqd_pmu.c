@@ -26,10 +26,12 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "cpufreqd_plugin.h"
+#include "sysfs_utils.h"
 
 #ifndef DEBUG_NO_PMU
 #  define PMU_INFO_FILE		"/proc/pmu/info"
@@ -47,19 +49,29 @@ struct battery_interval {
 
 static char tag[255];
 static char val[255];
+static char pmu_buf[1024];
+static struct sysfs_attr *pmu_info;
+static struct sysfs_attr *pmu_battery;
 static char version[100];
 static unsigned int battery_present;
 static int battery_percent;
 static unsigned int ac;
 
-static int tokenize (FILE *fp, char *t, char *v) {
+/* tokenizes the next line off *buf, advancing it */
+static int tokenize (const char **buf, char *t, char *v) {
 	char str[255];
 	char *s1, *s2;
+	size_t len = 0;
 
 	t[0] = v[0] = '\0';
 
-	if (fgets(str, 255, fp) == NULL)
+	if (**buf == '\0')
 		return EOF;
+	len = strcspn(*buf, "\n");
+	snprintf(str, sizeof(str), "%.*s", (int)len, *buf);
+	*buf += len;
+	if (**buf == '\n')
+		(*buf)++;
 
 	if ((s1 = strtok(str, ":")) == NULL)
 		return 0;
@@ -105,15 +117,17 @@ static int tokenize (FILE *fp, char *t, char *v) {
  */
 static int pmu_init(void) {
 
-	FILE *fp;
+	const char *buf = pmu_buf;
 
-	fp = fopen(PMU_INFO_FILE, "r");
-	if (!fp) {
+	pmu_info = sysfs_attr_open(PMU_INFO_FILE, O_RDONLY);
+	if (!pmu_info || sysfs_attr_read(pmu_info, pmu_buf, sizeof(pmu_buf)) < 0) {
 		clog(LOG_INFO, "%s: %s\n", PMU_INFO_FILE, strerror(errno));
+		sysfs_attr_close(pmu_info);
+		pmu_info = NULL;
 		return -1;
 	}
 
-	while (tokenize(fp, tag, val) != EOF) {
+	while (tokenize(&buf, tag, val) != EOF) {
 		if (strcmp(tag, "PMU driver version") == 0) {
 			sprintf(version, "%s - ", val);
 		}
@@ -121,28 +135,33 @@ static int pmu_init(void) {
 			strncat(version, val, 100-strlen(version));
 		}
 	}
-	fclose(fp);
 
 	clog(LOG_NOTICE, "PMU driver/firmware version %s\n", version);
 
 	return 0;
 }
 
+static int pmu_exit(void) {
+	sysfs_attr_close(pmu_info);
+	sysfs_attr_close(pmu_battery);
+	pmu_info = pmu_battery = NULL;
+	return 0;
+}
+
 static int pmu_update(void) {
 
-	FILE *fp;
+	const char *buf = pmu_buf;
 
 	float bat_charge = .0;
 	float bat_max_charge = .0;
 
 	/** /proc/pmu/info **/
-	fp = fopen(PMU_INFO_FILE, "r");
-	if (!fp) {
+	if (sysfs_attr_read(pmu_info, pmu_buf, sizeof(pmu_buf)) < 0) {
 		clog(LOG_ERR, "%s: %s\n", PMU_INFO_FILE, strerror(errno));
 		return -1;
 	}
 
-	while (tokenize(fp, tag, val) != EOF) {
+	while (tokenize(&buf, tag, val) != EOF) {
 		if (strcmp(tag, "AC Power") == 0) {
 			ac = atoi(val);
 		}
@@ -150,16 +169,18 @@ static int pmu_update(void) {
 			battery_present = atoi(val);
 		}
 	}
-	fclose(fp);
 
 	/** /proc/pmu/battery_0 **/
-	fp = fopen(PMU_BATTERY_FILE, "r");
-	if (!fp) {
+	if (pmu_battery == NULL)
+		pmu_battery = sysfs_attr_open(PMU_BATTERY_FILE, O_RDONLY);
+	if (pmu_battery == NULL ||
+			sysfs_attr_read(pmu_battery, pmu_buf, sizeof(pmu_buf)) < 0) {
 		clog(LOG_ERR, "%s: %s\n", PMU_BATTERY_FILE, strerror(errno));
 		return -1;
 	}
 
-	while (tokenize(fp, tag, val) != EOF) {
+	buf = pmu_buf;
+	while (tokenize(&buf, tag, val) != EOF) {
 		if (strcmp(tag, "charge") == 0) {
 			bat_charge = atof(val);
 		}
@@ -167,7 +188,6 @@ static int pmu_update(void) {
 			bat_max_charge = atof(val);
 		}
 	}
-	fclose(fp);
 
 	battery_percent = 100 * (bat_charge / bat_max_charge);
 
@@ -264,6 +284,7 @@ static struct cpufreqd_plugin pmu = {
 	.plugin_name      = "pmu_plugin",	/* plugin_name */
 	.keywords         = kw,			/* config_keywords */
 	.plugin_init      = &pmu_init,		/* plugin_init */
+	.plugin_exit      = &pmu_exit,		/* plugin_exit */
 	.plugin_update    = &pmu_update		/* plugin_update */
 };
 
@@ -17,399 +17,1420 @@
  *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
-#include <ctype.h>
-#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <regex.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
 #include "cpufreqd_plugin.h"
 
-#define PRG_LENGTH 64
+/* the netlink process events connector needs a listening thread */
+#if defined(HAVE_LINUX_CN_PROC_H) && defined(PTHREAD_DIR)
+#  define PROC_CONNECTOR 1
+#  include <pthread.h>
+#  include <sys/socket.h>
+#  include <linux/netlink.h>
+#  include <linux/connector.h>
+#  include <linux/cn_proc.h>
+#endif
+
+#define CMD_LENGTH 256
+#define NAME_SET_MIN 256
+#define PID_HASH_SIZE 16384
+#define DENTS_BUF_SIZE 32768
+#define CN_RCVBUF_SIZE (1024 * 1024)
+
+#define PATTERN_EXACT	0
+#define PATTERN_GLOB	1
+#define PATTERN_REGEX	2
+
+/* a single entry of a programs= directive:
+ *   name        exact match
+ *   glob*       fnmatch(3) pattern
+ *   ~regex      extended regular expression
+ * patterns containing a '/' are matched against the full command
+ * path, the others against its basename. A trailing >=N requires
+ * N running instances.
+ * The patterns of a directive are chained through next, all the
+ * patterns are also on the all_next list to match new programs.
+ */
+struct prg_pattern {
+	char *str;
+	int type;
+	int full_path;
+	regex_t re;
+	unsigned int min_count;
+	unsigned int count;		/* running instances matching */
+	struct prg_usage *usage;	/* owning program_usage= directive */
+	struct prg_pattern *next;
+	struct prg_pattern *all_next;
+};
+static struct prg_pattern *all_patterns = NULL;
 
-/* a tree structure, contains strings
- * - a binary tree
- * - almost balanced
- * - no duplicates allowed
- * - contains a 'used' short to reuse the allocated
- *   memory through each loop
+/* a program_usage= directive, the cpu time used by the pids
+ * matching any of its patterns is summed at each update
  */
-struct TNODE {
-	char name[PRG_LENGTH];
-	struct TNODE *left;
-	struct TNODE *right;
-	struct TNODE *parent;
-	unsigned short used;
-	unsigned short height;
+struct prg_usage {
+	struct prg_pattern *patterns;
+	int min, max;
+	unsigned long long ticks;	/* cpu time used since the last update */
+	unsigned int stamp;		/* last pid accounted for */
+	int usage;			/* percent of a single cpu */
+	struct prg_usage *next;
 };
-typedef struct TNODE TNODE;
-typedef TNODE TREE;
+static struct prg_usage *all_usage = NULL;
 
-static TREE *running_programs = 0L;
+/* a running program, names are interned in an open addressing
+ * hash set and shared by all the pids running them. The patterns
+ * matching a program are resolved once when it is first seen,
+ * later on pid changes only update the pattern counts.
+ */
+struct prg_name {
+	unsigned int hash;
+	unsigned int used;		/* running instances */
+	unsigned int nmatch;
+	unsigned int nusage;		/* program_usage= patterns among them */
+	struct prg_pattern **match;	/* patterns matching this program */
+	const char *base;		/* basename of path */
+	char path[];			/* argv[0] as found in cmdline */
+};
+static struct prg_name **name_set = NULL;
+static unsigned int name_set_size = 0;	/* always a power of 2 */
+static unsigned int name_set_count = 0;
 
-/* create a new node obj */
-static TNODE * new_tnode(void) {
-	TNODE *ret = (TNODE *)calloc(1, sizeof(TNODE));
-	return ret;
+/* pid to program name cache, filled by the /proc scan and kept
+ * up to date by the proc connector when it is running.
+ * Every entry is also on the seen list: the scan moves the pids
+ * it finds to the tail, whatever is left at the head has gone.
+ */
+struct pid_entry {
+	pid_t pid;
+	ino_t ino;		/* /proc/<pid> inode, changes if the pid is reused */
+	unsigned int gen;	/* last scan that saw this pid */
+	int confirmed;		/* name re-read once, in case we caught fork before exec */
+	struct prg_name *prg;	/* NULL for kernel threads and zombies */
+	int stat_fd;		/* kept open while program_usage= watches the pid */
+	unsigned long long cpu_ticks;	/* utime + stime at the last update */
+	struct pid_entry *next;
+	struct pid_entry *seen_prev;
+	struct pid_entry *seen_next;
+	struct pid_entry *usage_prev;
+	struct pid_entry *usage_next;
+};
+static struct pid_entry *pid_table[PID_HASH_SIZE];
+static struct pid_entry seen_list = {
+	.seen_prev = &seen_list,
+	.seen_next = &seen_list,
+};
+/* pids whose cpu time is accounted for */
+static struct pid_entry usage_list = {
+	.usage_prev = &usage_list,
+	.usage_next = &usage_list,
+};
+static unsigned int scan_gen;
+
+/* /proc is kept open and read with getdents64 into a static buffer */
+struct linux_dirent64 {
+	unsigned long long d_ino;
+	long long d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+static char dents_buf[DENTS_BUF_SIZE] __attribute__ ((aligned(8)));
+static int proc_fd = -1;
+
+static int use_proc_connector = 1;
+
+#ifdef PROC_CONNECTOR
+static pthread_t cn_thread;
+static pthread_mutex_t programs_mtx = PTHREAD_MUTEX_INITIALIZER;
+static int cn_sock = -1;
+static int cn_active;
+static int cn_resync;
+/* pids the thread had events for during a rescan, the pid
+ * map is more recent than the /proc snapshot for them
+ */
+static int cn_rescanning;
+static pid_t *cn_touched;
+static unsigned int cn_touched_count, cn_touched_size;
+#  define programs_lock()	pthread_mutex_lock(&programs_mtx)
+#  define programs_unlock()	pthread_mutex_unlock(&programs_mtx)
+#else
+#  define programs_lock()
+#  define programs_unlock()
+#endif
+
+/* FNV-1a */
+static unsigned int name_hash(const char *s) {
+	unsigned int h = 2166136261U;
+	while (*s) {
+		h ^= (unsigned char)*s++;
+		h *= 16777619U;
+	}
+	return h;
 }
 
-/* set the usage count to 0 */
-static void neglect_node(TNODE **n) {
-	if (*n != NULL) {
-		(*n)->used = 0;
+static int pattern_matches(const struct prg_pattern *p, const struct prg_name *n) {
+	const char *s = p->full_path ? n->path : n->base;
+
+	switch (p->type) {
+		case PATTERN_GLOB:
+			return fnmatch(p->str, s, 0) == 0;
+		case PATTERN_REGEX:
+			return regexec(&p->re, s, 0, NULL, 0) == 0;
+		default:
+			return strcmp(p->str, s) == 0;
 	}
 }
 
-/* free node */
-static void free_tnode(TNODE *n) {
-	free(n);
+static int name_add_match(struct prg_name *n, struct prg_pattern *p) {
+	struct prg_pattern **m = realloc(n->match,
+			(n->nmatch + 1) * sizeof(struct prg_pattern *));
+	if (m == NULL) {
+		clog(LOG_ERR, "Unable to match %s (%s)\n", n->path, strerror(errno));
+		return -1;
+	}
+	m[n->nmatch++] = p;
+	n->match = m;
+	if (p->usage != NULL)
+		n->nusage++;
+	return 0;
 }
 
-/* free a full tree */
-static void free_tree(TREE *t) {
-	if (t != NULL) {
-		if (t->right != NULL) {
-			free_tree(t->right);
-			t->right = NULL;
+static void name_del_match(struct prg_name *n, const struct prg_pattern *p) {
+	unsigned int i = 0;
+	for (i = 0; i < n->nmatch; i++) {
+		if (n->match[i] == p) {
+			n->match[i] = n->match[--n->nmatch];
+			if (p->usage != NULL)
+				n->nusage--;
+			return;
 		}
-		if (t->left != NULL) {
-			free_tree(t->left);
-			t->left = NULL;
-		}
-		free_tnode(t);
 	}
 }
 
-static void insert_tnode(TREE **t, const char *c) {
-	int cmp = 0;
+static void name_free(struct prg_name *n) {
+	free(n->match);
+	free(n);
+}
 
-	if (*t == NULL) {
-		*t = new_tnode();
-		memcpy((*t)->name, c, PRG_LENGTH);
-		(*t)->used = 1;
-		clog(LOG_DEBUG, "new node (%s)\n", c);
-		return;
+/* returns the slot holding path or the empty slot where
+ * it should go, name_set must not be full
+ */
+static unsigned int name_set_slot(const char *path, unsigned int hash) {
+	unsigned int mask = name_set_size - 1;
+	unsigned int i = hash & mask;
+
+	while (name_set[i] != NULL) {
+		if (name_set[i]->hash == hash && strcmp(name_set[i]->path, path) == 0)
+			break;
+		i = (i + 1) & mask;
 	}
+	return i;
+}
 
-	/* insert node */
-	cmp = strncmp(c, (*t)->name, PRG_LENGTH);
-	if (cmp > 0) {
-		insert_tnode(&((*t)->right), c);
-		(*t)->right->parent = *t;
-		(*t)->right->height = (short unsigned)((*t)->height + 1);
-	} else if (cmp < 0) {
-		insert_tnode(&((*t)->left), c);
-		(*t)->left->parent = *t;
-		(*t)->left->height = (short unsigned)((*t)->height + 1);
-	} else {
-		(*t)->used++;
+/* keep the load factor below 3/4 */
+static int name_set_grow(void) {
+	struct prg_name **old = name_set;
+	unsigned int old_size = name_set_size, i = 0;
+	unsigned int size = name_set_size ? name_set_size * 2 : NAME_SET_MIN;
+
+	name_set = calloc(size, sizeof(struct prg_name *));
+	if (name_set == NULL) {
+		clog(LOG_ERR, "Unable to grow the program set (%s)\n", strerror(errno));
+		name_set = old;
+		return -1;
+	}
+	name_set_size = size;
+	for (i = 0; i < old_size; i++) {
+		if (old[i] != NULL)
+			name_set[name_set_slot(old[i]->path, old[i]->hash)] = old[i];
 	}
+	free(old);
+	return 0;
 }
-/* find the predecessor of the input node.
- * It must be the rightomost child in the left subtree.
- * NOT RECURSIVE
+
+/* removes n from the set shifting back the entries of
+ * its probe sequence, no tombstones are left around
  */
-static TNODE *predecessor(TNODE *n) {
-	TNODE *ret = n->left;
-	while (ret->right != NULL) {
-		ret = ret->right;
+static void name_set_remove(struct prg_name *n) {
+	unsigned int mask = name_set_size - 1;
+	unsigned int i = name_set_slot(n->path, n->hash), j = i, k = 0;
+
+	name_set[i] = NULL;
+	while (1) {
+		j = (j + 1) & mask;
+		if (name_set[j] == NULL)
+			break;
+		/* entries whose home slot lies cyclically in (i, j] stay */
+		k = name_set[j]->hash & mask;
+		if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+		name_set[i] = name_set[j];
+		name_set[j] = NULL;
+		i = j;
 	}
-	return ret;
+	name_set_count--;
+	clog(LOG_DEBUG, "Removed program (%s).\n", n->path);
+	name_free(n);
 }
 
-#if 0
-/* find the successor of the input node.
- * It must be the leftomost child in the right subtree
- * NOT RECURSIVE
+static void name_set_clear(void) {
+	unsigned int i = 0;
+	for (i = 0; i < name_set_size; i++) {
+		if (name_set[i] != NULL)
+			name_free(name_set[i]);
+	}
+	free(name_set);
+	name_set = NULL;
+	name_set_size = name_set_count = 0;
+}
+
+/* returns the interned program for path, creating it
+ * and resolving the patterns that match it if needed
  */
-static TNODE *successor(TNODE *n) {
-	TNODE *ret = n->right;
-	while (ret->left!=NULL) {
-		ret = ret->left;
+static struct prg_name *name_get(const char *path) {
+	unsigned int hash = name_hash(path), i = 0;
+	struct prg_name *n = NULL;
+	struct prg_pattern *p = NULL;
+	size_t len = strlen(path);
+
+	if (name_set_size != 0) {
+		i = name_set_slot(path, hash);
+		if (name_set[i] != NULL)
+			return name_set[i];
 	}
-	return ret;
+	if ((name_set_count + 1) * 4 > name_set_size * 3 && name_set_grow() != 0)
+		return NULL;
+
+	n = calloc(1, sizeof(struct prg_name) + len + 1);
+	if (n == NULL) {
+		clog(LOG_ERR, "Unable to add program %s (%s)\n", path, strerror(errno));
+		return NULL;
+	}
+	n->hash = hash;
+	memcpy(n->path, path, len + 1);
+	n->base = rindex(n->path, '/');
+	n->base = n->base != NULL ? n->base + 1 : n->path;
+
+	for (p = all_patterns; p != NULL; p = p->all_next) {
+		if (pattern_matches(p, n))
+			name_add_match(n, p);
+	}
+
+	name_set[name_set_slot(path, hash)] = n;
+	name_set_count++;
+	clog(LOG_DEBUG, "new program (%s)\n", path);
+	return n;
 }
-#endif
 
-/* removes an unused node from the tree
-*/
-static void sweep_unused_node(TNODE **n) {
-	TNODE *swap = NULL;
+/* accounts for delta instances of n more (or less) running,
+ * n goes away if none is left
+ */
+static void name_ref(struct prg_name *n, int delta) {
+	unsigned int i = 0;
 
-	if (*n != NULL && (*n)->used == 0) {
+	n->used = (unsigned int)((int)n->used + delta);
+	for (i = 0; i < n->nmatch; i++)
+		n->match[i]->count = (unsigned int)((int)n->match[i]->count + delta);
+	if (n->used == 0)
+		name_set_remove(n);
+}
 
-		/* 1- a node with no child */
-		if ((*n)->right == NULL && (*n)->left == NULL) {
-			if ((*n)->parent!=NULL) {
-				if ((*n)->parent->left == *n) (*n)->parent->left = NULL;
-				if ((*n)->parent->right == *n) (*n)->parent->right = NULL;
-			} else {
-				/* hey i'm removing the root elem */
-				running_programs = NULL;
-			}
-			clog(LOG_DEBUG, "Removed node (%s).\n", (*n)->name);
-			free_tnode(*n);
-			*n = NULL;
-		}
+/* makes p known to the running programs */
+static void pattern_register(struct prg_pattern *p) {
+	unsigned int i = 0;
 
-		/* 2- a node with one child */
-		else if ((*n)->right == NULL && (*n)->left != NULL) {
-			if ((*n)->parent != NULL) {
-				if ((*n)->parent->left == *n) {
-					(*n)->parent->left = (*n)->left;
-				}
-				else if ((*n)->parent->right == *n) {
-					(*n)->parent->right = (*n)->left;
-				}
-				(*n)->left->parent = (*n)->parent;
-			} else {
-				/* hey i'm removing the root elem */
-				running_programs = (*n)->left;
-			}
-			clog(LOG_DEBUG, "Removed node (%s).\n", (*n)->name);
-			free_tnode(*n);
-			*n = NULL;
-		}
-		else if ((*n)->left == NULL && (*n)->right != NULL) {
-			if ((*n)->parent != NULL) {
-				if ((*n)->parent->left == *n) {
-					(*n)->parent->left = (*n)->right;
-				}
-				else if ((*n)->parent->right == *n) {
-					(*n)->parent->right = (*n)->right;
-				}
-				(*n)->right->parent = (*n)->parent;
-			} else {
-				/* hey i'm removing the root elem */
-				running_programs = (*n)->right;
-			}
-			clog(LOG_DEBUG, "Removed node (%s).\n", (*n)->name);
-			free_tnode(*n);
-			*n = NULL;
+	p->all_next = all_patterns;
+	all_patterns = p;
+	p->count = 0;
+	for (i = 0; i < name_set_size; i++) {
+		if (name_set[i] != NULL && pattern_matches(p, name_set[i]) &&
+				name_add_match(name_set[i], p) == 0)
+			p->count += name_set[i]->used;
+	}
+}
+
+static void pattern_unregister(struct prg_pattern *p) {
+	struct prg_pattern **pp = &all_patterns;
+	unsigned int i = 0;
+
+	while (*pp != NULL && *pp != p)
+		pp = &(*pp)->all_next;
+	if (*pp != NULL)
+		*pp = p->all_next;
+	for (i = 0; i < name_set_size; i++) {
+		if (name_set[i] != NULL)
+			name_del_match(name_set[i], p);
+	}
+}
+
+static void pattern_free(struct prg_pattern *p) {
+	struct prg_pattern *next = NULL;
+
+	while (p != NULL) {
+		next = p->next;
+		if (p->type == PATTERN_REGEX)
+			regfree(&p->re);
+		free(p->str);
+		free(p);
+		p = next;
+	}
+}
+
+/* parses a single programs= entry */
+static struct prg_pattern *pattern_new(const char *str) {
+	struct prg_pattern *p = NULL;
+	char *count = NULL, *end = NULL;
+	char err[128];
+	int ret = 0;
+
+	p = calloc(1, sizeof(struct prg_pattern));
+	if (p == NULL || (p->str = strdup(str)) == NULL) {
+		clog(LOG_ERR, "Unable to allocate pattern %s (%s)\n", str, strerror(errno));
+		free(p);
+		return NULL;
+	}
+	p->min_count = 1;
+
+	/* instance count threshold */
+	if ((count = strstr(p->str, ">=")) != NULL) {
+		p->min_count = (unsigned int)strtoul(count + 2, &end, 10);
+		if (end == count + 2 || *end != '\0' || p->min_count == 0) {
+			clog(LOG_ERR, "Invalid count in %s\n", str);
+			pattern_free(p);
+			return NULL;
 		}
+		*count = '\0';
+	}
+	if (p->str[0] == '\0') {
+		clog(LOG_ERR, "Empty program name in %s\n", str);
+		pattern_free(p);
+		return NULL;
+	}
 
-		/* 3- a node with 2 children */
-		else {
-			/* this actually unbalances the tree */
-			swap = predecessor(*n);
-			/* consider predecessor subtree (can't have right childs) */
-			if (swap->parent->left == swap) {
-				swap->parent->left = swap->left;
-			} else {
-				swap->parent->right = swap->left;
-			}
-			if (swap->left != NULL)
-				swap->left->parent = swap->parent;
-
-			clog(LOG_DEBUG, "Removed node (%s).\n", (*n)->name);
-			/* copy node data */
-			strncpy((*n)->name, swap->name, PRG_LENGTH);
-			(*n)->used = swap->used;
-			free_tnode(swap);
-			*n = NULL;
+	if (p->str[0] == '~') {
+		if ((ret = regcomp(&p->re, p->str + 1, REG_EXTENDED | REG_NOSUB)) != 0) {
+			regerror(ret, &p->re, err, sizeof(err));
+			clog(LOG_ERR, "Invalid regular expression %s (%s)\n",
+					p->str + 1, err);
+			free(p->str);
+			free(p);
+			return NULL;
 		}
+		p->type = PATTERN_REGEX;
+	} else if (strpbrk(p->str, "*?[") != NULL) {
+		p->type = PATTERN_GLOB;
+	} else {
+		p->type = PATTERN_EXACT;
 	}
+	p->full_path = index(p->str, '/') != NULL;
+	return p;
+}
+
+static unsigned int pid_hash(pid_t pid) {
+	return (unsigned int)pid % PID_HASH_SIZE;
+}
+
+static struct pid_entry *pid_table_lookup(pid_t pid) {
+	struct pid_entry *e = pid_table[pid_hash(pid)];
+	while (e != NULL && e->pid != pid)
+		e = e->next;
+	return e;
+}
+
+static void seen_unlink(struct pid_entry *e) {
+	e->seen_prev->seen_next = e->seen_next;
+	e->seen_next->seen_prev = e->seen_prev;
+}
+
+static void seen_append(struct pid_entry *e) {
+	e->seen_prev = seen_list.seen_prev;
+	e->seen_next = &seen_list;
+	seen_list.seen_prev->seen_next = e;
+	seen_list.seen_prev = e;
 }
 
-/* preorder visit
+/* reads utime + stime of e from /proc/<pid>/stat, the file
+ * stays open while the pid is watched if possible
  */
-static void preorder_visit(TREE *t, void (*cb)(TNODE **n)) {
-	if (t != NULL && t->left != NULL) {
-		preorder_visit(t->left, cb);
+static int read_cpu_ticks(struct pid_entry *e, unsigned long long *ticks) {
+	char buf[512];
+	char *c = NULL, *end = NULL;
+	unsigned long long utime = 0, stime = 0;
+	ssize_t len = 0;
+	int fd = e->stat_fd, i = 0;
+
+	if (fd < 0) {
+		snprintf(buf, sizeof(buf), "/proc/%d/stat", e->pid);
+		if ((fd = open(buf, O_RDONLY | O_CLOEXEC)) < 0)
+			return -1;
 	}
-	if (t != NULL) {
-		cb(&t);
+	len = pread(fd, buf, sizeof(buf) - 1, 0);
+	if (fd != e->stat_fd)
+		close(fd);
+	if (len <= 0)
+		return -1;
+	buf[len] = '\0';
+
+	/* the command name may contain anything, skip past it
+	 * and the 11 fields before utime
+	 */
+	if ((c = rindex(buf, ')')) == NULL)
+		return -1;
+	for (i = 0; i < 12; i++) {
+		if ((c = index(c + 1, ' ')) == NULL)
+			return -1;
 	}
-	if (t != NULL && t->right != NULL) {
-		preorder_visit(t->right, cb);
+	utime = strtoull(c + 1, &end, 10);
+	if (*end != ' ')
+		return -1;
+	stime = strtoull(end + 1, &end, 10);
+	if (*end != ' ')
+		return -1;
+
+	*ticks = utime + stime;
+	return 0;
+}
+
+/* starts or stops accounting for the cpu time of e depending
+ * on its program being matched by a program_usage= directive
+ */
+static void usage_check(struct pid_entry *e) {
+	char file[32];
+	int watch = e->prg != NULL && e->prg->nusage > 0;
+
+	if (watch && e->usage_next == NULL) {
+		e->usage_prev = usage_list.usage_prev;
+		e->usage_next = &usage_list;
+		usage_list.usage_prev->usage_next = e;
+		usage_list.usage_prev = e;
+		/* failures (EMFILE) are fine, the file is opened at each read */
+		snprintf(file, sizeof(file), "/proc/%d/stat", e->pid);
+		e->stat_fd = open(file, O_RDONLY | O_CLOEXEC);
+		if (read_cpu_ticks(e, &e->cpu_ticks) != 0)
+			e->cpu_ticks = 0;
+
+	} else if (!watch && e->usage_next != NULL) {
+		e->usage_prev->usage_next = e->usage_next;
+		e->usage_next->usage_prev = e->usage_prev;
+		e->usage_prev = e->usage_next = NULL;
+		if (e->stat_fd >= 0)
+			close(e->stat_fd);
+		e->stat_fd = -1;
 	}
 }
 
-/* find a node */
-static TNODE * find_tnode(TREE *t, const char *c) {
-	int cmp = 0;
-	if (c != NULL && t != NULL) {
-		cmp = strncmp(t->name, c, PRG_LENGTH);
-		if (cmp > 0) {
-			return find_tnode(t->left, c);
-		} else if (cmp < 0) {
-			return find_tnode(t->right, c);
-		} else if (t->used > 0) {
-			return t;
+/* patterns of a program_usage= directive came or went */
+static void usage_rebuild(void) {
+	struct pid_entry *e = NULL;
+	for (e = seen_list.seen_next; e != &seen_list; e = e->seen_next)
+		usage_check(e);
+}
+
+/* sums up the cpu time of the watched pids for each
+ * program_usage= directive, a pid is accounted for once per
+ * directive even if more of its patterns match.
+ */
+static void usage_update(void) {
+	static struct timespec last;
+	static unsigned int stamp;
+	static long hz;
+	struct timespec now;
+	struct pid_entry *e = NULL;
+	struct prg_usage *u = NULL;
+	unsigned long long ticks = 0, delta = 0;
+	double elapsed = 0.0;
+	unsigned int i = 0;
+
+	if (all_usage == NULL)
+		return;
+	if (hz <= 0 && (hz = sysconf(_SC_CLK_TCK)) <= 0)
+		hz = 100;
+
+	for (u = all_usage; u != NULL; u = u->next)
+		u->ticks = 0;
+
+	for (e = usage_list.usage_next; e != &usage_list; e = e->usage_next) {
+		if (read_cpu_ticks(e, &ticks) != 0)
+			continue;
+		delta = ticks > e->cpu_ticks ? ticks - e->cpu_ticks : 0;
+		e->cpu_ticks = ticks;
+		stamp++;
+		for (i = 0; i < e->prg->nmatch; i++) {
+			u = e->prg->match[i]->usage;
+			if (u != NULL && u->stamp != stamp) {
+				u->stamp = stamp;
+				u->ticks += delta;
+			}
 		}
 	}
-	return NULL;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (last.tv_sec != 0 || last.tv_nsec != 0)
+		elapsed = (double)(now.tv_sec - last.tv_sec) +
+			(double)(now.tv_nsec - last.tv_nsec) / 1000000000.0;
+	last = now;
+
+	for (u = all_usage; u != NULL; u = u->next) {
+		u->usage = elapsed > 0.0 ?
+			(int)((double)u->ticks * 100.0 / (elapsed * (double)hz)) : 0;
+		clog(LOG_DEBUG, "%s: %d%%\n", u->patterns->str, u->usage);
+	}
+}
+
+/* removes a pid from the map and releases its program */
+static void untrack_process(pid_t pid) {
+	struct pid_entry **e = &pid_table[pid_hash(pid)];
+	struct pid_entry *found = NULL;
+
+	while (*e != NULL && (*e)->pid != pid)
+		e = &(*e)->next;
+	if (*e == NULL)
+		return;
+
+	found = *e;
+	*e = found->next;
+	seen_unlink(found);
+	if (found->prg != NULL)
+		name_ref(found->prg, -1);
+	found->prg = NULL;
+	usage_check(found);
+	free(found);
 }
 
-#ifdef DEBUG_TREE
-static void debug_tnode(TNODE *n) {
-	if (n != NULL) {
-		clog(LOG_DEBUG, "DEBUG_TREE %s [u:%d] [h:%d]\n", n->name, n->used, n->height);
+/* records pid as running program path, replacing any previous
+ * program (the process exec'ed something else). An empty path
+ * is recorded as no program.
+ *
+ * Returns the pid entry or NULL on allocation failures.
+ */
+static struct pid_entry *track_process(pid_t pid, const char *path) {
+	struct pid_entry *e = pid_table_lookup(pid);
+	struct prg_name *prg = NULL;
+
+	if (e == NULL) {
+		e = calloc(1, sizeof(struct pid_entry));
+		if (e == NULL) {
+			clog(LOG_ERR, "Unable to track pid %d (%s)\n", pid,
+					strerror(errno));
+			return NULL;
+		}
+		e->pid = pid;
+		e->gen = scan_gen;
+		e->stat_fd = -1;
+		e->next = pid_table[pid_hash(pid)];
+		pid_table[pid_hash(pid)] = e;
+		seen_append(e);
 	}
+
+	/* on failures the pid is tracked with no program */
+	if (*path != '\0')
+		prg = name_get(path);
+	if (e->prg == prg)
+		return e;
+	if (prg != NULL)
+		name_ref(prg, 1);
+	if (e->prg != NULL)
+		name_ref(e->prg, -1);
+	e->prg = prg;
+	usage_check(e);
+	return e;
 }
 
-static void print_tree(TNODE *n) {
-	char tab[64];
-	unsigned int i=0;
-	if (n != NULL) {
-		for(i = 0; i < n->height && i < 63; i++) {
-			tab[i]=' ';
+static void pid_table_clear(void) {
+	unsigned int i = 0;
+	struct pid_entry *e = NULL;
+
+	for (i = 0; i < PID_HASH_SIZE; i++) {
+		while ((e = pid_table[i]) != NULL) {
+			pid_table[i] = e->next;
+			if (e->stat_fd >= 0)
+				close(e->stat_fd);
+			free(e);
 		}
-		tab[i] = '\\';
-		tab[i+1] = '\0';
-		clog(LOG_DEBUG, "DEBUG_TREE %s%s \t%s - [h:%d]\n",
-				tab, n->name, n->parent!=NULL?n->parent->name:"nobody", n->height);
 	}
+	seen_list.seen_prev = seen_list.seen_next = &seen_list;
+	usage_list.usage_prev = usage_list.usage_next = &usage_list;
 }
-#endif
 
-/* int numeric_entry(const struct dirent *d)
- *
- * Select function for scandir()
+/* parses a /proc entry name, returns 0 if it is not a pid */
+static pid_t parse_pid(const char *s) {
+	pid_t pid = 0;
+
+	if (*s == '\0')
+		return 0;
+	while (*s >= '0' && *s <= '9')
+		pid = pid * 10 + (*s++ - '0');
+	return *s == '\0' ? pid : 0;
+}
+
+/* reads /proc/<pid>/cmdline and stores the program path
+ * into program (CMD_LENGTH long). Kernel threads and zombies
+ * have an empty cmdline and give an empty path.
  *
+ * Returns a pointer to the path or NULL if the process
+ * disappeared meanwhile.
  */
-static int numeric_entry(const struct dirent *d) {
-	if (isdigit(d->d_name[0])) {
+static char *read_program_name(pid_t pid, char *program) {
+	char file[32];
+	char *prg_path;
+	ssize_t len = 0;
+	int fd = -1;
+
+	snprintf(file, sizeof(file), "/proc/%d/cmdline", pid);
+
+	if ((fd = open(file, O_RDONLY | O_CLOEXEC)) < 0) {
+#if 0
+		clog(LOG_DEBUG, "%s: %s\n", file, strerror(errno));
+#endif
+		return NULL; /* disappeared process?? */
+	}
+	len = read(fd, program, CMD_LENGTH - 1);
+	close(fd);
+	if (len < 0) {
+#if 0
+		clog(LOG_DEBUG, "%s: %s\n", file, strerror(errno));
+#endif
+		return NULL;
+	}
+
+	/* terminate the string, arguments are NUL separated */
+	program[len] = '\0';
 #if 0
-		clog(LOG_DEBUG, "directory: %s\n", d->d_name);
+	clog(LOG_DEBUG, "read program (%d: %s)\n", pid, program);
 #endif
-		return 1;
+	/* strip stuff after a blank space */
+	prg_path = index(program, ' ');
+	if (prg_path != NULL)
+		*prg_path = '\0';
+
+	/* login shells */
+	prg_path = program;
+	if (*prg_path == '-')
+		prg_path++;
+
+	return prg_path;
+}
+
+/* opens /proc or goes back to its first entry */
+static int proc_rewind(void) {
+	if (proc_fd < 0) {
+		proc_fd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (proc_fd < 0) {
+			clog(LOG_ERR, "/proc: %s\n", strerror(errno));
+			return -1;
+		}
+	} else if (lseek(proc_fd, 0, SEEK_SET) < 0) {
+		clog(LOG_ERR, "/proc: %s\n", strerror(errno));
+		return -1;
 	}
 	return 0;
 }
 
-/* int get_running_programs(void)
+/* int scan_processes(int reread)
  *
- * looks for running programs and fills the
- * global struct running_programs.
+ * looks for running programs in /proc and updates the pid
+ * cache and the running program set. Only pids not
+ * seen before (or reused) have their cmdline read unless reread
+ * is set, pids not found anymore are dropped.
  *
- * Returns the length of the newly created list.
+ * Returns the number of processes read.
  */
-static int programs_update(void) {
-
-	struct dirent **namelist;
-	int n = 0, ret = 0, pid = 0;
-	char file[PRG_LENGTH];
-	char program[PRG_LENGTH];
-	char *prg_basename;
-	FILE *fp;
+static int scan_processes(int reread) {
+	struct linux_dirent64 *d = NULL;
+	struct pid_entry *e = NULL;
+	char program[CMD_LENGTH];
+	char *prg_path = NULL;
+	long n = 0, off = 0;
+	pid_t pid = 0;
+	int ret = 0, added = 0, gone = 0, confirm = 0;
 
-	/* reset all nodes  */
-	preorder_visit(running_programs, &neglect_node);
+	if (proc_rewind() != 0)
+		return 0;
 
-	n = scandir("/proc", &namelist, numeric_entry, NULL);
-#if 0
-	clog(LOG_DEBUG, "directories: %d\n", n);
-#endif
+	scan_gen++;
+	while ((n = syscall(SYS_getdents64, proc_fd, dents_buf, DENTS_BUF_SIZE)) > 0) {
+		for (off = 0; off < n; off += d->d_reclen) {
+			d = (struct linux_dirent64 *)(dents_buf + off);
+			if ((pid = parse_pid(d->d_name)) == 0)
+				continue;
 
+			e = pid_table_lookup(pid);
+			if (reread || e == NULL || e->ino != (ino_t)d->d_ino || !e->confirmed) {
+				confirm = (e != NULL && e->ino == (ino_t)d->d_ino);
+				prg_path = read_program_name(pid, program);
+				if (prg_path == NULL)
+					continue;
+				if (!confirm)
+					added++;
+				/* the pid was reused, don't inherit the old name */
+				if (e != NULL && !confirm)
+					untrack_process(pid);
+				if ((e = track_process(pid, prg_path)) == NULL)
+					continue;
+				e->ino = (ino_t)d->d_ino;
+				e->confirmed = confirm;
+			}
+			e->gen = scan_gen;
+			seen_unlink(e);
+			seen_append(e);
+			ret++;
+		}
+	}
 	if (n < 0) {
-		clog(LOG_ERR, "scandir: %s\n", strerror(errno));
+		/* don't drop anything on a partial read */
+		clog(LOG_ERR, "getdents64(/proc): %s\n", strerror(errno));
+		return ret;
+	}
+
+	/* whatever was not seen by this scan is at the head */
+	while (seen_list.seen_next != &seen_list && seen_list.seen_next->gen != scan_gen) {
+		untrack_process(seen_list.seen_next->pid);
+		gone++;
+	}
+
+	clog(LOG_INFO, "read %d processes (%d new, %d gone)\n", ret, added, gone);
+	return ret;
+}
 
+#ifdef PROC_CONNECTOR
+/* subscribe or unsubscribe (op) to process events */
+static int proc_connector_control(enum proc_cn_mcast_op op) {
+	char buf[NLMSG_SPACE(sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op))];
+	struct nlmsghdr *nlh = (struct nlmsghdr *)buf;
+	struct cn_msg *msg = NULL;
+
+	memset(buf, 0, sizeof(buf));
+	nlh->nlmsg_len = NLMSG_LENGTH(sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op));
+	nlh->nlmsg_type = NLMSG_DONE;
+	nlh->nlmsg_pid = (__u32)getpid();
+
+	msg = (struct cn_msg *)NLMSG_DATA(nlh);
+	msg->id.idx = CN_IDX_PROC;
+	msg->id.val = CN_VAL_PROC;
+	msg->len = sizeof(enum proc_cn_mcast_op);
+	memcpy(msg->data, &op, sizeof(enum proc_cn_mcast_op));
+
+	if (send(cn_sock, nlh, nlh->nlmsg_len, 0) < 0) {
+		clog(LOG_NOTICE, "Couldn't send to the proc connector (%s).\n",
+				strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+static void proc_connector_close(void) {
+	if (cn_sock < 0)
+		return;
+	proc_connector_control(PROC_CN_MCAST_IGNORE);
+	close(cn_sock);
+	cn_sock = -1;
+}
+
+static int proc_connector_open(void) {
+	struct sockaddr_nl addr;
+	int rcvbuf = CN_RCVBUF_SIZE;
+
+	cn_sock = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+	if (cn_sock < 0) {
+		clog(LOG_NOTICE, "Couldn't open the proc connector (%s).\n",
+				strerror(errno));
+		return -1;
+	}
+	/* try to survive fork bombs without overruns, not fatal */
+	setsockopt(cn_sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = CN_IDX_PROC;
+	addr.nl_pid = 0;
+	if (bind(cn_sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		clog(LOG_NOTICE, "Couldn't bind the proc connector (%s).\n",
+				strerror(errno));
+		close(cn_sock);
+		cn_sock = -1;
+		return -1;
+	}
+
+	if (proc_connector_control(PROC_CN_MCAST_LISTEN) != 0) {
+		close(cn_sock);
+		cn_sock = -1;
+		return -1;
+	}
+	return 0;
+}
+
+/* remembers pid had an event while rescanning, with programs_mtx held */
+static void touch_pid(pid_t pid) {
+	pid_t *t = NULL;
+	unsigned int size = 0;
+
+	if (!cn_rescanning)
+		return;
+	if (cn_touched_count == cn_touched_size) {
+		size = cn_touched_size ? cn_touched_size * 2 : 256;
+		if ((t = realloc(cn_touched, size * sizeof(pid_t))) == NULL) {
+			/* can't tell, do it again */
+			cn_resync = 1;
+			return;
+		}
+		cn_touched = t;
+		cn_touched_size = size;
+	}
+	cn_touched[cn_touched_count++] = pid;
+}
+
+static int pid_cmp(const void *a, const void *b) {
+	return *(const pid_t *)a - *(const pid_t *)b;
+}
+
+static int touched(pid_t pid) {
+	return bsearch(&pid, cn_touched, cn_touched_count, sizeof(pid_t),
+			&pid_cmp) != NULL;
+}
+
+/* a /proc entry read by rescan_processes */
+struct proc_snap {
+	pid_t pid;
+	ino_t ino;
+	char *path;
+};
+
+/* tells if the process read in a snapshot is still the one behind its pid */
+static int still_running(const struct proc_snap *p) {
+	char name[16];
+	struct stat st;
+
+	snprintf(name, sizeof(name), "%d", p->pid);
+	return fstatat(proc_fd, name, &st, 0) == 0 && st.st_ino == p->ino;
+}
+
+/* int rescan_processes(void)
+ *
+ * re-reads every pid after proc connector events were lost. /proc is
+ * walked without programs_mtx so that the connector thread keeps
+ * draining its socket, the lock is only taken to merge the snapshot
+ * into the pid map. Pids the thread had events for meanwhile are left
+ * as the thread recorded them, unless it couldn't track them (a fork
+ * whose parent was not known yet), then the snapshot is used if the
+ * process is still there.
+ *
+ * Returns the number of processes read.
+ */
+static int rescan_processes(void) {
+	struct linux_dirent64 *d = NULL;
+	struct pid_entry *e = NULL;
+	struct proc_snap *snap = NULL, *tmp = NULL;
+	char program[CMD_LENGTH];
+	char *prg_path = NULL;
+	unsigned int count = 0, size = 0, i = 0;
+	long n = 0, off = 0;
+	pid_t pid = 0;
+	int failed = 0, gone = 0;
+
+	programs_lock();
+	cn_resync = 0;
+	cn_rescanning = 1;
+	cn_touched_count = 0;
+	programs_unlock();
+
+	failed = proc_rewind() != 0;
+	while (!failed && (n = syscall(SYS_getdents64, proc_fd, dents_buf, DENTS_BUF_SIZE)) > 0) {
+		for (off = 0; off < n && !failed; off += d->d_reclen) {
+			d = (struct linux_dirent64 *)(dents_buf + off);
+			if ((pid = parse_pid(d->d_name)) == 0)
+				continue;
+			if ((prg_path = read_program_name(pid, program)) == NULL)
+				continue;
+			if (count == size) {
+				size = size ? size * 2 : 1024;
+				if ((tmp = realloc(snap, size * sizeof(struct proc_snap))) == NULL) {
+					failed = 1;
+					break;
+				}
+				snap = tmp;
+			}
+			if ((snap[count].path = strdup(prg_path)) == NULL) {
+				failed = 1;
+				break;
+			}
+			snap[count].pid = pid;
+			snap[count].ino = (ino_t)d->d_ino;
+			count++;
+		}
+	}
+	if (n < 0 || failed) {
+		/* don't drop anything on a partial read */
+		clog(LOG_ERR, "Unable to rescan /proc (%s)\n", strerror(errno));
+		failed = 1;
+	}
+
+	programs_lock();
+	cn_rescanning = 0;
+	if (failed) {
+		cn_resync = 1;
 	} else {
+		qsort(cn_touched, cn_touched_count, sizeof(pid_t), &pid_cmp);
+		scan_gen++;
+		for (i = 0; i < count; i++) {
+			e = pid_table_lookup(snap[i].pid);
+			if (touched(snap[i].pid) && (e != NULL || !still_running(&snap[i])))
+				continue;
+			/* the pid was reused, don't inherit the old name */
+			if (e != NULL && e->ino != snap[i].ino)
+				untrack_process(snap[i].pid);
+			if ((e = track_process(snap[i].pid, snap[i].path)) == NULL)
+				continue;
+			e->confirmed = e->ino == snap[i].ino;
+			e->ino = snap[i].ino;
+			e->gen = scan_gen;
+			seen_unlink(e);
+			seen_append(e);
+		}
+		/* whatever was not seen is at the head, unless the thread
+		 * just added it
+		 */
+		while (seen_list.seen_next != &seen_list && seen_list.seen_next->gen != scan_gen) {
+			e = seen_list.seen_next;
+			if (touched(e->pid)) {
+				e->gen = scan_gen;
+				seen_unlink(e);
+				seen_append(e);
+				continue;
+			}
+			untrack_process(e->pid);
+			gone++;
+		}
+	}
+	cn_touched_count = 0;
+	programs_unlock();
 
-		while(n--) {
-			snprintf(file, PRG_LENGTH - 1, "/proc/%s/cmdline", namelist[n]->d_name);
-#if 0
-			clog(LOG_DEBUG, "directory (%3d: %s)\n", n, file);
-#endif
-			pid = atoi(namelist[n]->d_name);
-			free(namelist[n]);
+	for (i = 0; i < count; i++)
+		free(snap[i].path);
+	free(snap);
+	if (!failed)
+		clog(LOG_INFO, "read %u processes (%d gone)\n", count, gone);
+	return (int)count;
+}
 
-			if (!(fp = fopen(file, "r"))) {
-#if 0
-				clog(LOG_DEBUG, "%s: %s\n", file, strerror(errno));
-#endif
-				continue; /* disappeared process?? */
+/* apply a single process event to the pid map,
+ * must be called with programs_mtx held.
+ *
+ * Returns 1 if a watched program has just been started.
+ */
+static int handle_proc_event(const struct proc_event *ev, const char *exec_name) {
+	struct pid_entry *parent = NULL, *e = NULL;
+
+	switch (ev->what) {
+		case PROC_EVENT_FORK:
+			/* a new process (not thread) inherits its parent's name */
+			if (ev->event_data.fork.child_pid != ev->event_data.fork.child_tgid)
+				break;
+			touch_pid(ev->event_data.fork.child_tgid);
+			parent = pid_table_lookup(ev->event_data.fork.parent_tgid);
+			if (parent != NULL) {
+				untrack_process(ev->event_data.fork.child_tgid);
+				track_process(ev->event_data.fork.child_tgid,
+						parent->prg != NULL ? parent->prg->path : "");
+			}
+			break;
+		case PROC_EVENT_EXEC:
+			touch_pid(ev->event_data.exec.process_tgid);
+			if (exec_name == NULL) {
+				untrack_process(ev->event_data.exec.process_tgid);
+				break;
+			}
+			e = track_process(ev->event_data.exec.process_tgid, exec_name);
+			if (e != NULL && e->prg != NULL && e->prg->nmatch > 0) {
+				clog(LOG_INFO, "watched program %s started (pid %d)\n",
+						exec_name, ev->event_data.exec.process_tgid);
+				return 1;
 			}
+			break;
+		case PROC_EVENT_EXIT:
+			if (ev->event_data.exit.process_pid == ev->event_data.exit.process_tgid) {
+				touch_pid(ev->event_data.exit.process_tgid);
+				untrack_process(ev->event_data.exit.process_tgid);
+			}
+			break;
+		default:
+			break;
+	}
+	return 0;
+}
 
-			if (!fgets(program, PRG_LENGTH - 1, fp)) {
-#if 0
-				clog(LOG_DEBUG, "%s: %s\n", file, strerror(errno));
-#endif
-				fclose(fp);
+/*  Waits for process events on the proc connector socket and keeps
+ *  the pid map up to date. cpufreqd is woken as soon as a watched
+ *  program starts. On overruns a full /proc rescan is requested.
+ */
+static void *proc_connector_wait (void __UNUSED__ *arg) {
+	char buf[4096] __attribute__ ((aligned(NLMSG_ALIGNTO)));
+	char program[CMD_LENGTH];
+	const char *exec_name = NULL;
+	struct nlmsghdr *nlh = NULL;
+	struct cn_msg *msg = NULL;
+	struct proc_event ev;
+	unsigned int left = 0;
+	int len = 0, wake = 0, err = 0;
+
+	clog(LOG_DEBUG, "proc connector thread running.\n");
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+	while (1) {
+		/* recv is the only place where we can be cancelled */
+		pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+		len = (int)recv(cn_sock, buf, sizeof(buf), 0);
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+		if (len < 0) {
+			err = errno;
+			if (err == EINTR)
 				continue;
+			programs_lock();
+			cn_resync = 1;
+			if (err != ENOBUFS) {
+				clog(LOG_ERR, "Error reading the proc connector (%s), "
+						"falling back to /proc scanning.\n",
+						strerror(err));
+				cn_active = 0;
+			} else {
+				clog(LOG_NOTICE, "proc connector overrun, rescanning.\n");
 			}
-			fclose(fp);
+			programs_unlock();
+			wake_cpufreqd();
+			if (err != ENOBUFS)
+				break;
+			continue;
+		}
 
-			/* terminate the string */
-			program[PRG_LENGTH - 1] = '\0';
-#if 0
-			clog(LOG_DEBUG, "read program (%3d %5d: %s)\n", n, pid, program);
+		wake = 0;
+		left = (unsigned int)len;
+		for (nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, left);
+				nlh = NLMSG_NEXT(nlh, left)) {
+
+			if (nlh->nlmsg_type == NLMSG_NOOP)
+				continue;
+			if (nlh->nlmsg_type == NLMSG_ERROR || nlh->nlmsg_type == NLMSG_OVERRUN) {
+				programs_lock();
+				cn_resync = 1;
+				programs_unlock();
+				wake = 1;
+				continue;
+			}
+
+			msg = (struct cn_msg *)NLMSG_DATA(nlh);
+			if (msg->id.idx != CN_IDX_PROC || msg->id.val != CN_VAL_PROC)
+				continue;
+			/* the event is only 4 bytes aligned in the message */
+			memset(&ev, 0, sizeof(ev));
+			memcpy(&ev, msg->data, sizeof(ev) < msg->len ? sizeof(ev) : msg->len);
+
+			/* read the new name outside the lock, threads exec'ing
+			 * are reported with the thread group id anyway
+			 */
+			exec_name = NULL;
+			if (ev.what == PROC_EVENT_EXEC)
+				exec_name = read_program_name(ev.event_data.exec.process_tgid,
+						program);
+
+			programs_lock();
+			wake |= handle_proc_event(&ev, exec_name);
+			programs_unlock();
+		}
+
+		/* Ring the bell!! */
+		if (wake)
+			wake_cpufreqd();
+	}
+	return NULL;
+}
+
+/* open the proc connector and launch the listening thread */
+static int proc_connector_init(void) {
+	int ret = 0;
+
+	if (proc_connector_open() != 0)
+		return -1;
+
+	/* the first update will populate the pid map */
+	cn_resync = 1;
+	cn_active = 1;
+	if ((ret = pthread_create(&cn_thread, NULL, &proc_connector_wait, NULL)) != 0) {
+		clog(LOG_ERR, "Unable to launch thread: %s\n", strerror(ret));
+		cn_active = 0;
+		proc_connector_close();
+		return -1;
+	}
+	clog(LOG_INFO, "using the proc connector to track processes.\n");
+	return 0;
+}
+
+static void proc_connector_exit(void) {
+	int ret = 0;
+
+	if (cn_thread) {
+		clog(LOG_DEBUG, "killing proc connector thread.\n");
+		ret = pthread_cancel(cn_thread);
+		if (ret != 0)
+			clog(LOG_ERR, "Couldn't cancel proc connector thread (%s).\n",
+					strerror(ret));
+		ret = pthread_join(cn_thread, NULL);
+		if (ret != 0)
+			clog(LOG_ERR, "Couldn't join proc connector thread (%s).\n",
+					strerror(ret));
+		cn_thread = 0;
+	}
+	cn_active = 0;
+	proc_connector_close();
+	free(cn_touched);
+	cn_touched = NULL;
+	cn_touched_count = cn_touched_size = 0;
+}
 #endif
-			/* strip stuff after a blank space */
-			prg_basename = index(program, ' ');
-			if (prg_basename != NULL)
-				*prg_basename = '\0';
-
-			/* find basename */
-			prg_basename = rindex(program, '/');
-			if (prg_basename == NULL)
-				prg_basename = program;
-			else
-				prg_basename++;
-			if (*prg_basename == '-')
-				prg_basename++;
-
-			insert_tnode(&running_programs, prg_basename);
-			ret++;
+
+/* int programs_update(void)
+ *
+ * updates the running program set, either from the proc
+ * connector pid map or by an incremental /proc scan.
+ *
+ * Returns the number of processes read.
+ */
+static int programs_update(void) {
+	int ret = 0;
+
+#ifdef PROC_CONNECTOR
+	int active = 0, resync = 0;
+
+	programs_lock();
+	active = cn_active;
+	resync = cn_resync;
+	programs_unlock();
+	if (active || resync) {
+		if (!active) {
+			/* the thread gave up, back to /proc scanning */
+			proc_connector_exit();
+			cn_resync = 0;
+			ret = scan_processes(1);
+		} else if (resync) {
+			/* re-read every pid if events were lost */
+			ret = rescan_processes();
 		}
+		programs_lock();
+		usage_update();
+		programs_unlock();
+		return ret;
 	}
-	free(namelist);
-	clog(LOG_INFO, "read %d processes\n", ret);
-	preorder_visit(running_programs, &sweep_unused_node);
-#ifdef DEBUG_TREE
-	preorder_visit(running_programs, &debug_tnode);
-	preorder_visit(running_programs, &print_tree);
 #endif
+
+	ret = scan_processes(0);
+	usage_update();
+	clog(LOG_DEBUG, "%u programs running\n", name_set_count);
 	return ret;
 }
 
+static int programs_conf(const char *key, const char *value) {
+
+	if (strncmp(key, "proc_connector", 14) == 0 && value != NULL) {
+		use_proc_connector = atoi(value);
+		clog(LOG_DEBUG, "proc_connector is %s.\n",
+				use_proc_connector ? "enabled" : "disabled");
+		return 0;
+	}
+	return -1;
+}
+
+static int programs_post_conf(void) {
+#ifdef PROC_CONNECTOR
+	if (use_proc_connector && proc_connector_init() != 0)
+		clog(LOG_NOTICE, "proc connector unavailable, scanning /proc.\n");
+#else
+	if (use_proc_connector)
+		clog(LOG_INFO, "proc connector support not compiled in.\n");
+#endif
+	return 0;
+}
+
 static int programs_exit(void) {
 	clog(LOG_INFO, "called\n");
-	free_tree(running_programs);
+#ifdef PROC_CONNECTOR
+	proc_connector_exit();
+#endif
+	pid_table_clear();
+	name_set_clear();
+	if (proc_fd >= 0) {
+		close(proc_fd);
+		proc_fd = -1;
+	}
 	return 0;
 }
 
+/* parses a comma separated list of patterns */
+static struct prg_pattern *parse_patterns(const char *ev) {
+	char *str_copy = NULL;
+	char *t_prog = NULL;
+	struct prg_pattern *ret = NULL, *p = NULL, **tail = &ret;
+
+	if ((str_copy = strdup(ev)) == NULL) {
+		clog(LOG_ERR, "Unable to parse %s (%s)\n", ev, strerror(errno));
+		return NULL;
+	}
+
+	for (t_prog = strtok(str_copy, ","); t_prog != NULL; t_prog = strtok(NULL, ",")) {
+		if ((p = pattern_new(t_prog)) == NULL) {
+			pattern_free(ret);
+			free(str_copy);
+			return NULL;
+		}
+		*tail = p;
+		tail = &p->next;
+		clog(LOG_DEBUG, "read program %s (min %u)\n", p->str, p->min_count);
+	}
+	free(str_copy);
+	return ret;
+}
+
+/* programs=a,b,c
+ * every entry is a pattern as described for struct prg_pattern,
+ * the directive matches if any of them does.
+ */
 static int programs_parse(const char *ev, void **obj) {
-	char str_copy[5*PRG_LENGTH];
-	char *t_prog;
-	TREE *ret=NULL;
+	struct prg_pattern *ret = NULL, *p = NULL;
 
 	clog(LOG_DEBUG, "called with entries %s.\n", ev);
-	strncpy(str_copy, ev, 5*PRG_LENGTH);
+	if ((ret = parse_patterns(ev)) == NULL)
+		return -1;
 
-	t_prog = strtok(str_copy,",");
-	do {
-		if (t_prog == NULL)
-			continue;
-
-		insert_tnode(&ret, t_prog);
-		clog(LOG_DEBUG, "read program %s\n", t_prog);
-	} while ((t_prog = strtok(NULL,",")) != NULL);
+	programs_lock();
+	for (p = ret; p != NULL; p = p->next)
+		pattern_register(p);
+	programs_unlock();
 
 	*obj = ret;
 	return 0;
 }
 
 static void programs_free(void *obj) {
-	free_tree(obj);
-}
+	struct prg_pattern *p = NULL;
 
-static int find_program(const TNODE *l) {
-	clog(LOG_DEBUG, "tree ptr %p\n", l);
-	return (find_tnode(running_programs, l->name) != NULL) ? MATCH :
-		(l->right != NULL && find_program(l->right) == MATCH) ? MATCH :
-		(l->left != NULL && find_program(l->left) == MATCH) ? MATCH : DONT_MATCH;
+	programs_lock();
+	for (p = obj; p != NULL; p = p->next)
+		pattern_unregister(p);
+	programs_unlock();
+	pattern_free(obj);
 }
 
 static int programs_evaluate(const void *s) {
-	clog(LOG_DEBUG, "tree ptr %p\n", s);
-	return find_program((const TNODE *) s);
+	const struct prg_pattern *p = NULL;
+	int ret = DONT_MATCH;
+
+	programs_lock();
+	for (p = s; p != NULL; p = p->next) {
+		clog(LOG_DEBUG, "%s: %u running (min %u)\n", p->str, p->count, p->min_count);
+		if (p->count >= p->min_count) {
+			ret = MATCH;
+			break;
+		}
+	}
+	programs_unlock();
+	return ret;
+}
+
+/* program_usage=a,b,c:min-max
+ * matches if the programs matching any of the patterns use
+ * between min and max percent of a cpu altogether.
+ */
+static int program_usage_parse(const char *ev, void **obj) {
+	struct prg_usage *ret = NULL;
+	struct prg_pattern *p = NULL;
+	char *str_copy = NULL, *interval = NULL;
+
+	clog(LOG_DEBUG, "called with %s.\n", ev);
+	ret = calloc(1, sizeof(struct prg_usage));
+	if (ret == NULL || (str_copy = strdup(ev)) == NULL) {
+		clog(LOG_ERR, "couldn't make enough room for program_usage (%s)\n",
+				strerror(errno));
+		free(ret);
+		return -1;
+	}
+
+	if ((interval = rindex(str_copy, ':')) == NULL ||
+			sscanf(interval + 1, "%d-%d", &ret->min, &ret->max) != 2) {
+		clog(LOG_ERR, "Discarded wrong format for program_usage: %s\n", ev);
+		free(str_copy);
+		free(ret);
+		return -1;
+	}
+	if (ret->min > ret->max) {
+		clog(LOG_ERR, "Min higher than Max?\n");
+		free(str_copy);
+		free(ret);
+		return -1;
+	}
+	*interval = '\0';
+
+	ret->patterns = parse_patterns(str_copy);
+	free(str_copy);
+	if (ret->patterns == NULL) {
+		free(ret);
+		return -1;
+	}
+	clog(LOG_INFO, "parsed %s %d-%d\n", ev, ret->min, ret->max);
+
+	programs_lock();
+	for (p = ret->patterns; p != NULL; p = p->next) {
+		p->usage = ret;
+		pattern_register(p);
+	}
+	ret->next = all_usage;
+	all_usage = ret;
+	usage_rebuild();
+	programs_unlock();
+
+	*obj = ret;
+	return 0;
+}
+
+static void program_usage_free(void *obj) {
+	struct prg_usage *u = obj, **uu = &all_usage;
+	struct prg_pattern *p = NULL;
+
+	programs_lock();
+	for (p = u->patterns; p != NULL; p = p->next)
+		pattern_unregister(p);
+	while (*uu != NULL && *uu != u)
+		uu = &(*uu)->next;
+	if (*uu != NULL)
+		*uu = u->next;
+	usage_rebuild();
+	programs_unlock();
+	pattern_free(u->patterns);
+	free(u);
+}
+
+static int program_usage_evaluate(const void *s) {
+	const struct prg_usage *u = s;
+	int usage = 0;
+
+	programs_lock();
+	usage = u->usage;
+	programs_unlock();
+
+	clog(LOG_DEBUG, "called %d-%d [%d]\n", u->min, u->max, usage);
+	return (usage >= u->min && usage <= u->max) ? MATCH : DONT_MATCH;
 }
 
 static struct cpufreqd_keyword kw[] = {
 	{ .word = "programs", .parse = &programs_parse,   .evaluate = &programs_evaluate, .free=programs_free },
+	{ .word = "program_usage", .parse = &program_usage_parse, .evaluate = &program_usage_evaluate, .free = &program_usage_free },
 	{ .word = NULL },
 };
 
@@ -418,6 +1439,8 @@ static struct cpufreqd_plugin programs = {
 	.keywords         = kw,                     /* config_keywords */
 	.plugin_exit      = &programs_exit,         /* plugin_exit */
 	.plugin_update    = &programs_update,       /* plugin_update */
+	.plugin_conf      = &programs_conf,         /* plugin_conf */
+	.plugin_post_conf = &programs_post_conf,    /* plugin_post_conf */
 };
 
 /* MUST DEFINE THIS ONE */
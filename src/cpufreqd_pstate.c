@@ -0,0 +1,787 @@
+/*
+ *  Copyright (C) 2002-2008  Mattia Dongili <malattia@linux.it>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  P-state Plugin
+ *  --------------
+ *  With intel_pstate and amd-pstate in active mode the governor is only
+ *  `performance' or `powersave', the driver (or the hardware) picks the
+ *  frequency. This plugin sets what they take into account instead:
+ *  the energy performance preference of each policy, the global
+ *  min_perf_pct/max_perf_pct (intel_pstate) and turbo.
+ *
+ *  The attributes are opened once and kept open, the current value is
+ *  read back before writing as the driver resets some of them (e.g. the
+ *  EPP when the governor changes).
+ *
+ *  Turbo can also be rationed while a Profile is set: at most a share of
+ *  each time window (turbo_budget) and/or below a package temperature
+ *  (turbo_temperature). Turbo residency is logged at the end of each
+ *  window and when the plugin exits, and is available to other plugins
+ *  as the plugin data (see cpufreqd_pstate.h).
+ *
+ *  turbo and its limits only need a writable boost attribute, the plugin
+ *  loads without intel_pstate and amd_pstate if there's one (e.g.
+ *  acpi-cpufreq), epp and perf_pct need the pstate driver.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cpufreqd_plugin.h"
+#include "cpufreq_utils.h"
+#include "sysfs_utils.h"
+#include "cpufreqd_pstate.h"
+
+#define SYS_CPU_DIR		"/sys/devices/system/cpu"
+#define INTEL_PSTATE_DIR	SYS_CPU_DIR "/intel_pstate"
+#define AMD_PSTATE_DIR		SYS_CPU_DIR "/amd_pstate"
+#define EPP			SYS_CPU_DIR "/cpu%u/cpufreq/energy_performance_preference"
+#define EPP_AVAILABLE		SYS_CPU_DIR "/cpu%u/cpufreq/energy_performance_available_preferences"
+#define GLOBAL_BOOST		SYS_CPU_DIR "/cpufreq/boost"
+#define POLICY_BOOST		SYS_CPU_DIR "/cpu%u/cpufreq/boost"
+#define THERMAL_ZONES		"/sys/class/thermal/thermal_zone*"
+#define HWMONS			"/sys/class/hwmon/hwmon*"
+
+#define EPP_LEN			32
+#define DEFAULT_WINDOW		60.0	/* s */
+#define DEFAULT_HYSTERESIS	5.0	/* °C */
+#define DT_MAX			10.0	/* longer gaps (suspend, manual mode) */
+
+struct perf_pct {
+	long min, max;
+};
+
+struct turbo_budget {
+	double share;		/* 0 - 1 */
+	double window;		/* s */
+	const struct cpufreq_policy *policy;	/* Profile it belongs to */
+};
+
+struct turbo_temperature {
+	double max;		/* °C, turbo off from here */
+	double hysteresis;	/* back on below max - hysteresis */
+	const struct cpufreq_policy *policy;
+};
+
+static const char *driver;	/* intel_pstate or amd_pstate, NULL if none */
+static char driver_status[16];	/* active, passive, guided... */
+static char epp_available[MAX_STRING_LEN];
+static unsigned int cpus;
+
+/* per cpu, opened when first needed */
+static struct sysfs_attr **epp_attr;
+static struct sysfs_attr **boost_attr;
+
+static struct sysfs_attr *min_perf_attr;
+static struct sysfs_attr *max_perf_attr;
+static struct sysfs_attr *no_turbo_attr;	/* intel_pstate, inverted */
+static struct sysfs_attr *global_boost_attr;	/* acpi-cpufreq style */
+
+/* package temperature sensors, opened by the first turbo_temperature */
+static struct sysfs_attr **pkg_temp_attr;
+static unsigned int pkg_temps;
+
+/* the limits of the current Profile, NULL if none */
+static struct turbo_budget *budget;
+static struct turbo_temperature *temp_limit;
+static unsigned char *limited;	/* per cpu, turbo is under the limits */
+static int turbo_wanted = -1;	/* turbo=, restored when limits go */
+static int turbo_state = -1;	/* as last written */
+static int too_hot;
+
+/* turbo residency */
+static double last_update;
+static double window_start;
+static struct turbo_residency residency;
+
+static struct sysfs_attr *open_if_exists(const char *path, int mode) {
+	if (access(path, F_OK) != 0)
+		return NULL;
+	return sysfs_attr_open(path, mode);
+}
+
+/* gets the per cpu attribute, opening it the first time */
+static struct sysfs_attr *cpu_attr(struct sysfs_attr **attrs, const char *fmt,
+		unsigned int cpu) {
+	char path[MAX_PATH_LEN];
+
+	if (cpu >= cpus)
+		return NULL;
+	if (attrs[cpu] == NULL) {
+		snprintf(path, sizeof(path), fmt, cpu);
+		attrs[cpu] = sysfs_attr_open(path, O_RDWR);
+	}
+	return attrs[cpu];
+}
+
+/* Writes value unless the kernel already holds it.
+ * Returns -1 on errors.
+ */
+static int write_changed(struct sysfs_attr *attr, const char *value) {
+	char current[EPP_LEN];
+
+	if (sysfs_attr_read(attr, current, sizeof(current)) >= 0
+			&& strcmp(current, value) == 0) {
+		clog(LOG_DEBUG, "%s already %s\n", sysfs_attr_path(attr), value);
+		return 0;
+	}
+	if (sysfs_attr_write(attr, value) != 0)
+		return -1;
+	clog(LOG_INFO, "%s set to %s\n", sysfs_attr_path(attr), value);
+	return 0;
+}
+
+static int write_changed_long(struct sysfs_attr *attr, long value) {
+	char buf[EPP_LEN];
+
+	snprintf(buf, sizeof(buf), "%ld", value);
+	return write_changed(attr, buf);
+}
+
+/* is word one of the space separated words in list */
+static int in_list(const char *list, const char *word) {
+	size_t len = strlen(word);
+	const char *s = list;
+
+	while ((s = strstr(s, word)) != NULL) {
+		if ((s == list || s[-1] == ' ')
+				&& (s[len] == '\0' || s[len] == ' '))
+			return 1;
+		s += len;
+	}
+	return 0;
+}
+
+/*
+ *  parse the 'epp' keyword: a preference name or a raw 0-255 value
+ */
+static int pstate_epp_parse(const char *ev, void **obj) {
+	char *ret = NULL;
+	long raw = 0;
+
+	if (ev[0] == '\0' || strlen(ev) >= EPP_LEN || strchr(ev, ' ') != NULL) {
+		clog(LOG_ERR, "couldn't parse epp=%s\n", ev);
+		return -1;
+	}
+	if (driver == NULL) {
+		clog(LOG_ERR, "epp needs intel_pstate or amd_pstate\n");
+		return -1;
+	}
+	if (sysfs_parse_long(ev, &raw) == 0) {
+		if (raw < 0 || raw > 255) {
+			clog(LOG_ERR, "epp value out of range (%ld), 0-255 expected\n",
+					raw);
+			return -1;
+		}
+	} else if (epp_available[0] != '\0' && !in_list(epp_available, ev)) {
+		clog(LOG_ERR, "unknown epp %s (available: %s)\n", ev, epp_available);
+		return -1;
+	}
+
+	ret = strdup(ev);
+	if (ret == NULL) {
+		clog(LOG_ERR, "couldn't make enough room for epp (%s)\n",
+				strerror(errno));
+		return -1;
+	}
+	clog(LOG_INFO, "epp %s\n", ret);
+	*obj = ret;
+	return 0;
+}
+
+/*
+ *  parse the 'perf_pct' keyword: min-max percentages of the max performance
+ */
+static int pstate_perf_pct_parse(const char *ev, void **obj) {
+	struct perf_pct *ret = NULL;
+	int min = 0, max = 0, n = 0;
+
+	if (sscanf(ev, "%d-%d%n", &min, &max, &n) != 2 || ev[n] != '\0'
+			|| min < 0 || max > 100 || min > max) {
+		clog(LOG_ERR, "couldn't parse perf_pct=%s, min-max (0-100) expected\n",
+				ev);
+		return -1;
+	}
+	if (min_perf_attr == NULL || max_perf_attr == NULL) {
+		clog(LOG_ERR, "perf_pct needs intel_pstate min_perf_pct and max_perf_pct\n");
+		return -1;
+	}
+
+	ret = malloc(sizeof(struct perf_pct));
+	if (ret == NULL) {
+		clog(LOG_ERR, "couldn't make enough room for perf_pct (%s)\n",
+				strerror(errno));
+		return -1;
+	}
+	ret->min = min;
+	ret->max = max;
+	clog(LOG_INFO, "perf_pct %ld-%ld\n", ret->min, ret->max);
+	*obj = ret;
+	return 0;
+}
+
+/*
+ *  parse the 'turbo' keyword
+ */
+static int pstate_turbo_parse(const char *ev, void **obj) {
+	int *ret = NULL;
+	int on = 0;
+
+	if (strcmp(ev, "on") == 0) {
+		on = 1;
+	} else if (strcmp(ev, "off") != 0) {
+		clog(LOG_ERR, "couldn't parse turbo=%s, on or off expected\n", ev);
+		return -1;
+	}
+
+	ret = malloc(sizeof(int));
+	if (ret == NULL) {
+		clog(LOG_ERR, "couldn't make enough room for turbo (%s)\n",
+				strerror(errno));
+		return -1;
+	}
+	*ret = on;
+	clog(LOG_INFO, "turbo %s\n", on ? "on" : "off");
+	*obj = ret;
+	return 0;
+}
+
+/*
+ *  parse the 'turbo_budget' keyword: percent[/window], window in seconds
+ */
+static int pstate_turbo_budget_parse(const char *ev, void **obj) {
+	struct turbo_budget *ret = NULL;
+	double share = 0.0, window = DEFAULT_WINDOW;
+	const char *s = ev;
+	char *end = NULL;
+
+	share = strtod(s, &end);
+	if (end != s && *end == '%')
+		end++;
+	if (end != s && *end == '/') {
+		s = end + 1;
+		window = strtod(s, &end);
+		if (end != s && *end == 's')
+			end++;
+	}
+	if (end == s || *end != '\0' || share < 0.0 || share > 100.0
+			|| window < 1.0) {
+		clog(LOG_ERR, "couldn't parse turbo_budget=%s, percent[/seconds] "
+				"expected\n", ev);
+		return -1;
+	}
+
+	ret = calloc(1, sizeof(struct turbo_budget));
+	if (ret == NULL) {
+		clog(LOG_ERR, "couldn't make enough room for turbo_budget (%s)\n",
+				strerror(errno));
+		return -1;
+	}
+	ret->share = share / 100.0;
+	ret->window = window;
+	clog(LOG_INFO, "turbo budget %.0f%% of %.0fs\n", share, window);
+	*obj = ret;
+	return 0;
+}
+
+/* package sensors: x86_pkg_temp thermal zones, or coretemp / k10temp */
+static int open_package_sensors(void) {
+	const char *zone_types[] = { "x86_pkg_temp", NULL };
+	const char *hwmon_names[] = { "coretemp", "k10temp", "zenpower", NULL };
+	const char *pattern[] = { THERMAL_ZONES, HWMONS };
+	const char *name_attr[] = { "type", "name" };
+	const char *temp_attr[] = { "temp", "temp1_input" };
+	const char **names[] = { zone_types, hwmon_names };
+	char path[MAX_PATH_LEN], name[MAX_STRING_LEN];
+	struct sysfs_attr *attr = NULL, **tmp = NULL;
+	glob_t g;
+	unsigned int i = 0, j = 0, k = 0;
+	int match = 0;
+
+	for (i = 0; i < 2 && pkg_temps == 0; i++) {
+		if (glob(pattern[i], 0, NULL, &g) != 0)
+			continue;
+		for (j = 0; j < g.gl_pathc; j++) {
+			snprintf(path, sizeof(path), "%s/%s", g.gl_pathv[j], name_attr[i]);
+			if ((attr = open_if_exists(path, O_RDONLY)) == NULL)
+				continue;
+			match = 0;
+			if (sysfs_attr_read(attr, name, sizeof(name)) >= 0) {
+				for (k = 0; names[i][k] != NULL; k++)
+					match |= strcmp(name, names[i][k]) == 0;
+			}
+			sysfs_attr_close(attr);
+			snprintf(path, sizeof(path), "%s/%s", g.gl_pathv[j], temp_attr[i]);
+			if (!match || (attr = open_if_exists(path, O_RDONLY)) == NULL)
+				continue;
+			tmp = realloc(pkg_temp_attr, (pkg_temps + 1) * sizeof(struct sysfs_attr *));
+			if (tmp == NULL) {
+				clog(LOG_ERR, "couldn't make enough room for %s (%s)\n",
+						path, strerror(errno));
+				sysfs_attr_close(attr);
+				break;
+			}
+			pkg_temp_attr = tmp;
+			pkg_temp_attr[pkg_temps++] = attr;
+			clog(LOG_INFO, "package temperature from %s (%s)\n", path, name);
+		}
+		globfree(&g);
+	}
+	return pkg_temps > 0 ? 0 : -1;
+}
+
+/*
+ *  parse the 'turbo_temperature' keyword: max[:hysteresis], °C
+ */
+static int pstate_turbo_temperature_parse(const char *ev, void **obj) {
+	struct turbo_temperature *ret = NULL;
+	double max = 0.0, hysteresis = DEFAULT_HYSTERESIS;
+	const char *s = ev;
+	char *end = NULL;
+
+	max = strtod(s, &end);
+	if (end != s && *end == ':') {
+		s = end + 1;
+		hysteresis = strtod(s, &end);
+	}
+	if (end == s || *end != '\0' || max <= 0.0 || hysteresis < 0.0) {
+		clog(LOG_ERR, "couldn't parse turbo_temperature=%s, "
+				"max[:hysteresis] expected\n", ev);
+		return -1;
+	}
+	if (pkg_temps == 0 && open_package_sensors() != 0) {
+		clog(LOG_ERR, "no package temperature sensor found for "
+				"turbo_temperature\n");
+		return -1;
+	}
+
+	ret = calloc(1, sizeof(struct turbo_temperature));
+	if (ret == NULL) {
+		clog(LOG_ERR, "couldn't make enough room for turbo_temperature (%s)\n",
+				strerror(errno));
+		return -1;
+	}
+	ret->max = max;
+	ret->hysteresis = hysteresis;
+	clog(LOG_INFO, "turbo up to %.1fC (hysteresis %.1fC)\n", max, hysteresis);
+	*obj = ret;
+	return 0;
+}
+
+static void pstate_epp_change(void *obj, const struct cpufreq_policy __UNUSED__ *old,
+		const struct cpufreq_policy *new, const unsigned int cpu) {
+	struct sysfs_attr *attr = NULL;
+
+	/* the driver forces the performance EPP and refuses changes */
+	if (new->governor != NULL && strcmp(new->governor, "performance") == 0) {
+		clog(LOG_DEBUG, "CPU%u: epp is fixed by the performance governor\n",
+				cpu);
+		return;
+	}
+	if ((attr = cpu_attr(epp_attr, EPP, cpu)) == NULL) {
+		clog(LOG_WARNING, "CPU%u: can't set epp\n", cpu);
+		return;
+	}
+	write_changed(attr, (const char *)obj);
+}
+
+static void pstate_perf_pct_change(void *obj, const struct cpufreq_policy __UNUSED__ *old,
+		const struct cpufreq_policy __UNUSED__ *new,
+		const unsigned int __UNUSED__ cpu) {
+	const struct perf_pct *pct = (const struct perf_pct *)obj;
+	long current_max = 0;
+
+	/* min_perf_pct is clamped to max_perf_pct, so raise the max first */
+	if (sysfs_attr_read_long(max_perf_attr, &current_max) == 0
+			&& pct->min > current_max) {
+		write_changed_long(max_perf_attr, pct->max);
+		write_changed_long(min_perf_attr, pct->min);
+	} else {
+		write_changed_long(min_perf_attr, pct->min);
+		write_changed_long(max_perf_attr, pct->max);
+	}
+}
+
+/* writes turbo where the cpu gets it from, once if it's global */
+static void write_turbo(unsigned int cpu, int on) {
+	struct sysfs_attr *attr = NULL;
+
+	if (no_turbo_attr != NULL) {
+		write_changed(no_turbo_attr, on ? "0" : "1");
+		return;
+	}
+	if (global_boost_attr != NULL) {
+		write_changed(global_boost_attr, on ? "1" : "0");
+		return;
+	}
+	if ((attr = cpu_attr(boost_attr, POLICY_BOOST, cpu)) == NULL) {
+		clog(LOG_WARNING, "CPU%u: can't set turbo\n", cpu);
+		return;
+	}
+	write_changed(attr, on ? "1" : "0");
+}
+
+static int read_turbo(unsigned int cpu) {
+	struct sysfs_attr *attr = no_turbo_attr;
+	long value = 0;
+
+	if (attr == NULL)
+		attr = global_boost_attr;
+	if (attr == NULL && (attr = cpu_attr(boost_attr, POLICY_BOOST, cpu)) == NULL)
+		return -1;
+	if (sysfs_attr_read_long(attr, &value) != 0)
+		return -1;
+	return attr == no_turbo_attr ? value == 0 : value != 0;
+}
+
+static int is_current(const struct cpufreq_policy *policy, unsigned int cpu) {
+	const struct profile *p = get_cpufreqd_info()->current_profiles[cpu];
+	return p != NULL && &p->policy == policy;
+}
+
+/* the limits of the current Profile of cpu drive turbo */
+static int under_limits(unsigned int cpu) {
+	return (budget != NULL && is_current(budget->policy, cpu))
+		|| (temp_limit != NULL && is_current(temp_limit->policy, cpu));
+}
+
+static void pstate_turbo_change(void *obj, const struct cpufreq_policy __UNUSED__ *old,
+		const struct cpufreq_policy __UNUSED__ *new, const unsigned int cpu) {
+	turbo_wanted = *(int *)obj;
+	if (under_limits(cpu)) {
+		clog(LOG_DEBUG, "CPU%u: turbo is left to the limits\n", cpu);
+		return;
+	}
+	write_turbo(cpu, turbo_wanted);
+	turbo_state = turbo_wanted;
+}
+
+static void start_limits(unsigned int cpu) {
+	if (cpu >= cpus)
+		return;
+	if (turbo_wanted == -1)
+		turbo_wanted = read_turbo(cpu);
+	/* the first decision is written whatever turbo_state says */
+	if (!limited[cpu])
+		turbo_state = -1;
+	limited[cpu] = 1;
+}
+
+static void pstate_turbo_budget_change(void *obj, const struct cpufreq_policy __UNUSED__ *old,
+		const struct cpufreq_policy *new, const unsigned int cpu) {
+	struct turbo_budget *b = (struct turbo_budget *)obj;
+
+	b->policy = new;
+	if (budget != b) {
+		clog(LOG_DEBUG, "turbo budget %.0f%% of %.0fs\n", b->share * 100.0,
+				b->window);
+		budget = b;
+		window_start = monotonic_time();
+		residency.window_turbo = 0.0;
+	}
+	start_limits(cpu);
+}
+
+static void pstate_turbo_temperature_change(void *obj,
+		const struct cpufreq_policy __UNUSED__ *old,
+		const struct cpufreq_policy *new, const unsigned int cpu) {
+	struct turbo_temperature *t = (struct turbo_temperature *)obj;
+
+	t->policy = new;
+	if (temp_limit != t) {
+		clog(LOG_DEBUG, "turbo up to %.1fC\n", t->max);
+		temp_limit = t;
+	}
+	start_limits(cpu);
+}
+
+static void pstate_turbo_limits_free(void *obj) {
+	/* free_configuration() runs before pstate_exit() */
+	if (obj == budget)
+		budget = NULL;
+	if (obj == temp_limit)
+		temp_limit = NULL;
+	free(obj);
+}
+
+/* the window may have been cut short by a Profile change */
+static void log_window(void) {
+	double elapsed = residency.window_time;
+
+	if (elapsed <= 0.0)
+		return;
+	clog(LOG_INFO, "turbo residency %.0f%% of the last %.0fs (budget %.0f%%), "
+			"%.0f%% overall\n",
+			residency.window_turbo * 100.0 / elapsed, elapsed,
+			budget->share * 100.0,
+			residency.known > 0.0 ?
+			residency.turbo * 100.0 / residency.known : 0.0);
+}
+
+/* hottest package, -1 if none could be read */
+static double package_temperature(void) {
+	unsigned int i = 0;
+	long value = 0;
+	double ret = -1.0;
+
+	for (i = 0; i < pkg_temps; i++) {
+		if (sysfs_attr_read_long(pkg_temp_attr[i], &value) == 0
+				&& (double)value / 1000.0 > ret)
+			ret = (double)value / 1000.0;
+	}
+	return ret;
+}
+
+static int pstate_update(void) {
+	unsigned int i = 0, running = 0;
+	double now = monotonic_time(), dt = now - last_update;
+	double temperature = 0.0;
+	int on = 1;
+
+	if (last_update == 0.0 || dt < 0.0)
+		dt = 0.0;
+	if (dt > DT_MAX)
+		dt = DT_MAX;
+	last_update = now;
+
+	/* residency */
+	if (turbo_state != -1) {
+		residency.known += dt;
+		if (turbo_state) {
+			residency.turbo += dt;
+			residency.window_turbo += dt;
+		}
+	}
+	residency.window_time = budget != NULL ? now - window_start : 0.0;
+
+	/* another Profile has been set */
+	if (budget != NULL) {
+		for (i = 0; i < cpus && !is_current(budget->policy, i); i++);
+		if (i == cpus) {
+			log_window();
+			budget = NULL;
+			residency.window_turbo = residency.window_time = 0.0;
+		}
+	}
+	if (temp_limit != NULL) {
+		for (i = 0; i < cpus && !is_current(temp_limit->policy, i); i++);
+		if (i == cpus)
+			temp_limit = NULL;
+	}
+	for (i = 0; i < cpus; i++) {
+		if (limited[i] && !under_limits(i)) {
+			clog(LOG_DEBUG, "CPU%u: turbo limits released\n", i);
+			limited[i] = 0;
+			if (turbo_wanted != -1 && turbo_state != turbo_wanted)
+				write_turbo(i, turbo_wanted);
+		}
+		running += limited[i];
+	}
+	if (!running) {
+		if (turbo_wanted != -1)
+			turbo_state = turbo_wanted;
+		return 0;
+	}
+
+	if (budget != NULL) {
+		if (now - window_start >= budget->window) {
+			log_window();
+			window_start = now;
+			residency.window_turbo = residency.window_time = 0.0;
+		}
+		/* off if another poll with turbo would overrun the budget */
+		on = residency.window_turbo + dt
+			<= budget->share * budget->window + 0.001;
+	}
+	if (temp_limit != NULL
+			&& (temperature = package_temperature()) >= 0.0) {
+		if (temperature >= temp_limit->max)
+			too_hot = 1;
+		else if (temperature <= temp_limit->max - temp_limit->hysteresis)
+			too_hot = 0;
+		on = on && !too_hot;
+	}
+
+	if (on == turbo_state)
+		return 0;
+	if (budget != NULL)
+		clog(LOG_INFO, "turbo %s (%.0fs of %.0fs used%s)\n", on ? "on" : "off",
+				residency.window_turbo, budget->share * budget->window,
+				too_hot ? ", too hot" : "");
+	else
+		clog(LOG_INFO, "turbo %s (%.1fC)\n", on ? "on" : "off", temperature);
+	for (i = 0; i < cpus; i++) {
+		if (!limited[i])
+			continue;
+		write_turbo(i, on);
+		/* global attribute, written already */
+		if (no_turbo_attr != NULL || global_boost_attr != NULL)
+			break;
+	}
+	turbo_state = on;
+	return 0;
+}
+
+static void read_driver_status(const char *dir) {
+	char path[MAX_PATH_LEN];
+	struct sysfs_attr *attr = NULL;
+
+	snprintf(path, sizeof(path), "%s/status", dir);
+	if ((attr = open_if_exists(path, O_RDONLY)) == NULL)
+		return;
+	if (sysfs_attr_read(attr, driver_status, sizeof(driver_status)) < 0)
+		driver_status[0] = '\0';
+	sysfs_attr_close(attr);
+}
+
+static void read_epp_available(void) {
+	char path[MAX_PATH_LEN];
+	struct sysfs_attr *attr = NULL;
+
+	snprintf(path, sizeof(path), EPP_AVAILABLE, 0);
+	if ((attr = open_if_exists(path, O_RDONLY)) == NULL)
+		return;
+	if (sysfs_attr_read(attr, epp_available, sizeof(epp_available)) < 0)
+		epp_available[0] = '\0';
+	sysfs_attr_close(attr);
+	clog(LOG_DEBUG, "available epp: %s\n", epp_available);
+}
+
+/* a boost attribute turbo can be set with */
+static int boost_writable(void) {
+	char path[MAX_PATH_LEN];
+	unsigned int i = 0;
+
+	if (no_turbo_attr != NULL || access(GLOBAL_BOOST, W_OK) == 0)
+		return 1;
+	for (i = 0; i < get_cpufreqd_info()->cpus; i++) {
+		snprintf(path, sizeof(path), POLICY_BOOST, i);
+		if (access(path, W_OK) == 0)
+			return 1;
+	}
+	return 0;
+}
+
+static int pstate_init(void) {
+	if (access(INTEL_PSTATE_DIR, F_OK) == 0) {
+		driver = "intel_pstate";
+		read_driver_status(INTEL_PSTATE_DIR);
+		min_perf_attr = open_if_exists(INTEL_PSTATE_DIR "/min_perf_pct", O_RDWR);
+		max_perf_attr = open_if_exists(INTEL_PSTATE_DIR "/max_perf_pct", O_RDWR);
+		no_turbo_attr = open_if_exists(INTEL_PSTATE_DIR "/no_turbo", O_RDWR);
+	} else if (access(AMD_PSTATE_DIR, F_OK) == 0) {
+		driver = "amd_pstate";
+		read_driver_status(AMD_PSTATE_DIR);
+	} else if (!boost_writable()) {
+		clog(LOG_NOTICE, "neither intel_pstate nor amd_pstate nor a boost "
+				"attribute found\n");
+		return -1;
+	}
+	if (no_turbo_attr == NULL)
+		global_boost_attr = open_if_exists(GLOBAL_BOOST, O_RDWR);
+	read_epp_available();
+
+	cpus = get_cpufreqd_info()->cpus;
+	epp_attr = calloc(cpus, sizeof(struct sysfs_attr *));
+	boost_attr = calloc(cpus, sizeof(struct sysfs_attr *));
+	limited = calloc(cpus, sizeof(unsigned char));
+	if (epp_attr == NULL || boost_attr == NULL || limited == NULL) {
+		clog(LOG_ERR, "couldn't make enough room for %u cpus (%s)\n",
+				cpus, strerror(errno));
+		free(epp_attr);
+		free(boost_attr);
+		free(limited);
+		epp_attr = boost_attr = NULL;
+		limited = NULL;
+		sysfs_attr_close(min_perf_attr);
+		sysfs_attr_close(max_perf_attr);
+		sysfs_attr_close(no_turbo_attr);
+		sysfs_attr_close(global_boost_attr);
+		min_perf_attr = max_perf_attr = no_turbo_attr = global_boost_attr = NULL;
+		return -1;
+	}
+	if (driver != NULL)
+		clog(LOG_INFO, "%s driver (%s)\n", driver,
+				driver_status[0] ? driver_status : "unknown status");
+	else
+		clog(LOG_INFO, "no pstate driver, turbo only\n");
+	return 0;
+}
+
+static int pstate_exit(void) {
+	unsigned int i = 0;
+
+	for (i = 0; i < cpus; i++) {
+		sysfs_attr_close(epp_attr[i]);
+		sysfs_attr_close(boost_attr[i]);
+	}
+	free(epp_attr);
+	free(boost_attr);
+	free(limited);
+	epp_attr = boost_attr = NULL;
+	limited = NULL;
+	cpus = 0;
+	for (i = 0; i < pkg_temps; i++)
+		sysfs_attr_close(pkg_temp_attr[i]);
+	free(pkg_temp_attr);
+	pkg_temp_attr = NULL;
+	pkg_temps = 0;
+	sysfs_attr_close(min_perf_attr);
+	sysfs_attr_close(max_perf_attr);
+	sysfs_attr_close(no_turbo_attr);
+	sysfs_attr_close(global_boost_attr);
+	min_perf_attr = max_perf_attr = no_turbo_attr = global_boost_attr = NULL;
+	if (residency.known > 0.0)
+		clog(LOG_NOTICE, "turbo residency %.0f%% over %.0fs\n",
+				residency.turbo * 100.0 / residency.known,
+				residency.known);
+	driver = NULL;
+	clog(LOG_INFO, "pstate exited.\n");
+	return 0;
+}
+
+static struct cpufreqd_keyword kw[] = {
+	{ .word = "epp", .parse = &pstate_epp_parse,
+		.profile_post_change = &pstate_epp_change },
+	{ .word = "perf_pct", .parse = &pstate_perf_pct_parse,
+		.profile_post_change = &pstate_perf_pct_change },
+	{ .word = "turbo", .parse = &pstate_turbo_parse,
+		.profile_post_change = &pstate_turbo_change },
+	{ .word = "turbo_budget", .parse = &pstate_turbo_budget_parse,
+		.profile_post_change = &pstate_turbo_budget_change,
+		.free = &pstate_turbo_limits_free },
+	{ .word = "turbo_temperature", .parse = &pstate_turbo_temperature_parse,
+		.profile_post_change = &pstate_turbo_temperature_change,
+		.free = &pstate_turbo_limits_free },
+	{ .word = NULL, .parse = NULL, .evaluate = NULL, .free = NULL }
+};
+
+static struct cpufreqd_plugin pstate = {
+	.plugin_name	= "pstate",
+	.keywords	= kw,
+	.plugin_init	= &pstate_init,
+	.plugin_exit	= &pstate_exit,
+	.plugin_update	= &pstate_update,
+	.data		= &residency,
+};
+
+struct cpufreqd_plugin *create_plugin (void) {
+	return &pstate;
+}
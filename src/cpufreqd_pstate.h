@@ -0,0 +1,32 @@
+/*
+ *  Copyright (C) 2002-2008  Mattia Dongili <malattia@linux.it>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __CPUFREQD_PSTATE_H__
+#define __CPUFREQD_PSTATE_H__ 1
+
+/* turbo residency, available to other plugins through
+ * get_plugin_data("pstate")
+ */
+struct turbo_residency {
+	double turbo;		/* s with turbo on */
+	double known;		/* s with a known turbo state */
+	double window_turbo;	/* s with turbo on in the current budget window */
+	double window_time;	/* s elapsed in the current budget window, 0 if none */
+};
+
+#endif
@@ -31,6 +31,8 @@
  *
  * The response may be longer than a single line and is
  * terminated by the RESPONSE_END (see defines).
+ * Sets of cpus in responses are sent in the text form described
+ * in cpumask.h, as long as needed by the number of cpus.
  */
 
 #define CMD_SHIFT		16
@@ -16,12 +16,18 @@
  *  along with this program; if not, write to the Free Software
  *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
+#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
 #include <sensors/sensors.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "cpufreqd_plugin.h"
+#include "sysfs_utils.h"
+#include "sensor_aggregate.h"
+#include "thermal_control.h"
 
 #if !defined __GNUC__ || __GNUC__ < 3
 #define __attribute__(x)
@@ -31,6 +37,9 @@
 typedef sensors_feature_data sensors_feature;
 #endif
 
+#define HWMON_DIR	"/sys/class/hwmon"
+#define INPUT_SUFFIX	"_input"
+
 /* to hold monitored feature list and avoid reading all sensors */
 struct sensors_monitor {
 	const sensors_chip_name *chip;
@@ -39,30 +48,98 @@ struct sensors_monitor {
 #if SENSORS_API_VERSION >= 0x400
 	const sensors_subfeature *sub_feat;
 #endif
+	/* native hwmon backend, chip and feat are NULL */
+	struct sysfs_attr *attr;
+	char feat_name[32];
+	double scale;	/* sysfs units to libsensors ones */
+	int raw;
+
 	double value;
+	int valid;	/* value read at the last update */
 	struct sensors_monitor *next;
 };
 static struct sensors_monitor *monitor_list;
 
+/* hwmon inputs found at the first lookup */
+struct hwmon_feature {
+	char chip[MAX_STRING_LEN];	/* the chip name attribute */
+	char dir[16];			/* hwmonN */
+	char id[MAX_STRING_LEN];	/* chip-hwmonN */
+	char feature[32];		/* temp1, in0, fan2... */
+	char label[MAX_STRING_LEN];
+	char path[MAX_PATH_LEN];	/* the _input attribute */
+	double scale;
+};
+static struct hwmon_feature *hwmon_features;
+static unsigned int hwmon_count, hwmon_size;
+static int hwmon_scanned;
+static struct sysfs_batch *hwmon_batch;
+
+/* hwmon reports integers: millidegrees, millivolts, microwatts... */
+static const struct {
+	const char *prefix;
+	double scale;
+} hwmon_units[] = {
+	{ "temp",	0.001 },
+	{ "in",		0.001 },
+	{ "curr",	0.001 },
+	{ "humidity",	0.001 },
+	{ "power",	0.000001 },
+	{ "energy",	0.000001 },
+	{ "fan",	1.0 },
+	{ NULL,		0.0 }
+};
+
+static int use_libsensors;
+
+/* features matching a pattern, aggregated once per update */
+struct sensor_group {
+	char pattern[MAX_STRING_LEN];
+	int how;	/* enum sensor_aggregate */
+	struct sensors_monitor **members;
+	double *values;	/* scratch for the aggregation */
+	unsigned int count;
+	double value;
+	int valid;
+	struct sensor_group *next;
+};
+static struct sensor_group *group_list;
+
+/* what a directive reads, either a single feature or a group */
+struct sensor_source {
+	struct sensors_monitor *monitor;
+	struct sensor_group *group;
+};
+
 /* object returned by parse_config pointer */
 struct sensor_object {
-	struct sensors_monitor *monitor;
+	struct sensor_source src;
 	char name[MAX_STRING_LEN];
 	double min;
 	double max;
 };
 
+/* sensor_target Profile directives */
+struct sensor_target {
+	struct sensor_source src;
+	struct thermal_control *ctl;
+	struct sensor_target *next;
+};
+static struct sensor_target *targets;
+
 static const char *default_file_path[] =
   { "/etc", "/usr/local/etc", "/usr/lib/sensors", "/usr/local/lib/sensors",
     "/usr/lib", "/usr/local/lib", ".", 0 };
 
 static char sensors_conffile[MAX_PATH_LEN];
 static int init_success;
+static int init_tried;
 
 /*
- * Do initalization after having read our config section
+ * Initialize libsensors, with the native hwmon backend this is only done
+ * when a feature can't be found in sysfs
  */
-static int sensors_post_conf(void) {
+static int load_libsensors(void) {
 	FILE *config = NULL;
 	int i;
 
@@ -94,7 +171,8 @@ static int sensors_post_conf(void) {
 #endif
 	if(sensors_init(config)) {
 		clog(LOG_ERR, "sensors_init() failed, sensors disabled!\n");
-		fclose(config);
+		if (config)
+			fclose(config);
 		return -1;
 	}
 	if (config)
@@ -106,25 +184,65 @@ static int sensors_post_conf(void) {
 	return 0;
 }
 
+/*
+ * Do initalization after having read our config section
+ */
+static int sensors_post_conf(void) {
+	if (use_libsensors) {
+		init_tried = 1;
+		return load_libsensors();
+	}
+	if ((hwmon_batch = sysfs_batch_new()) == NULL)
+		return -1;
+	clog(LOG_INFO, "reading hwmon sensors directly\n");
+	return 0;
+}
+
 /*
  * cleanup senesors if init was successful
  */
 static int sensors_exit(void) {
 	struct sensors_monitor *released = NULL;
+	struct sensor_group *group = NULL;
 
 	if (init_success)
 		sensors_cleanup();
 
+	while (group_list != NULL) {
+		group = group_list;
+		group_list = group_list->next;
+		free(group->members);
+		free(group->values);
+		free(group);
+	}
+
 	/* free monitored features list */
 	while (monitor_list != NULL) {
 		released = monitor_list;
 		monitor_list = monitor_list->next;
+		sysfs_attr_close(released->attr);
 		free(released);
 	}
+	sysfs_batch_free(hwmon_batch);
+	hwmon_batch = NULL;
+	free(hwmon_features);
+	hwmon_features = NULL;
+	hwmon_count = hwmon_size = 0;
+	hwmon_scanned = 0;
 
 	return 0;
 }
 
+/* the value a directive is evaluated against, -1 if it couldn't be read */
+static int source_value(const struct sensor_source *src, double *value) {
+	if (src->group != NULL) {
+		*value = src->group->value;
+		return src->group->valid ? 0 : -1;
+	}
+	*value = src->monitor->value;
+	return src->monitor->valid ? 0 : -1;
+}
+
 /*
  * parse configuration entries
  */
@@ -136,6 +254,19 @@ static int sensors_conf(const char *key, const char *value) {
 		return 0;
 	}
 
+	if (strcmp(key, "backend") == 0) {
+		if (strcmp(value, "libsensors") == 0)
+			use_libsensors = 1;
+		else if (strcmp(value, "hwmon") == 0)
+			use_libsensors = 0;
+		else {
+			clog(LOG_WARNING, "unknown backend %s, using hwmon\n", value);
+			use_libsensors = 0;
+		}
+		clog(LOG_DEBUG, "backend is %s\n", use_libsensors ? "libsensors" : "hwmon");
+		return 0;
+	}
+
 	/* chip directive: use only said chips (usefull??) */
 	return -1;
 }
@@ -148,20 +279,57 @@ static int sensors_conf(const char *key, const char *value) {
 static int sensors_get(void) {
 
 	struct sensors_monitor *list = monitor_list;
+	struct sensor_group *group = NULL;
+	struct sensor_target *st = NULL;
+	unsigned int i = 0, count = 0;
+	double value = 0.0;
+
+	if (hwmon_batch != NULL)
+		sysfs_batch_read(hwmon_batch);
 
 	while (list) {
+		if (list->attr != NULL) {
+			if (list->valid) {
+				list->value = (double)list->raw * list->scale;
+				clog(LOG_INFO, "%s:%s: %.3f\n", list->chip_string,
+						list->feat_name, list->value);
+			}
+			list = list->next;
+			continue;
+		}
 #if SENSORS_API_VERSION >= 0x400
 		if(sensors_get_value(list->chip, list->sub_feat->number, &list->value) < 0) {
 #else
 		if(sensors_get_feature(*(list->chip), list->feat->number, &list->value) < 0) {
 #endif
 			clog(LOG_ERR,"could not read value for %s\n",list->feat->name);
+			list->valid = 0;
 			return -1;
 		}
+		list->valid = 1;
 		clog(LOG_INFO, "%s:%s: %.3f\n", list->chip_string, list->feat->name, list->value);
 		list = list->next;
 	}
 
+	for (group = group_list; group != NULL; group = group->next) {
+		count = 0;
+		for (i = 0; i < group->count; i++) {
+			if (group->members[i]->valid)
+				group->values[count++] = group->members[i]->value;
+		}
+		group->valid = count > 0;
+		if (group->valid) {
+			group->value = sensor_aggregate(group->values, count, group->how);
+			clog(LOG_INFO, "%s:%s: %.3f (%u)\n", group->pattern,
+					sensor_aggregate_name(group->how), group->value, count);
+		}
+	}
+
+	for (st = targets; st != NULL; st = st->next) {
+		if (source_value(&st->src, &value) == 0)
+			thermal_control_update(st->ctl, value);
+	}
+
 	return 0;
 }
 
@@ -284,8 +452,288 @@ static struct sensors_monitor * validate_feature_name(const char *name) {
 	return NULL;
 }
 
-static int sensor_parse(const char *ev, void **obj) {
+/* reads a small sysfs file, returns -1 if it isn't there */
+static int read_small_file(const char *path, char *buf, size_t len) {
+	struct sysfs_attr *attr = NULL;
+	int ret = 0;
+
+	if (access(path, R_OK) != 0 || (attr = sysfs_attr_open(path, O_RDONLY)) == NULL)
+		return -1;
+	ret = sysfs_attr_read(attr, buf, len) < 0 ? -1 : 0;
+	sysfs_attr_close(attr);
+	return ret;
+}
+
+static double hwmon_scale(const char *feature) {
+	int i = 0;
+
+	for (i = 0; hwmon_units[i].prefix != NULL; i++) {
+		if (strncmp(feature, hwmon_units[i].prefix,
+					strlen(hwmon_units[i].prefix)) == 0)
+			return hwmon_units[i].scale;
+	}
+	return 0.0;
+}
+
+static struct hwmon_feature *hwmon_add(void) {
+	struct hwmon_feature *hf = NULL;
+	unsigned int size = 0;
+
+	if (hwmon_count == hwmon_size) {
+		size = hwmon_size ? hwmon_size * 2 : 16;
+		hf = realloc(hwmon_features, size * sizeof(struct hwmon_feature));
+		if (hf == NULL) {
+			clog(LOG_ERR, "couldn't make enough room for hwmon features (%s)\n",
+					strerror(errno));
+			return NULL;
+		}
+		hwmon_features = hf;
+		hwmon_size = size;
+	}
+	hf = &hwmon_features[hwmon_count++];
+	memset(hf, 0, sizeof(struct hwmon_feature));
+	return hf;
+}
+
+/* collects the *_input attributes of a hwmon device, older drivers have
+ * them in the device directory
+ */
+static void scan_hwmon_device(const char *dir) {
+	char base[MAX_PATH_LEN], path[MAX_PATH_LEN], chip[MAX_STRING_LEN];
+	struct hwmon_feature *hf = NULL;
+	struct dirent *ent = NULL;
+	DIR *d = NULL;
+	size_t len = 0;
+	double scale = 0.0;
+
+	snprintf(base, sizeof(base), "%s/%s", HWMON_DIR, dir);
+	snprintf(path, sizeof(path), "%s/name", base);
+	if (read_small_file(path, chip, sizeof(chip)) != 0) {
+		snprintf(base, sizeof(base), "%s/%s/device", HWMON_DIR, dir);
+		snprintf(path, sizeof(path), "%s/name", base);
+		if (read_small_file(path, chip, sizeof(chip)) != 0)
+			return;
+	}
+
+	if ((d = opendir(base)) == NULL)
+		return;
+	while ((ent = readdir(d)) != NULL) {
+		len = strlen(ent->d_name);
+		if (len <= strlen(INPUT_SUFFIX) || len - strlen(INPUT_SUFFIX) >= 32
+				|| strcmp(ent->d_name + len - strlen(INPUT_SUFFIX),
+					INPUT_SUFFIX) != 0
+				|| (scale = hwmon_scale(ent->d_name)) == 0.0)
+			continue;
+		if ((hf = hwmon_add()) == NULL)
+			break;
+		snprintf(hf->chip, sizeof(hf->chip), "%s", chip);
+		snprintf(hf->dir, sizeof(hf->dir), "%s", dir);
+		snprintf(hf->id, sizeof(hf->id), "%s-%s", chip, dir);
+		memcpy(hf->feature, ent->d_name, len - strlen(INPUT_SUFFIX));
+		hf->feature[len - strlen(INPUT_SUFFIX)] = '\0';
+		snprintf(hf->path, sizeof(hf->path), "%s/%s", base, ent->d_name);
+		hf->scale = scale;
+		snprintf(path, sizeof(path), "%s/%s_label", base, hf->feature);
+		if (read_small_file(path, hf->label, sizeof(hf->label)) != 0)
+			hf->label[0] = '\0';
+		clog(LOG_DEBUG, "%s/%s (%s)\n", hf->chip, hf->feature, hf->label);
+	}
+	closedir(d);
+}
+
+/* lists the hwmon inputs once, every directive is looked up here */
+static void scan_hwmon(void) {
+	struct dirent *ent = NULL;
+	DIR *d = NULL;
+
+	hwmon_scanned = 1;
+	if ((d = opendir(HWMON_DIR)) == NULL) {
+		clog(LOG_NOTICE, "couldn't open %s (%s)\n", HWMON_DIR, strerror(errno));
+		return;
+	}
+	while ((ent = readdir(d)) != NULL) {
+		if (ent->d_name[0] != '.')
+			scan_hwmon_device(ent->d_name);
+	}
+	closedir(d);
+	clog(LOG_INFO, "found %u hwmon inputs\n", hwmon_count);
+}
+
+/* name is [chip/]feature where chip is the hwmon device name, its
+ * hwmonN directory or both as chip-hwmonN and feature the input name or
+ * its label, both can be shell patterns
+ */
+static int hwmon_match(const struct hwmon_feature *hf, const char *name) {
+	char chip[MAX_STRING_LEN];
+	const char *feat = strchr(name, '/');
+
+	if (feat != NULL) {
+		snprintf(chip, sizeof(chip), "%.*s", (int)(feat - name), name);
+		if (fnmatch(chip, hf->chip, 0) != 0 && fnmatch(chip, hf->dir, 0) != 0
+				&& fnmatch(chip, hf->id, 0) != 0)
+			return 0;
+		feat++;
+	} else {
+		feat = name;
+	}
+	return fnmatch(feat, hf->feature, 0) == 0
+		|| (hf->label[0] && fnmatch(feat, hf->label, 0) == 0);
+}
+
+static struct hwmon_feature *hwmon_lookup(const char *name) {
+	unsigned int i = 0;
+
+	if (!hwmon_scanned)
+		scan_hwmon();
+
+	for (i = 0; i < hwmon_count; i++) {
+		if (hwmon_match(&hwmon_features[i], name))
+			return &hwmon_features[i];
+	}
+	return NULL;
+}
+
+static struct sensors_monitor *hwmon_monitor(const struct hwmon_feature *hf) {
+	struct sensors_monitor *list = monitor_list;
+	struct sensors_monitor *ret = NULL;
+
+	/* directives on the same input share the reading */
+	for (; list != NULL; list = list->next) {
+		if (list->attr != NULL
+				&& strcmp(sysfs_attr_path(list->attr), hf->path) == 0)
+			return list;
+	}
+
+	if ((ret = calloc(1, sizeof(struct sensors_monitor))) == NULL) {
+		clog(LOG_ERR, "Couldn't create new sensor monitor for %s (%s)\n",
+				hf->feature, strerror(errno));
+		return NULL;
+	}
+	if ((ret->attr = sysfs_attr_open(hf->path, O_RDONLY)) == NULL
+			|| sysfs_batch_add(hwmon_batch, ret->attr, &ret->raw,
+				&ret->valid) != 0) {
+		sysfs_attr_close(ret->attr);
+		free(ret);
+		return NULL;
+	}
+	snprintf(ret->chip_string, sizeof(ret->chip_string), "%s", hf->chip);
+	snprintf(ret->feat_name, sizeof(ret->feat_name), "%s", hf->feature);
+	ret->scale = hf->scale;
+	clog(LOG_DEBUG, "Creating new sensors_monitor for %s on chip %s\n",
+			hf->feature, hf->chip);
+	ret->next = monitor_list;
+	monitor_list = ret;
+	return ret;
+}
+
+/* hwmon first, libsensors knows about labels set in sensors.conf */
+static struct sensors_monitor *find_monitor(const char *name) {
+	struct hwmon_feature *hf = NULL;
+
+	if (!use_libsensors && (hf = hwmon_lookup(name)) != NULL)
+		return hwmon_monitor(hf);
 
+	if (!init_tried) {
+		init_tried = 1;
+		clog(LOG_INFO, "%s not found in hwmon, trying libsensors\n", name);
+		load_libsensors();
+	}
+	if (!init_success)
+		return NULL;
+	return validate_feature_name(name);
+}
+
+/* groups are shared by the directives using the same pattern and
+ * aggregation, they're only available with the hwmon backend
+ */
+static struct sensor_group *find_group(const char *pattern, int how) {
+	struct sensor_group *group = group_list;
+	struct sensors_monitor *monitor = NULL;
+	unsigned int i = 0;
+
+	for (; group != NULL; group = group->next) {
+		if (group->how == how && strcmp(group->pattern, pattern) == 0)
+			return group;
+	}
+	if (use_libsensors) {
+		clog(LOG_ERR, "%s: groups need the hwmon backend\n", pattern);
+		return NULL;
+	}
+	if (!hwmon_scanned)
+		scan_hwmon();
+
+	if ((group = calloc(1, sizeof(struct sensor_group))) == NULL
+			|| (hwmon_count > 0 && ((group->members = calloc(hwmon_count,
+						sizeof(struct sensors_monitor *))) == NULL
+				|| (group->values = calloc(hwmon_count,
+						sizeof(double))) == NULL))) {
+		clog(LOG_ERR, "couldn't make enough room for a sensor_group (%s)\n",
+				strerror(errno));
+		if (group != NULL) {
+			free(group->members);
+			free(group);
+		}
+		return NULL;
+	}
+	for (i = 0; i < hwmon_count; i++) {
+		if (!hwmon_match(&hwmon_features[i], pattern))
+			continue;
+		if ((monitor = hwmon_monitor(&hwmon_features[i])) != NULL)
+			group->members[group->count++] = monitor;
+	}
+	if (group->count == 0) {
+		clog(LOG_ERR, "no feature matches %s\n", pattern);
+		free(group->members);
+		free(group->values);
+		free(group);
+		return NULL;
+	}
+	snprintf(group->pattern, sizeof(group->pattern), "%s", pattern);
+	group->how = how;
+	clog(LOG_INFO, "%s:%s groups %u features\n", pattern,
+			sensor_aggregate_name(how), group->count);
+	group->next = group_list;
+	group_list = group;
+	return group;
+}
+
+/* parses name:[aggregation:] out of ev, rest points after it */
+static int parse_source(const char *ev, struct sensor_source *src,
+		char *name, const char **rest) {
+	const char *colon = strchr(ev, ':');
+	const char *next = NULL;
+	int how = -1;
+
+	if (colon == NULL || colon == ev || colon - ev >= MAX_STRING_LEN)
+		return -1;
+	memcpy(name, ev, (size_t)(colon - ev));
+	name[colon - ev] = '\0';
+
+	*rest = colon + 1;
+	if ((next = strchr(*rest, ':')) != NULL &&
+			(how = sensor_aggregate_parse(*rest, (size_t)(next - *rest))) >= 0)
+		*rest = next + 1;
+
+	if (how >= 0) {
+		src->group = find_group(name, how);
+		return src->group != NULL ? 0 : -1;
+	}
+	if (strpbrk(name, "*?[") != NULL) {
+		clog(LOG_ERR, "%s: patterns need an aggregation (max, min, avg, p90)\n",
+				name);
+		return -1;
+	}
+	if ((src->monitor = find_monitor(name)) == NULL) {
+		clog(LOG_ERR, "feature \"%s\" does not exist, try 'sensors -u' "
+				"to see a full list of available feature names.\n",
+				name);
+		return -1;
+	}
+	return 0;
+}
+
+static int sensor_parse(const char *ev, void **obj) {
+	const char *range = NULL;
 	struct sensor_object *ret = calloc(1, sizeof(struct sensor_object));
 	if (ret == NULL) {
 		clog(LOG_ERR, "couldn't make enough room for a sensor_object (%s)\n",
@@ -295,40 +743,81 @@ static int sensor_parse(const char *ev, void **obj) {
 
 	clog(LOG_DEBUG, "called with %s\n", ev);
 
-	/* try to parse the %[a-zA-Z0-9]:%d-%d format first */
-	if (sscanf(ev, "%32[a-zA-Z0-9_-% +]:%lf-%lf", ret->name, &ret->min, &ret->max) == 3) {
-		/* validate feature name */
-		if ((ret->monitor = validate_feature_name(ret->name)) != NULL) {
-			clog(LOG_INFO, "parsed %s %.3f-%.3f\n", ret->name, ret->min, ret->max);
-			*obj = ret;
-		}
-		else {
-			clog(LOG_ERR, "feature \"%s\" does not exist, try 'sensors -u' "
-					"to see a full list of available feature names.\n",
-					ret->name);
-			free(ret);
-			return -1;
-		}
-	} else {
+	/* name[:aggregation]:%f-%f */
+	if (parse_source(ev, &ret->src, ret->name, &range) != 0
+			|| sscanf(range, "%lf-%lf", &ret->min, &ret->max) != 2) {
 		free(ret);
 		return -1;
 	}
+	clog(LOG_INFO, "parsed %s %.3f-%.3f\n", ret->name, ret->min, ret->max);
+	*obj = ret;
 
 	return 0;
 }
 
 static int sensor_evaluate(const void *s) {
 	const struct sensor_object *so = (const struct sensor_object *) s;
+	double value = 0.0;
+
+	if (source_value(&so->src, &value) != 0)
+		return DONT_MATCH;
 
 	clog(LOG_DEBUG, "called %.3f-%.3f [%s:%.3f]\n", so->min, so->max,
-			so->name, so->monitor->value);
+			so->name, value);
+
+	return (value >= so->min && value <= so->max) ? MATCH : DONT_MATCH;
+}
+
+static int sensor_target_parse(const char *ev, void **obj) {
+	char name[MAX_STRING_LEN];
+	const char *target = NULL;
+	struct sensor_target *ret = calloc(1, sizeof(struct sensor_target));
+	if (ret == NULL) {
+		clog(LOG_ERR, "couldn't make enough room for a sensor_target (%s)\n",
+				strerror(errno));
+		return -1;
+	}
+
+	clog(LOG_DEBUG, "called with %s\n", ev);
+
+	if (parse_source(ev, &ret->src, name, &target) != 0) {
+		free(ret);
+		return -1;
+	}
+	if ((ret->ctl = thermal_control_parse(target)) == NULL) {
+		free(ret);
+		return -1;
+	}
+	clog(LOG_INFO, "parsed %s %.1f\n", name, thermal_control_target(ret->ctl));
 
-	return (so->monitor->value >= so->min && so->monitor->value <= so->max) ? MATCH : DONT_MATCH;
+	ret->next = targets;
+	targets = ret;
+	*obj = ret;
+	return 0;
 }
 
+static void sensor_target_change(void *obj, const struct cpufreq_policy *old,
+		const struct cpufreq_policy *new, const unsigned int cpu) {
+	thermal_control_activate(((struct sensor_target *)obj)->ctl, old, new, cpu);
+}
+
+static void sensor_target_free(void *obj) {
+	struct sensor_target *st = (struct sensor_target *)obj;
+	struct sensor_target **t = &targets;
+
+	while (*t != NULL && *t != st)
+		t = &(*t)->next;
+	if (*t != NULL)
+		*t = st->next;
+	thermal_control_free(st->ctl);
+	free(st);
+}
 
 static struct cpufreqd_keyword kw[] = {
 	{ .word = "sensor", .parse = &sensor_parse, .evaluate = &sensor_evaluate },
+	{ .word = "sensor_target", .parse = &sensor_target_parse,
+		.profile_post_change = &sensor_target_change,
+		.free = &sensor_target_free },
 	{ .word = NULL, .parse = NULL, .evaluate = NULL, .free = NULL }
 };
 
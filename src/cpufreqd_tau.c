@@ -23,10 +23,12 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "cpufreqd_plugin.h"
+#include "sysfs_utils.h"
 
 #  define CPU_INFO_FILE		"/proc/cpuinfo"
 
@@ -38,15 +40,24 @@ struct temperature_interval tau_temperature;
 
 static char tag[255];
 static char val[255];
+static char cpuinfo_buf[4096];
+static struct sysfs_attr *cpuinfo;
 
-static int tokenize (FILE *fp, char *t, char *v) {
+/* tokenizes the next line off *buf, advancing it */
+static int tokenize (const char **buf, char *t, char *v) {
 	char str[255];
 	char *s1, *s2;
+	size_t len = 0;
 
 	t[0] = v[0] = '\0';
 
-	if (fgets(str, 255, fp) == NULL)
+	if (**buf == '\0')
 		return EOF;
+	len = strcspn(*buf, "\n");
+	snprintf(str, sizeof(str), "%.*s", (int)len, *buf);
+	*buf += len;
+	if (**buf == '\n')
+		(*buf)++;
 
 	if ((s1 = strtok(str, ":")) == NULL)
 		return 0;
@@ -89,46 +100,39 @@ static int tokenize (FILE *fp, char *t, char *v) {
 }
 
 static int tau_init(void) {
-	FILE *fp;
 
-	fp = fopen(CPU_INFO_FILE, "r");
-	if (!fp) {
+	cpuinfo = sysfs_attr_open(CPU_INFO_FILE, O_RDONLY);
+	if (!cpuinfo) {
 		clog(LOG_INFO, "%s: %s\n", CPU_INFO_FILE, strerror(errno));
 		return -1;
 	}
 
-	fclose(fp);
-
 	clog(LOG_NOTICE, "/proc/cpuinfo file found\n");
 
 	return 0;
 }
 
+static int tau_exit(void) {
+	sysfs_attr_close(cpuinfo);
+	cpuinfo = NULL;
+	return 0;
+}
+
 static int tau_update(void) {
 
-	FILE *fp;
+	const char *buf = cpuinfo_buf;
 
-	fp = fopen(CPU_INFO_FILE, "r");
-	if (!fp) {
+	if (sysfs_attr_read(cpuinfo, cpuinfo_buf, sizeof(cpuinfo_buf)) <= 0) {
 		clog(LOG_ERR, "%s: %s\n", CPU_INFO_FILE, strerror(errno));
 		return -1;
 	}
 
-	char str[255];
-
-	if (fgets(str, 255, fp) == NULL){
-	  clog(LOG_INFO,"%s",str);
-	  fclose(fp);
-	  return -1;
-	}
-
-	while (tokenize(fp, tag, val) != EOF) {
+	while (tokenize(&buf, tag, val) != EOF) {
 		if (strcmp(tag, "temperature") == 0) {
 		  int readed;
 		  if (((readed=sscanf(val, "%d-%d", &(tau_temperature.min), &(tau_temperature.max))) < 1)
 		      || (readed >2)) {
 		    clog(LOG_ERR, "wrong temperature value %s\n", val);
-		    fclose(fp);
 		    return -1;
 		  } else if (readed == 1) {
 		    //Temperature is not an interval
@@ -138,7 +142,6 @@ static int tau_update(void) {
 		  break; //Reading more is a waste of time
 		}
 	}
-	fclose(fp);
 
 	return 0;
 }
@@ -184,6 +187,7 @@ static struct cpufreqd_plugin tau = {
 	.plugin_name      = "tau_plugin",	/* plugin_name */
 	.keywords         = kw,			/* config_keywords */
 	.plugin_init      = &tau_init,		/* plugin_init */
+	.plugin_exit      = &tau_exit,		/* plugin_exit */
 	.plugin_update    = &tau_update		/* plugin_update */
 };
 
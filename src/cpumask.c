@@ -0,0 +1,146 @@
+/*
+ *  Copyright (C) 2002-2008  Mattia Dongili <malattia@linux.it>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cpumask.h"
+
+#define BITS_PER_LONG	(8 * sizeof(unsigned long))
+#define WORDS(cpus)	(((cpus) + BITS_PER_LONG - 1) / BITS_PER_LONG)
+#define GROUP_BITS	32	/* bits per comma separated group */
+#define GROUP_LEN	9	/* 8 hex digits and a comma */
+#define HEX_DIGITS	"0123456789abcdefABCDEF"
+
+struct cpumask *cpumask_new(unsigned int cpus) {
+	struct cpumask *ret = calloc(1, sizeof(struct cpumask)
+			+ WORDS(cpus) * sizeof(unsigned long));
+
+	if (ret != NULL)
+		ret->cpus = cpus;
+	return ret;
+}
+
+void cpumask_free(struct cpumask *mask) {
+	free(mask);
+}
+
+void cpumask_zero(struct cpumask *mask) {
+	memset(mask->bits, 0, WORDS(mask->cpus) * sizeof(unsigned long));
+}
+
+void cpumask_set(struct cpumask *mask, unsigned int cpu) {
+	if (cpu < mask->cpus)
+		mask->bits[cpu / BITS_PER_LONG] |= 1UL << (cpu % BITS_PER_LONG);
+}
+
+void cpumask_clear(struct cpumask *mask, unsigned int cpu) {
+	if (cpu < mask->cpus)
+		mask->bits[cpu / BITS_PER_LONG] &= ~(1UL << (cpu % BITS_PER_LONG));
+}
+
+int cpumask_test(const struct cpumask *mask, unsigned int cpu) {
+	return cpu < mask->cpus
+		&& (mask->bits[cpu / BITS_PER_LONG] >> (cpu % BITS_PER_LONG)) & 1UL;
+}
+
+unsigned int cpumask_weight(const struct cpumask *mask) {
+	unsigned int i = 0, ret = 0;
+
+	for (i = 0; i < WORDS(mask->cpus); i++)
+		ret += (unsigned int)__builtin_popcountl(mask->bits[i]);
+	return ret;
+}
+
+int cpumask_next(const struct cpumask *mask, int cpu) {
+	unsigned int start = (unsigned int)(cpu + 1), w = 0;
+	unsigned long word = 0;
+
+	if (cpu < -1 || start >= mask->cpus)
+		return -1;
+	w = start / BITS_PER_LONG;
+	/* skip the bits up to cpu in the first word, then whole words */
+	word = mask->bits[w] & (~0UL << (start % BITS_PER_LONG));
+	while (word == 0) {
+		if (++w >= WORDS(mask->cpus))
+			return -1;
+		word = mask->bits[w];
+	}
+	return (int)(w * BITS_PER_LONG) + __builtin_ctzl(word);
+}
+
+static unsigned int groups(unsigned int cpus) {
+	return cpus > 0 ? (cpus + GROUP_BITS - 1) / GROUP_BITS : 1;
+}
+
+size_t cpumask_strlen(const struct cpumask *mask) {
+	return groups(mask->cpus) * GROUP_LEN;
+}
+
+static unsigned long get_group(const struct cpumask *mask, unsigned int g) {
+	unsigned int bit = g * GROUP_BITS;
+
+	if (bit >= mask->cpus)
+		return 0;
+	return (mask->bits[bit / BITS_PER_LONG] >> (bit % BITS_PER_LONG))
+		& 0xffffffffUL;
+}
+
+int cpumask_print(const struct cpumask *mask, char *buf, size_t len) {
+	unsigned int g = groups(mask->cpus);
+	char *s = buf;
+
+	if (len < cpumask_strlen(mask))
+		return -1;
+	while (g-- > 0) {
+		sprintf(s, "%08lx%s", get_group(mask, g), g > 0 ? "," : "");
+		s += strlen(s);
+	}
+	return (int)(s - buf);
+}
+
+struct cpumask *cpumask_parse(const char *str, const char **end) {
+	struct cpumask *ret = NULL;
+	size_t len = strspn(str, HEX_DIGITS ",");
+	unsigned int count = 1, g = 0, bit = 0;
+	unsigned long value = 0;
+	const char *s = str;
+	char *e = NULL;
+	size_t i = 0;
+
+	if (len == 0)
+		return NULL;
+	for (i = 0; i < len; i++)
+		count += str[i] == ',';
+	if ((ret = cpumask_new(count * GROUP_BITS)) == NULL)
+		return NULL;
+
+	for (g = count; g-- > 0; s = e + 1) {
+		i = strspn(s, HEX_DIGITS);
+		if (i == 0 || i > 8) {
+			cpumask_free(ret);
+			return NULL;
+		}
+		value = strtoul(s, &e, 16);
+		bit = g * GROUP_BITS;
+		ret->bits[bit / BITS_PER_LONG] |= value << (bit % BITS_PER_LONG);
+	}
+	if (end != NULL)
+		*end = str + len;
+	return ret;
+}
@@ -0,0 +1,62 @@
+/*
+ *  Copyright (C) 2002-2008  Mattia Dongili <malattia@linux.it>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __CPUMASK_H__
+#define __CPUMASK_H__ 1
+
+#include <stddef.h>
+
+/*
+ *  A set of CPUs as big as needed, shared by the daemon and the
+ *  clients. Bits are kept in unsigned longs and scanned a word at
+ *  a time.
+ *  The text form is the one the kernel uses for cpu masks: 32 bit
+ *  hex groups separated by commas, most significant first
+ *  (e.g. "00000001,0000ff00" for CPUs 8-15 and 32).
+ */
+struct cpumask {
+	unsigned int cpus;	/* bits */
+	unsigned long bits[];
+};
+
+/* Returns NULL if there's no room */
+struct cpumask *cpumask_new(unsigned int cpus);
+void cpumask_free(struct cpumask *mask);
+
+void cpumask_zero(struct cpumask *mask);
+void cpumask_set(struct cpumask *mask, unsigned int cpu);
+void cpumask_clear(struct cpumask *mask, unsigned int cpu);
+int cpumask_test(const struct cpumask *mask, unsigned int cpu);
+unsigned int cpumask_weight(const struct cpumask *mask);
+
+/* Returns the first cpu set after cpu (-1 to start), -1 when done */
+int cpumask_next(const struct cpumask *mask, int cpu);
+#define cpumask_for_each(cpu, mask) \
+	for ((cpu) = cpumask_next((mask), -1); (cpu) >= 0; \
+			(cpu) = cpumask_next((mask), (cpu)))
+
+/* Returns the room needed by the text form, terminator included */
+size_t cpumask_strlen(const struct cpumask *mask);
+/* Returns the string length or -1 if len is too short */
+int cpumask_print(const struct cpumask *mask, char *buf, size_t len);
+/* Returns NULL if str is not a mask (the rest of the line
+ * is left to the caller through end, can be NULL).
+ */
+struct cpumask *cpumask_parse(const char *str, const char **end);
+
+#endif
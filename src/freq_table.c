@@ -0,0 +1,102 @@
+/*
+ *  Copyright (C) 2002-2008  Mattia Dongili <malattia@linux.it>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include "freq_table.h"
+
+static int compare_freq(const void *a, const void *b) {
+	unsigned long fa = *(const unsigned long *)a;
+	unsigned long fb = *(const unsigned long *)b;
+	return fa < fb ? -1 : fa > fb;
+}
+
+struct freq_table *freq_table_new(const struct cpufreq_available_frequencies *freqs) {
+	const struct cpufreq_available_frequencies *f = NULL;
+	struct freq_table *ret = NULL;
+	unsigned int count = 0, i = 0;
+
+	for (f = freqs; f != NULL; f = f->next)
+		count++;
+	if (count == 0)
+		return NULL;
+	ret = malloc(sizeof(struct freq_table) + count * sizeof(unsigned long));
+	if (ret == NULL)
+		return NULL;
+	for (f = freqs; f != NULL; f = f->next)
+		ret->freq[i++] = f->frequency;
+	qsort(ret->freq, count, sizeof(unsigned long), &compare_freq);
+
+	/* drop duplicates */
+	ret->count = 1;
+	for (i = 1; i < count; i++) {
+		if (ret->freq[i] != ret->freq[ret->count - 1])
+			ret->freq[ret->count++] = ret->freq[i];
+	}
+	ret->refs = 1;
+	return ret;
+}
+
+struct freq_table *freq_table_get(struct freq_table *table) {
+	if (table != NULL)
+		table->refs++;
+	return table;
+}
+
+void freq_table_put(struct freq_table *table) {
+	if (table != NULL && --table->refs == 0)
+		free(table);
+}
+
+unsigned int freq_table_index(const struct freq_table *table, unsigned long freq) {
+	unsigned int lo = 0, hi = table->count, mid = 0;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (table->freq[mid] < freq)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+unsigned long freq_table_ceil(const struct freq_table *table, unsigned long freq) {
+	unsigned int i = freq_table_index(table, freq);
+	return i < table->count ? table->freq[i] : freq_table_max(table);
+}
+
+unsigned long freq_table_floor(const struct freq_table *table, unsigned long freq) {
+	unsigned int i = freq_table_index(table, freq);
+
+	if (i < table->count && table->freq[i] == freq)
+		return freq;
+	return i > 0 ? table->freq[i - 1] : freq_table_min(table);
+}
+
+unsigned long freq_table_nearest(const struct freq_table *table, unsigned long freq) {
+	unsigned int i = freq_table_index(table, freq);
+	unsigned long higher = 0, lower = 0;
+
+	if (i == 0)
+		return freq_table_min(table);
+	if (i == table->count)
+		return freq_table_max(table);
+	higher = table->freq[i];
+	lower = table->freq[i - 1];
+	return freq - lower >= higher - freq ? higher : lower;
+}
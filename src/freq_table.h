@@ -0,0 +1,52 @@
+/*
+ *  Copyright (C) 2002-2008  Mattia Dongili <malattia@linux.it>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __FREQ_TABLE_H__
+#define __FREQ_TABLE_H__ 1
+
+#include <cpufreq.h>
+
+/*
+ *  The available frequencies of a cpufreq policy, sorted once so that
+ *  they can be searched rather than walked. The cpus of a policy share
+ *  the same table (see cpufreq_sys_info), hence the reference count.
+ */
+struct freq_table {
+	unsigned int refs;
+	unsigned int count;
+	unsigned long freq[];	/* ascending, no duplicates */
+};
+
+/* Returns NULL if there are no frequencies or no room */
+struct freq_table *freq_table_new(const struct cpufreq_available_frequencies *freqs);
+struct freq_table *freq_table_get(struct freq_table *table);
+void freq_table_put(struct freq_table *table);
+
+/* index of the lowest frequency >= freq, count if there is none */
+unsigned int freq_table_index(const struct freq_table *table, unsigned long freq);
+/* the lowest frequency >= freq, the highest if there is none */
+unsigned long freq_table_ceil(const struct freq_table *table, unsigned long freq);
+/* the highest frequency <= freq, the lowest if there is none */
+unsigned long freq_table_floor(const struct freq_table *table, unsigned long freq);
+/* the closest frequency, the higher one if freq is half way */
+unsigned long freq_table_nearest(const struct freq_table *table, unsigned long freq);
+
+#define freq_table_min(table)	((table)->freq[0])
+#define freq_table_max(table)	((table)->freq[(table)->count - 1])
+
+#endif
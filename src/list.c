@@ -108,3 +108,27 @@ void list_append(struct LIST *l, struct NODE *n) {
 		l->last = n;
 	}
 }
+
+/* puts n at its own place in l, fixing its neighbours */
+static void list_relink(struct LIST *l, struct NODE *n) {
+	if (n->prev)
+		n->prev->next = n;
+	else
+		l->first = n;
+	if (n->next)
+		n->next->prev = n;
+	else
+		l->last = n;
+}
+
+void list_swap_nodes(struct LIST *l1, struct NODE *n1,
+		struct LIST *l2, struct NODE *n2) {
+	struct NODE *prev = n1->prev, *next = n1->next;
+
+	n1->prev = n2->prev;
+	n1->next = n2->next;
+	n2->prev = prev;
+	n2->next = next;
+	list_relink(l1, n2);
+	list_relink(l2, n1);
+}
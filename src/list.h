@@ -85,4 +85,11 @@ extern void node_free(struct NODE *n);
  */
 extern void list_append(struct LIST *l, struct NODE *n);
 
+/*
+ * Exchanges n1 of l1 with n2 of l2, each one taking the
+ * place of the other. l1 and l2 must be different lists.
+ */
+extern void list_swap_nodes(struct LIST *l1, struct NODE *n1,
+		struct LIST *l2, struct NODE *n2);
+
 #endif
@@ -34,6 +34,8 @@
 #include <time.h>
 #include <unistd.h>
 #include "config_parser.h"
+#include "cpu_hotplug.h"
+#include "cpumask.h"
 #include "cpufreq_utils.h"
 #include "cpufreqd.h"
 #include "cpufreqd_log.h"
@@ -42,7 +44,11 @@
 #include "daemon_utils.h"
 #include "list.h"
 #include "plugin_utils.h"
+#include "ramp.h"
+#include "sampler.h"
 #include "sock_utils.h"
+#include "state.h"
+#include "uevent.h"
 
 #define TRIGGER_RULE_EVENT(event_func, directives, dir, old, new) \
 do { \
@@ -67,7 +73,9 @@ do { \
 } while (0);
 
 static struct rule *current_rule;
+static struct profile *manual_profile; /* set from remote */
 static int force_reinit = 0;
+static int force_reload = 0;
 static int force_exit = 0;
 static int timer_expired = 1; /* expired in order to run on the first loop */
 
@@ -122,6 +130,124 @@ static struct rule *update_rule_scores(struct LIST *rule_list) {
 	return ret;
 }
 
+/*
+ * writes the new_profile policy for cpu and triggers the post change event
+ *
+ * Returns always 0 (success) except if double checking is enabled and setting
+ * the policy fails in which case -1 is returned.
+ */
+static int cpufreqd_apply_cpu_profile (unsigned int cpu, struct profile *old_profile,
+		struct profile *new_profile) {
+	struct directive *d;
+
+	/* don't even try to set the profile if it hasn't changed */
+	if (new_profile == old_profile) {
+		clog(LOG_DEBUG, "Profile unchanged (\"%s\"-\"%s\"), for CPU%d doing nothing.\n",
+				old_profile->name, new_profile->name, cpu);
+	}
+	/* int cpufreq_set_policy(unsigned int cpu, struct cpufreq_policy *policy) */
+	else if (cpufreq_set_policy(cpu, &(new_profile->policy)) == 0) {
+		clog(LOG_NOTICE, "Profile \"%s\" set for CPU%d\n", new_profile->name, cpu);
+		cpufreqd_info->current_profiles[cpu] = new_profile;
+
+		/* double check if everything is OK (configurable) */
+		if (configuration->double_check) {
+			struct cpufreq_policy *check = NULL;
+			check = cpufreq_get_policy(cpu);
+			if (check->max != new_profile->policy.max
+					|| check->min != new_profile->policy.min
+					|| strcmp(check->governor, new_profile->policy.governor) != 0) {
+				/* written policy and subsequent read disagree */
+				clog(LOG_ERR, "I haven't been able to set the chosen policy "
+						"for CPU%d.\n"
+						"I set %d-%d-%s\n"
+						"System says %d-%d-%s\n",
+						cpu, new_profile->policy.max, new_profile->policy.min,
+						new_profile->policy.governor, check->max,
+						check->min, check->governor);
+				cpufreq_put_policy(check);
+				return -1;
+			} else {
+				clog(LOG_INFO, "Policy correctly set %d-%d-%s\n",
+						new_profile->policy.max,
+						new_profile->policy.min,
+						new_profile->policy.governor);
+			}
+			cpufreq_put_policy(check);
+		} /* end if double_check */
+	}
+	/* went away in the meantime, not an error */
+	else if (!cpu_hotplug_check(cpu)) {
+		clog(LOG_INFO, "CPU%d went offline while setting profile \"%s\"\n",
+				cpu, new_profile->name);
+		return 0;
+	}
+	else {
+		clog(LOG_WARNING, "Couldn't set profile \"%s\" set for cpu%d (%d-%d-%s)\n",
+				new_profile->name, cpu, new_profile->policy.max,
+				new_profile->policy.min, new_profile->policy.governor);
+		return -1;
+	}
+
+	/* profile postchange event */
+	if (new_profile->directives.first) {
+		TRIGGER_PROFILE_EVENT(profile_post_change, &new_profile->directives, d,
+				old_profile != NULL ? &old_profile->policy : NULL,
+				&new_profile->policy, cpu);
+	}
+	return 0;
+}
+
+/*
+ * sets new_profile for cpu, old_profile is the one being replaced (NULL
+ * if unknown)
+ *
+ * Returns always 0 (success) except if double checking is enabled and setting
+ * the policy fails in which case -1 is returned.
+ */
+static int cpufreqd_set_cpu_profile (unsigned int cpu, struct profile *old_profile,
+		struct profile *new_profile) {
+	struct directive *d;
+
+	/* parked or unplugged, will be set when it comes back */
+	if (!cpufreqd_info->online[cpu]) {
+		clog(LOG_DEBUG, "CPU%d is offline, doing nothing.\n", cpu);
+		return 0;
+	}
+
+	/* profile prechange event */
+	if (new_profile->directives.first) {
+		TRIGGER_PROFILE_EVENT(profile_pre_change, &new_profile->directives, d,
+				old_profile != NULL ? &old_profile->policy : NULL,
+				&new_profile->policy, cpu);
+	}
+
+	/* stepping through the frequencies in between, the profile is
+	 * applied when the ramp is done
+	 */
+	if (new_profile != old_profile && ramp_start(cpu, old_profile, new_profile))
+		return 0;
+
+	return cpufreqd_apply_cpu_profile(cpu, old_profile, new_profile);
+}
+
+/*
+ * ramp handler, the last step (or a failed one) sets the profile
+ */
+static void cpufreqd_ramp_done (unsigned int cpu, struct profile *old,
+		struct profile *new) {
+	/* ramped back to where it started from, the policy must be
+	 * written anyway
+	 */
+	if (cpufreqd_apply_cpu_profile(cpu, old != new ? old : NULL, new) < 0) {
+		/* the cpu has no Profile now, have the next poll set the
+		 * Rule again
+		 */
+		clog(LOG_ERR, "Cannot set policy for CPU%d.\n", cpu);
+		current_rule = NULL;
+	}
+}
+
 /*
  * sets the policy
  * new is never NULL
@@ -131,79 +257,75 @@ static struct rule *update_rule_scores(struct LIST *rule_list) {
  */
 static int cpufreqd_set_profile (struct profile **old, struct profile **new) {
 	unsigned int i;
-	struct directive *d;
-	struct profile *old_profile = NULL;
-	struct profile *new_profile = NULL;
 
 	for (i = 0; i < cpufreqd_info->cpus; i++) {
-		new_profile = new[i];
-
-		if (new_profile == NULL) {
+		if (new[i] == NULL) {
 			clog(LOG_DEBUG, "No Profile available for CPU%d doing nothing.\n", i);
 			continue;
 		}
+		if (cpufreqd_set_cpu_profile(i, old != NULL ? old[i] : NULL, new[i]) < 0)
+			return -1;
+	}
+	return 0;
+}
 
-		if (old != NULL)
-			old_profile = old[i];
-
-		/* profile prechange event */
-		if (new_profile->directives.first) {
-			TRIGGER_PROFILE_EVENT(profile_pre_change, &new_profile->directives, d,
-					old_profile != NULL ? &old_profile->policy : NULL,
-					&new_profile->policy, i);
+/*
+ * (re)builds the sorted frequency table of cpu, shared with the other
+ * cpus of its policy
+ */
+static void cpufreqd_freq_table (unsigned int cpu) {
+	struct cpufreq_sys_info *info = cpufreqd_info->sys_info;
+	struct cpufreq_affected_cpus *a = NULL;
+
+	freq_table_put(info[cpu].table);
+	info[cpu].table = NULL;
+	for (a = info[cpu].affected_cpus; a != NULL; a = a->next) {
+		if (a->cpu != cpu && a->cpu < cpufreqd_info->cpus
+				&& info[a->cpu].table != NULL) {
+			info[cpu].table = freq_table_get(info[a->cpu].table);
+			return;
 		}
+	}
+	info[cpu].table = freq_table_new(info[cpu].frequencies);
+}
 
-		/* don't even try to set the profile if it hasn't changed */
-		if (new_profile == old_profile) {
-			clog(LOG_DEBUG, "Profile unchanged (\"%s\"-\"%s\"), for CPU%d doing nothing.\n",
-					old_profile->name, new_profile->name, i);
-		}
-		/* int cpufreq_set_policy(unsigned int cpu, struct cpufreq_policy *policy) */
-		else if (cpufreq_set_policy(i, &(new_profile->policy)) == 0) {
-			clog(LOG_NOTICE, "Profile \"%s\" set for CPU%d\n", new_profile->name, i);
-			cpufreqd_info->current_profiles[i] = new_profile;
-
-			/* double check if everything is OK (configurable) */
-			if (configuration->double_check) {
-				struct cpufreq_policy *check = NULL;
-				check = cpufreq_get_policy(i);
-				if (check->max != new_profile->policy.max
-						|| check->min != new_profile->policy.min
-						|| strcmp(check->governor, new_profile->policy.governor) != 0) {
-					/* written policy and subsequent read disagree */
-					clog(LOG_ERR, "I haven't been able to set the chosen policy "
-							"for CPU%d.\n"
-							"I set %d-%d-%s\n"
-							"System says %d-%d-%s\n",
-							i, new_profile->policy.max, new_profile->policy.min,
-							new_profile->policy.governor, check->max,
-							check->min, check->governor);
-					cpufreq_put_policy(check);
-					return -1;
-				} else {
-					clog(LOG_INFO, "Policy correctly set %d-%d-%s\n",
-							new_profile->policy.max,
-							new_profile->policy.min,
-							new_profile->policy.governor);
-				}
-				cpufreq_put_policy(check);
-			} /* end if double_check */
-		}
-		else {
-			clog(LOG_WARNING, "Couldn't set profile \"%s\" set for cpu%d (%d-%d-%s)\n",
-					new_profile->name, i, new_profile->policy.max,
-					new_profile->policy.min, new_profile->policy.governor);
-			return -1;
-		}
+/*
+ * cpu hotplug handler, sets the profile the cpu should have when it comes
+ * back: the current Rule one or the one set manually.
+ */
+static void cpufreqd_cpu_hotplug (unsigned int cpu, int online) {
+	struct cpufreq_sys_info *info = cpufreqd_info->sys_info + cpu;
+	struct cpufreq_limits *lim = NULL;
+	struct profile *p = NULL;
+
+	if (!online) {
+		/* plugins let go of what they hold for the profile there */
+		cpufreqd_info->current_profiles[cpu] = NULL;
+		ramp_cancel(cpu);
+		return;
+	}
 
-		/* profile postchange event */
-		if (new_profile->directives.first) {
-			TRIGGER_PROFILE_EVENT(profile_post_change, &new_profile->directives, d,
-					old != NULL ? &old_profile->policy : NULL,
-					&new_profile->policy, i);
-		}
+	/* cpufreq interface is created anew */
+	if (info->governors != NULL)
+		cpufreq_put_available_governors(info->governors);
+	if (info->affected_cpus != NULL)
+		cpufreq_put_affected_cpus(info->affected_cpus);
+	if (info->frequencies != NULL)
+		cpufreq_put_available_frequencies(info->frequencies);
+	info->affected_cpus = cpufreq_get_affected_cpus(cpu);
+	info->governors = cpufreq_get_available_governors(cpu);
+	info->frequencies = cpufreq_get_available_frequencies(cpu);
+	cpufreqd_freq_table(cpu);
+	if (cpufreqd_info->limits != NULL) {
+		lim = cpufreqd_info->limits + cpu;
+		if (cpufreq_get_hardware_limits(cpu, &lim->min, &lim->max) == 0)
+			clog(LOG_INFO, "Limits for cpu%d: MIN=%lu - MAX=%lu\n", cpu,
+					lim->min, lim->max);
 	}
-	return 0;
+
+	p = current_rule != NULL ? current_rule->prof[cpu] : manual_profile;
+	if (p != NULL && cpufreqd_set_cpu_profile(cpu, NULL, p) < 0)
+		clog(LOG_ERR, "Cannot set policy for CPU%d.\n", cpu);
 }
 
 static int set_cpufreqd_runmode(int mode) {
@@ -235,6 +357,164 @@ static int set_cpufreqd_runmode(int mode) {
 	return 0;
 }
 
+/*
+ * finds p, or the Profile replacing it, in the configuration
+ */
+static struct profile *find_profile(struct profile *p) {
+	struct profile *tmp = NULL;
+
+	if (p == NULL)
+		return NULL;
+	LIST_FOREACH_NODE(node, &configuration->profiles) {
+		tmp = (struct profile *) node->content;
+		if (tmp == p || strcmp(tmp->name, p->name) == 0)
+			return tmp;
+	}
+	return NULL;
+}
+
+/*
+ * finds r, or the Rule replacing it, in the configuration
+ */
+static struct rule *find_rule(struct rule *r) {
+	struct rule *tmp = NULL;
+
+	if (r == NULL)
+		return NULL;
+	LIST_FOREACH_NODE(node, &configuration->rules) {
+		tmp = (struct rule *) node->content;
+		if (tmp == r || strcmp(tmp->name, r->name) == 0)
+			return tmp;
+	}
+	return NULL;
+}
+
+/*
+ * reads the configuration file again and switches to it, unchanged Rules
+ * and Profiles are kept with their plugin objects. The current
+ * configuration stays if the new one isn't valid.
+ */
+static void cpufreqd_reload (void) {
+	struct cpufreqd_conf *new = NULL;
+	struct profile **target = NULL, *p = NULL;
+	unsigned int i = 0;
+
+	target = calloc(cpufreqd_info->cpus, sizeof(struct profile *));
+	if (target == NULL) {
+		clog(LOG_ERR, "Unable to allocate memory (%s), configuration "
+				"unchanged.\n", strerror(errno));
+		return;
+	}
+	new = reload_configuration(configuration);
+	if (new == NULL) {
+		clog(LOG_ERR, "Unable to parse config file: %s, configuration "
+				"unchanged.\n", configuration->config_file);
+		free(target);
+		return;
+	}
+
+	/* ramps hold Profiles that might go away */
+	ramp_exit();
+	swap_configuration(configuration, new);
+
+	/* what the cpus should have now, by name if replaced */
+	current_rule = find_rule(current_rule);
+	manual_profile = find_profile(manual_profile);
+	for (i = 0; i < cpufreqd_info->cpus; i++) {
+		p = cpufreqd_info->current_profiles[i];
+		if (current_rule != NULL)
+			target[i] = current_rule->prof[i];
+		else if (cpufreqd_info->cpufreqd_mode == MODE_MANUAL)
+			target[i] = manual_profile;
+		if (target[i] == NULL)
+			target[i] = find_profile(p);
+		/* replaced, plugins let go of what they hold for it */
+		if (p != NULL && find_profile(p) != p)
+			cpufreqd_info->current_profiles[i] = NULL;
+	}
+	discard_configuration(new);
+
+	if (ramp_init(configuration->ramp_interval, configuration->ramp_step,
+				&cpufreqd_ramp_done) < 0)
+		clog(LOG_ERR, "Unable to ramp Profile changes.\n");
+
+	for (i = 0; i < cpufreqd_info->cpus; i++) {
+		if (target[i] == NULL || target[i] == cpufreqd_info->current_profiles[i])
+			continue;
+		if (cpufreqd_set_cpu_profile(i, NULL, target[i]) < 0)
+			clog(LOG_ERR, "Cannot set policy for CPU%d.\n", i);
+	}
+	free(target);
+
+	/* new poll_interval, and the Rules are evaluated right away */
+	if (cpufreqd_info->cpufreqd_mode == MODE_DYNAMIC)
+		set_cpufreqd_runmode(MODE_DYNAMIC);
+	clog(LOG_NOTICE, "Configuration reloaded.\n");
+}
+
+/*
+ * warm start, adopts the Profiles the state file says are set if the
+ * policy is still what they want (without writing it again) and the
+ * Rule if all its Profiles are in place
+ */
+static void cpufreqd_warm_start (void) {
+	struct cpufreqd_state *st = NULL;
+	struct cpufreq_policy *policy = NULL;
+	struct profile *p = NULL;
+	struct rule *r = NULL;
+	struct directive *d = NULL;
+	unsigned int i = 0;
+
+	if ((st = state_load(configuration)) == NULL)
+		return;
+
+	for (i = 0; i < cpufreqd_info->cpus; i++) {
+		if (!cpufreqd_info->online[i] || !st->profiles[i][0])
+			continue;
+		p = NULL;
+		LIST_FOREACH_NODE(node, &configuration->profiles) {
+			if (strcmp(((struct profile *) node->content)->name,
+						st->profiles[i]) == 0) {
+				p = (struct profile *) node->content;
+				break;
+			}
+		}
+		if (p == NULL || (policy = cpufreq_get_policy(i)) == NULL)
+			continue;
+		if (policy->min == p->policy.min && policy->max == p->policy.max
+				&& strcmp(policy->governor, p->policy.governor) == 0) {
+			clog(LOG_NOTICE, "Profile \"%s\" already set for CPU%d\n",
+					p->name, i);
+			cpufreqd_info->current_profiles[i] = p;
+			/* plugins take hold of it as usual */
+			if (p->directives.first) {
+				cpufreqd_info->adopting = 1;
+				TRIGGER_PROFILE_EVENT(profile_post_change, &p->directives,
+						d, NULL, &p->policy, i);
+				cpufreqd_info->adopting = 0;
+			}
+		}
+		cpufreq_put_policy(policy);
+	}
+
+	LIST_FOREACH_NODE(node, &configuration->rules) {
+		if (strcmp(((struct rule *) node->content)->name, st->rule) == 0) {
+			r = (struct rule *) node->content;
+			break;
+		}
+	}
+	for (i = 0; r != NULL && i < cpufreqd_info->cpus; i++) {
+		if (cpufreqd_info->online[i] && r->prof[i] != NULL
+				&& r->prof[i] != cpufreqd_info->current_profiles[i])
+			r = NULL;
+	}
+	if (r != NULL && cpufreqd_info->cpufreqd_mode == MODE_DYNAMIC) {
+		clog(LOG_NOTICE, "Rule \"%s\" already applied\n", r->name);
+		current_rule = r;
+	}
+	state_free(st);
+}
+
 /*  int read_args (int argc, char *argv[])
  *  Reads command line arguments
  */
@@ -330,12 +610,8 @@ static void alarm_handler(int signo) {
 }
 
 static void hup_handler(int signo) {
-#if 0
 	clog(LOG_NOTICE, "Caught HUP signal (%s), reloading configuration file.\n", strsignal(signo));
-	force_reinit = 1;
-#else
-	clog(LOG_WARNING, "Caught HUP signal (%s), ignored.\n", strsignal(signo));
-#endif
+	force_reload = 1;
 }
 
 static void pipe_handler(int signo) {
@@ -437,8 +713,10 @@ static void execute_command(int sock, struct cpufreqd_conf *conf) {
 	struct pollfd fds;
 	char buf[MAX_STRING_LEN];
 	int buflen = 0;
-	unsigned int counter = 0, i = 0, cpus = 0;
+	unsigned int counter = 0, i = 0;
 	struct profile *p = NULL, **pp = NULL;
+	struct cpumask *cpus = NULL;
+	char *mask = NULL;
 	uint32_t command = INVALID_CMD;
 
 	/* we have a valid sock, wait for command
@@ -472,31 +750,42 @@ static void execute_command(int sock, struct cpufreqd_conf *conf) {
 				break;
 			case CMD_LIST_PROFILES:
 				clog(LOG_DEBUG, "CMD_LIST_PROFILES\n");
+				cpus = cpumask_new(cpufreqd_info->cpus);
+				if (cpus == NULL || (mask = malloc(cpumask_strlen(cpus))) == NULL) {
+					clog(LOG_ERR, "Couldn't allocate enough memory "
+							"to list profiles\n");
+					cpumask_free(cpus);
+					break;
+				}
 				LIST_FOREACH_NODE(node, &conf->profiles) {
 					p = (struct profile *) node->content;
 					/* FIXME: the current profile is not checked
 					 * as it may well be different from each cpu.
 					 * See command CMD_CUR_PROFILES.
 					 */
-					cpus = 0;
+					cpumask_zero(cpus);
 					for (i = 0; i < cpufreqd_info->cpus; i++) {
 						if (cpufreqd_info->current_profiles[i] == p)
-							cpus |= (1 << i);
+							cpumask_set(cpus, i);
 					}
 					/* format is:
-					 * 1 cpu applied bitmask
+					 * 1 cpu applied mask (as in cpumask.h, it
+					 *   grows with the number of cpus)
 					 * 2 profile name
 					 * 3 min freq
 					 * 4 max freq
 					 * 5 active governor
 					 */
-					buflen = snprintf(buf, MAX_STRING_LEN, "%d/%s/%lu/%lu/%s\n",
-							cpus,
+					cpumask_print(cpus, mask, cpumask_strlen(cpus));
+					write(sock, mask, strlen(mask));
+					buflen = snprintf(buf, MAX_STRING_LEN, "/%s/%lu/%lu/%s\n",
 							p->name,
 							p->policy.min, p->policy.max,
 							p->policy.governor);
 					write(sock, buf, (size_t)buflen);
 				}
+				free(mask);
+				cpumask_free(cpus);
 				break;
 			case CMD_CUR_PROFILES:
 				clog(LOG_DEBUG, "CMD_CUR_PROFILES\n");
@@ -562,6 +851,7 @@ static void execute_command(int sock, struct cpufreqd_conf *conf) {
 
 						cpufreqd_set_profile(NULL, pp);
 						free(pp);
+						manual_profile = p;
 
 						/* reset the current rule to let
 						 * the cpufreqd_loop set the correct
@@ -594,8 +884,10 @@ int main (int argc, char *argv[]) {
 	struct sigaction signal_action;
 	sigset_t old_sigmask;
 	fd_set rfds;
+	struct timespec sampler_ts;
 	unsigned int i = 0;
 	int cpufreqd_sock = -1, peer_sock = -1; /* input pipe */
+	int max_fd = -1, ready = 0;
 	char dirname[MAX_PATH_LEN];
 	int ret = 0;
 
@@ -654,9 +946,17 @@ int main (int argc, char *argv[]) {
 	sigaction(SIGPIPE, &signal_action, 0);
 
 	/*
-	 *  read how many cpus are available here
+	 *  read how many cpus there can be here, offline ones included
 	 */
-	cpufreqd_info->cpus = get_cpu_num();
+	cpufreqd_info->cpus = get_possible_cpu_num();
+	cpufreqd_info->online = (unsigned char *) calloc(1, cpufreqd_info->cpus * sizeof(unsigned char));
+	if (cpufreqd_info->online == NULL) {
+		clog(LOG_CRIT, "Unable to allocate memory (%s), exiting.\n", strerror(errno));
+		ret = ENOMEM;
+		goto out;
+	}
+	for (i = 0; i < cpufreqd_info->cpus; i++)
+		cpufreqd_info->online[i] = (unsigned char) cpu_is_online(i);
 
 	/*
 	 *  find cpufreq information about each cpu
@@ -671,6 +971,7 @@ int main (int argc, char *argv[]) {
 		(cpufreqd_info->sys_info+i)->affected_cpus = cpufreq_get_affected_cpus(i);
 		(cpufreqd_info->sys_info+i)->governors = cpufreq_get_available_governors(i);
 		(cpufreqd_info->sys_info+i)->frequencies = cpufreq_get_available_frequencies(i);
+		cpufreqd_freq_table(i);
 	}
 	/*
 	 * per-cpu profiles
@@ -691,8 +992,12 @@ int main (int argc, char *argv[]) {
 		goto out;
 	}
 	for (i = 0; i < cpufreqd_info->cpus; i++) {
-		/* if one of the probes fails remove all the others also */
+		/* if one of the probes fails remove all the others also,
+		 * offline cpus are probed when they come back
+		 */
 		struct cpufreq_limits *tmp_lim = cpufreqd_info->limits+i;
+		if (!cpufreqd_info->online[i])
+			continue;
 		if (cpufreq_get_hardware_limits(i, &tmp_lim->min, &tmp_lim->max) != 0) {
 			/* TODO: if libcpufreq fails try to read /proc/cpuinfo
 			 * and warn about this not being reliable
@@ -716,6 +1021,10 @@ int main (int argc, char *argv[]) {
 		goto out;
 	}
 
+	/* track cpus going offline and coming back */
+	uevent_init();
+	cpu_hotplug_init(&cpufreqd_cpu_hotplug);
+
 cpufreqd_start:
 
 	if (init_configuration(configuration) < 0) {
@@ -724,6 +1033,12 @@ cpufreqd_start:
 		goto out_config_read;
 	}
 
+	if (ramp_init(configuration->ramp_interval, configuration->ramp_step,
+				&cpufreqd_ramp_done) < 0) {
+		ret = ENOMEM;
+		goto out_config_read;
+	}
+
 	/* setup UNIX socket if necessary */
 	if (configuration->enable_remote) {
 		dirname[0] = '\0';
@@ -756,7 +1071,7 @@ cpufreqd_start:
 		goto out_socket;
 	}
 
-	/* if we are going to pselect the socket
+	/* we are going to pselect the socket and the uevents
 	 * then block all signals to avoid races,
 	 * will be unblocked by pselect
 	 *
@@ -767,22 +1082,33 @@ cpufreqd_start:
 	 *       setitimer and pselect is as short as possible, but...)
 	 *
 	 */
-	if (cpufreqd_sock > 0) {
-		sigemptyset(&signal_action.sa_mask);
-		sigaddset(&signal_action.sa_mask, SIGALRM);
-		sigprocmask(SIG_BLOCK, &signal_action.sa_mask, &old_sigmask);
-	}
-	/* otherwise if for any reason the control socket is closed
+	sigemptyset(&signal_action.sa_mask);
+	sigaddset(&signal_action.sa_mask, SIGALRM);
+	sigprocmask(SIG_BLOCK, &signal_action.sa_mask, &old_sigmask);
+
+	/* if for any reason the control socket is closed
 	 * force cpufreqd_mode to dynamic and move on
 	 */
-	else
+	if (cpufreqd_sock <= 0)
 		cpufreqd_info->cpufreqd_mode = MODE_DYNAMIC;
 
+	cpufreqd_warm_start();
 	set_cpufreqd_runmode(cpufreqd_info->cpufreqd_mode);
 	/*
 	 *  Looooooooop
 	 */
 	while (!force_exit && !force_reinit) {
+		/* between two ticks, nothing holds Rules or Profiles */
+		if (force_reload) {
+			force_reload = 0;
+			cpufreqd_reload();
+		}
+		/* uevents only force a Rule pass if a handler asks */
+		if (uevent_read())
+			timer_expired = 1;
+		cpu_hotplug_update();
+		sampler_run();
+
 		/*
 		 * Run the system scan and rule selection and set timer
 		 * if running in DYNAMIC mode AND the timer is expired
@@ -792,48 +1118,54 @@ cpufreqd_start:
 			/* can safely reset the expired flag now */
 			timer_expired = 0;
 		}
+		state_update(configuration, current_rule);
 
-		/* if the socket opened successfully */
-		if (cpufreqd_sock > 0) {
-			/* wait for a command */
+		/* wait for a command, a uevent, a sampler or SIGALRM */
+		if (!timer_expired || cpufreqd_info->cpufreqd_mode == MODE_MANUAL) {
 			FD_ZERO(&rfds);
-			FD_SET(cpufreqd_sock, &rfds);
+			max_fd = -1;
+			if (cpufreqd_sock > 0) {
+				FD_SET(cpufreqd_sock, &rfds);
+				max_fd = cpufreqd_sock;
+			}
+			if (uevent_fd() != -1) {
+				FD_SET(uevent_fd(), &rfds);
+				if (uevent_fd() > max_fd)
+					max_fd = uevent_fd();
+			}
 
-			if (!timer_expired || cpufreqd_info->cpufreqd_mode == MODE_MANUAL) {
-				switch (pselect(cpufreqd_sock+1, &rfds, NULL, NULL, NULL, &old_sigmask)) {
-					case 0:
-						/* timed out. check to see if things have changed */
-						/* will never happen actually... */
-						break;
-					case -1:
-						/* caused by SIGALARM (mostly) log if not so */
-						if (errno != EINTR)
-							clog(LOG_NOTICE, "pselect(): %s.\n", strerror(errno));
-						break;
-					case 1:
-						/* somebody tried to contact us. see what he wants */
-						peer_sock = accept(cpufreqd_sock, NULL, 0);
-						if (peer_sock == -1) {
-							clog(LOG_ALERT, "Unable to accept connection: "
-									" %s\n", strerror(errno));
-						}
-						execute_command(peer_sock, configuration);
-						close(peer_sock);
-						peer_sock = -1;
-						break;
-					default:
-						clog(LOG_ALERT, "pselect(): Internal error caught.\n");
+			ready = pselect(max_fd + 1, &rfds, NULL, NULL,
+					sampler_timeout(&sampler_ts), &old_sigmask);
+			switch (ready) {
+				case 0:
+					/* timed out, a sampler is due */
+					break;
+				case -1:
+					/* caused by SIGALARM (mostly) log if not so */
+					if (errno != EINTR)
+						clog(LOG_NOTICE, "pselect(): %s.\n", strerror(errno));
+					break;
+				default:
+					/* uevents are drained at the next round */
+					if (cpufreqd_sock <= 0 || !FD_ISSET(cpufreqd_sock, &rfds))
 						break;
-				}
+					/* somebody tried to contact us. see what he wants */
+					peer_sock = accept(cpufreqd_sock, NULL, 0);
+					if (peer_sock == -1) {
+						clog(LOG_ALERT, "Unable to accept connection: "
+								" %s\n", strerror(errno));
+					}
+					execute_command(peer_sock, configuration);
+					close(peer_sock);
+					peer_sock = -1;
+					break;
 			}
 		}
-		/* paranoid check for timer expiration
-		 * (might actually happen...)
-		 */
-		else if (!timer_expired) {
-			pause();
-		}
 	}
+	sigprocmask(SIG_SETMASK, &old_sigmask, NULL);
+
+	/* for a warm start next time */
+	state_save(configuration, current_rule);
 
 	/*
 	 * Clean up pidfile
@@ -851,6 +1183,7 @@ out_socket:
 	 *  Free configuration structures
 	 */
 out_config_read:
+	ramp_exit();
 	free_configuration(configuration);
 	if (force_reinit && !force_exit) {
 		force_reinit = 0;
@@ -859,6 +1192,8 @@ out_config_read:
 	}
 
 out:
+	cpu_hotplug_exit();
+	uevent_exit();
 	if (cpufreqd_info != NULL) {
 		if (cpufreqd_info->limits != NULL)
 			free(cpufreqd_info->limits);
@@ -871,6 +1206,7 @@ out:
 					cpufreq_put_affected_cpus((cpufreqd_info->sys_info+i)->affected_cpus);
 				if ((cpufreqd_info->sys_info+i)->frequencies!=NULL)
 					cpufreq_put_available_frequencies((cpufreqd_info->sys_info+i)->frequencies);
+				freq_table_put((cpufreqd_info->sys_info+i)->table);
 			}
 			free(cpufreqd_info->sys_info);
 		}
@@ -878,10 +1214,9 @@ out:
 		if (cpufreqd_info->current_profiles != NULL)
 			free(cpufreqd_info->current_profiles);
 
-		free(cpufreqd_info);
+		if (cpufreqd_info->online != NULL)
+			free(cpufreqd_info->online);
 	}
-	if (configuration != NULL)
-		free(configuration);
 	/*
 	 *  bye bye
 	 */
@@ -28,7 +28,28 @@
 #include "cpufreqd_plugin.h"
 #include "plugin_utils.h"
 
-struct cpufreqd_info *cpufreqd_info = { 0 };
+static struct cpufreqd_info info;
+struct cpufreqd_info *cpufreqd_info = &info;
+
+/* exported to plugins */
+struct cpufreqd_info *get_cpufreqd_info(void) {
+	return cpufreqd_info;
+}
+
+/* exported to plugins, "core" is the cpufreqd_info */
+void *get_plugin_data(const char *name) {
+	struct plugin_obj *o_plugin = NULL;
+
+	if (strcmp(name, "core") == 0)
+		return cpufreqd_info;
+	LIST_FOREACH_NODE(node, &configuration->plugins) {
+		o_plugin = (struct plugin_obj *)node->content;
+		if (o_plugin->plugin != NULL
+				&& strcmp(o_plugin->plugin->plugin_name, name) == 0)
+			return o_plugin->plugin->data;
+	}
+	return NULL;
+}
 
 /* removes any reference to a given plugin from Ruls and Profile */
 #if 0
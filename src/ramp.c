@@ -0,0 +1,197 @@
+/*
+ *  Copyright (C) 2002-2008  Mattia Dongili <malattia@linux.it>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cpufreq.h>
+#include "cpufreqd_plugin.h"
+#include "sampler.h"
+#include "ramp.h"
+
+struct ramp {
+	struct profile *old;		/* NULL if not ramping */
+	struct profile *new;
+	struct cpufreq_policy at;	/* last step set */
+};
+
+static struct ramp *ramps;
+static unsigned int cpus;
+static unsigned int running;
+static unsigned int interval;	/* ms */
+static unsigned int step;	/* frequencies per step */
+static ramp_handler done;
+
+static void ramp_tick(void);
+
+/* step frequencies from freq towards target, target itself if there are
+ * no more available frequencies in between
+ */
+static unsigned long walk(const struct freq_table *t, unsigned long freq,
+		unsigned long target) {
+	unsigned int i = 0;
+
+	if (target > freq) {
+		i = freq_table_index(t, freq + 1) + step - 1;
+		return i < t->count && t->freq[i] < target ? t->freq[i] : target;
+	}
+	if (target < freq) {
+		/* the ones below freq are [0, i) */
+		i = freq_table_index(t, freq);
+		return i >= step && t->freq[i - step] > target ? t->freq[i - step] : target;
+	}
+	return freq;
+}
+
+/* the step after at towards new, returns 1 if it is the last one */
+static int next_step(unsigned int cpu, const struct cpufreq_policy *at,
+		const struct cpufreq_policy *new, struct cpufreq_policy *next) {
+	const struct freq_table *t = cpufreqd_info->sys_info[cpu].table;
+
+	/* nothing to step through */
+	if (t == NULL) {
+		*next = *new;
+		return 1;
+	}
+	next->governor = new->governor;
+	next->max = walk(t, at->max, new->max);
+	next->min = walk(t, at->min, new->min);
+	if (next->min > next->max)
+		next->min = next->max;
+	return next->min == new->min && next->max == new->max;
+}
+
+static void stop(struct ramp *r) {
+	r->old = NULL;
+	r->new = NULL;
+	if (--running == 0)
+		sampler_stop(&ramp_tick);
+}
+
+/* the sampler, runs every interval ms */
+static void ramp_tick(void) {
+	struct cpufreq_policy next;
+	struct profile *old = NULL, *new = NULL;
+	struct ramp *r = NULL;
+	unsigned int i = 0;
+
+	for (i = 0; i < cpus && running > 0; i++) {
+		r = &ramps[i];
+		if (r->new == NULL)
+			continue;
+		if (next_step(i, &r->at, &r->new->policy, &next)) {
+			old = r->old;
+			new = r->new;
+			stop(r);
+			clog(LOG_DEBUG, "CPU%u ramp done\n", i);
+			done(i, old, new);
+			continue;
+		}
+		if (cpufreq_set_policy(i, &next) != 0) {
+			/* the cpu is left without a Profile otherwise */
+			clog(LOG_WARNING, "CPU%u ramp to \"%s\" stopped at %lu-%lu, "
+					"setting it at once\n",
+					i, r->new->name, r->at.min, r->at.max);
+			old = r->old;
+			new = r->new;
+			stop(r);
+			done(i, old, new);
+			continue;
+		}
+		r->at = next;
+		clog(LOG_DEBUG, "CPU%u ramping %lu-%lu\n", i, next.min, next.max);
+	}
+}
+
+int ramp_start(unsigned int cpu, struct profile *old, struct profile *new) {
+	struct cpufreq_policy next;
+	struct ramp *r = NULL;
+	struct profile *cur = NULL;
+
+	if (ramps == NULL || cpu >= cpus)
+		return 0;
+	r = &ramps[cpu];
+	cur = cpufreqd_info->current_profiles[cpu];
+
+	if (r->new == new)
+		return 1;
+	if (r->new == NULL) {
+		/* don't know where we are */
+		if (cur == NULL)
+			return 0;
+		r->at = cur->policy;
+	}
+	/* one step only, or back to where the ramp started */
+	if (next_step(cpu, &r->at, &new->policy, &next)) {
+		ramp_cancel(cpu);
+		return 0;
+	}
+	if (cpufreq_set_policy(cpu, &next) != 0) {
+		ramp_cancel(cpu);
+		return 0;
+	}
+
+	if (r->new == NULL) {
+		if (running++ == 0 && sampler_start(&ramp_tick, interval) != 0) {
+			running--;
+			return 0;
+		}
+		r->old = old != NULL ? old : cur;
+		/* plugins let go of what they hold for the old Profile */
+		cpufreqd_info->current_profiles[cpu] = NULL;
+	}
+	clog(LOG_NOTICE, "Ramping CPU%u to Profile \"%s\"\n", cpu, new->name);
+	r->new = new;
+	r->at = next;
+	return 1;
+}
+
+void ramp_cancel(unsigned int cpu) {
+	if (ramps == NULL || cpu >= cpus || ramps[cpu].new == NULL)
+		return;
+	clog(LOG_DEBUG, "CPU%u ramp to \"%s\" cancelled\n", cpu, ramps[cpu].new->name);
+	stop(&ramps[cpu]);
+}
+
+int ramp_init(unsigned int interval_ms, unsigned int freq_step,
+		ramp_handler handler) {
+	if (interval_ms == 0)
+		return 0;
+	cpus = cpufreqd_info->cpus;
+	ramps = calloc(cpus, sizeof(struct ramp));
+	if (ramps == NULL) {
+		clog(LOG_ERR, "Unable to make room for ramps (%s)\n", strerror(errno));
+		return -1;
+	}
+	interval = interval_ms;
+	step = freq_step > 0 ? freq_step : 1;
+	done = handler;
+	clog(LOG_INFO, "Ramping %u frequencies every %ums\n", step, interval);
+	return 0;
+}
+
+void ramp_exit(void) {
+	unsigned int i = 0;
+
+	if (ramps == NULL)
+		return;
+	for (i = 0; i < cpus; i++)
+		ramp_cancel(i);
+	free(ramps);
+	ramps = NULL;
+}
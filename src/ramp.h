@@ -0,0 +1,48 @@
+/*
+ *  Copyright (C) 2002-2008  Mattia Dongili <malattia@linux.it>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __RAMP_H__
+#define __RAMP_H__ 1
+
+#include "config_parser.h"
+
+/*
+ *  Profile transitions stepping through the available frequencies:
+ *  scaling_min_freq and scaling_max_freq are moved a few frequencies
+ *  at a time towards the new Profile, one step every interval ms.
+ *  While ramping the cpu has no current Profile, the handler is called
+ *  when the last step is due so that the new Profile gets set (and its
+ *  post change event triggered) as usual.
+ *  A ramp is redirected if another Profile is chosen in the meantime.
+ *  If a step can't be written the ramp is abandoned and the handler is
+ *  called right away.
+ */
+typedef void (*ramp_handler)(unsigned int cpu, struct profile *old,
+		struct profile *new);
+
+/* interval 0 disables ramping */
+int ramp_init(unsigned int interval_ms, unsigned int step, ramp_handler handler);
+void ramp_exit(void);
+
+/* Returns 1 if cpu is ramping towards new, 0 if new should be set at once
+ * (ramping disabled, no current Profile or one step only).
+ */
+int ramp_start(unsigned int cpu, struct profile *old, struct profile *new);
+void ramp_cancel(unsigned int cpu);
+
+#endif
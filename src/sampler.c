@@ -0,0 +1,151 @@
+/*
+ *  Copyright (C) 2002-2008  Mattia Dongili <malattia@linux.it>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <time.h>
+#include "cpufreq_utils.h"
+#include "cpufreqd_log.h"
+#include "sampler.h"
+
+#define SAMPLERS_MAX	4
+struct sampler {
+	sampler_func fn;
+	double interval;	/* s */
+	double next;		/* s, monotonic */
+};
+
+static struct sampler samplers[SAMPLERS_MAX];
+static unsigned int running;
+
+/* cpu time accounting since the last report */
+static double report_time;
+static double report_cpu;
+static unsigned long report_runs;
+
+/* user + system time used by cpufreqd, s */
+static double cpu_time(void) {
+	struct rusage ru;
+
+	if (getrusage(RUSAGE_SELF, &ru) != 0)
+		return 0.0;
+	return (double)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec)
+		+ (double)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1000000.0;
+}
+
+static void report_reset(double now) {
+	report_time = now;
+	report_cpu = cpu_time();
+	report_runs = 0;
+}
+
+static void report(double now) {
+	double wall = now - report_time;
+
+	if (wall > 0.0) {
+		clog(LOG_INFO, "%.2fms cpu time per second, %.1f samples per second\n",
+				(cpu_time() - report_cpu) * 1000.0 / wall,
+				(double)report_runs / wall);
+	}
+	report_reset(now);
+}
+
+int sampler_start(sampler_func fn, unsigned int interval_ms) {
+	struct sampler *s = NULL;
+	double now = monotonic_time();
+	unsigned int i = 0;
+
+	if (interval_ms < SAMPLER_MIN_INTERVAL) {
+		clog(LOG_ERR, "sampling interval %ums too short (min %ums)\n",
+				interval_ms, SAMPLER_MIN_INTERVAL);
+		return -1;
+	}
+	for (i = 0; i < SAMPLERS_MAX; i++) {
+		if (samplers[i].fn == fn) {
+			s = &samplers[i];
+			break;
+		}
+		if (s == NULL && samplers[i].fn == NULL)
+			s = &samplers[i];
+	}
+	if (s == NULL) {
+		clog(LOG_ERR, "no sampler left\n");
+		return -1;
+	}
+	if (s->fn == NULL) {
+		if (running++ == 0)
+			report_reset(now);
+		s->fn = fn;
+	}
+	s->interval = (double)interval_ms / 1000.0;
+	s->next = now + s->interval;
+	clog(LOG_DEBUG, "sampling every %ums\n", interval_ms);
+	return 0;
+}
+
+void sampler_stop(sampler_func fn) {
+	unsigned int i = 0;
+
+	for (i = 0; i < SAMPLERS_MAX; i++) {
+		if (samplers[i].fn != fn || fn == NULL)
+			continue;
+		samplers[i].fn = NULL;
+		if (--running == 0)
+			report(monotonic_time());
+	}
+}
+
+void sampler_run(void) {
+	struct sampler *s = NULL;
+	double now = 0.0;
+	unsigned int i = 0;
+
+	if (!running)
+		return;
+	now = monotonic_time();
+	for (i = 0; i < SAMPLERS_MAX; i++) {
+		s = &samplers[i];
+		if (s->fn == NULL || now < s->next)
+			continue;
+		s->fn();
+		report_runs++;
+		/* keep the pace, unless too late already */
+		s->next += s->interval;
+		if (s->next <= now)
+			s->next = now + s->interval;
+	}
+	if (running && now - report_time >= SAMPLER_REPORT)
+		report(now);
+}
+
+struct timespec *sampler_timeout(struct timespec *ts) {
+	double now = 0.0, next = 0.0;
+	unsigned int i = 0;
+
+	if (!running)
+		return NULL;
+	for (i = 0; i < SAMPLERS_MAX; i++) {
+		if (samplers[i].fn != NULL && (next == 0.0 || samplers[i].next < next))
+			next = samplers[i].next;
+	}
+	now = monotonic_time();
+	next = next > now ? next - now : 0.0;
+	ts->tv_sec = (time_t)next;
+	ts->tv_nsec = (long)((next - (double)ts->tv_sec) * 1000000000.0);
+	return ts;
+}
@@ -0,0 +1,52 @@
+/*
+ *  Copyright (C) 2002-2008  Mattia Dongili <malattia@linux.it>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __SAMPLER_H__
+#define __SAMPLER_H__ 1
+
+#include <time.h>
+
+/*
+ *  Periodic callbacks exported by the core cpufreqd to plugins that
+ *  need to sample faster than poll_interval allows (down to
+ *  SAMPLER_MIN_INTERVAL). They are run from the main loop in both
+ *  DYNAMIC and MANUAL mode, the main loop sleeps until the next one
+ *  is due.
+ *  While samplers are running the cpu time used by cpufreqd is
+ *  logged every SAMPLER_REPORT seconds.
+ *  The callbacks should not allocate memory nor block.
+ */
+#define SAMPLER_MIN_INTERVAL	10	/* ms */
+#define SAMPLER_REPORT		60	/* s */
+
+typedef void (*sampler_func)(void);
+
+/* Returns -1 if the interval is too short or no slot is left */
+int sampler_start(sampler_func fn, unsigned int interval_ms);
+/* can be called from fn itself */
+void sampler_stop(sampler_func fn);
+
+/*
+ *  Core cpufreqd only
+ */
+/* runs the callbacks due */
+void sampler_run(void);
+/* time left until the next callback is due, NULL if none is running */
+struct timespec *sampler_timeout(struct timespec *ts);
+
+#endif
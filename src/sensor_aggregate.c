@@ -0,0 +1,70 @@
+/*
+ *  Copyright (C) 2002-2008  Mattia Dongili <malattia@linux.it>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "sensor_aggregate.h"
+
+static const char *aggregate_names[] = { "max", "min", "avg", "p90", NULL };
+
+int sensor_aggregate_parse(const char *str, size_t len) {
+	int i = 0;
+
+	for (i = 0; aggregate_names[i] != NULL; i++) {
+		if (strlen(aggregate_names[i]) == len
+				&& strncmp(str, aggregate_names[i], len) == 0)
+			return i;
+	}
+	return -1;
+}
+
+const char *sensor_aggregate_name(int how) {
+	return how >= 0 && how <= AGGREGATE_P90 ? aggregate_names[how] : "?";
+}
+
+static int compare_doubles(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+double sensor_aggregate(double *values, unsigned int count, int how) {
+	double ret = values[0];
+	unsigned int i = 0;
+
+	switch (how) {
+	case AGGREGATE_MIN:
+		for (i = 1; i < count; i++)
+			ret = values[i] < ret ? values[i] : ret;
+		break;
+	case AGGREGATE_AVG:
+		for (i = 1; i < count; i++)
+			ret += values[i];
+		ret /= (double)count;
+		break;
+	case AGGREGATE_P90:
+		/* nearest rank */
+		qsort(values, count, sizeof(double), &compare_doubles);
+		ret = values[(count * 9 + 9) / 10 - 1];
+		break;
+	default:
+		for (i = 1; i < count; i++)
+			ret = values[i] > ret ? values[i] : ret;
+		break;
+	}
+	return ret;
+}
@@ -0,0 +1,41 @@
+/*
+ *  Copyright (C) 2002-2008  Mattia Dongili <malattia@linux.it>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __SENSOR_AGGREGATE_H__
+#define __SENSOR_AGGREGATE_H__ 1
+
+#include <stddef.h>
+
+/*
+ *  Aggregation of a group of readings (e.g. one temperature per core)
+ *  into a single value, exported by the core cpufreqd to plugins.
+ */
+enum sensor_aggregate {
+	AGGREGATE_MAX,
+	AGGREGATE_MIN,
+	AGGREGATE_AVG,
+	AGGREGATE_P90
+};
+
+/* parses the first len chars of str (max, min, avg, p90), -1 if unknown */
+int sensor_aggregate_parse(const char *str, size_t len);
+const char *sensor_aggregate_name(int how);
+/* values might be reordered, count must be > 0 */
+double sensor_aggregate(double *values, unsigned int count, int how);
+
+#endif
@@ -0,0 +1,252 @@
+/*
+ *  Copyright (C) 2002-2008  Mattia Dongili <malattia@linux.it>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "cpufreqd_plugin.h"
+#include "cpufreq_utils.h"
+#include "plugin_utils.h"
+#include "state.h"
+
+#define BOOT_ID		"/proc/sys/kernel/random/boot_id"
+#define BOOT_ID_LEN	40
+
+static double last_save; /* monotonic, s */
+
+/* jiffies and the like are only meaningful within the same boot,
+ * the id is empty if unknown
+ */
+static void get_boot_id(char *buf, size_t len) {
+	FILE *fp = fopen(BOOT_ID, "r");
+
+	*buf = '\0';
+	if (fp == NULL)
+		return;
+	if (fgets(buf, (int)len, fp) == NULL)
+		*buf = '\0';
+	buf[strcspn(buf, "\n")] = '\0';
+	fclose(fp);
+}
+
+/* writes the plugin snapshot line, nothing if it has none */
+static void save_plugin(FILE *fp, struct cpufreqd_plugin *plugin) {
+	char *buf = NULL;
+	size_t len = 0;
+	FILE *mem = NULL;
+	int ret = 0;
+
+	if (plugin->plugin_save == NULL)
+		return;
+	if ((mem = open_memstream(&buf, &len)) == NULL) {
+		clog(LOG_ERR, "Unable to make room for the %s snapshot (%s)\n",
+				plugin->plugin_name, strerror(errno));
+		return;
+	}
+	ret = plugin->plugin_save(mem);
+	fclose(mem);
+	if (ret == 0 && strchr(buf, '\n') == NULL)
+		fprintf(fp, "plugin:%s=%s\n", plugin->plugin_name, buf);
+	free(buf);
+}
+
+int state_save(struct cpufreqd_conf *config, const struct rule *rule) {
+	struct cpufreqd_info *cinfo = get_cpufreqd_info();
+	char tmp[MAX_PATH_LEN + 4];
+	char boot_id[BOOT_ID_LEN];
+	FILE *fp = NULL;
+	unsigned int i = 0;
+	int ret = 0;
+
+	if (!config->state_file[0])
+		return 0;
+	last_save = monotonic_time();
+
+	/* written aside and renamed over, a reader never sees half of it */
+	snprintf(tmp, sizeof(tmp), "%s.new", config->state_file);
+	if ((fp = fopen(tmp, "w")) == NULL) {
+		clog(LOG_ERR, "%s: %s\n", tmp, strerror(errno));
+		return -1;
+	}
+	get_boot_id(boot_id, sizeof(boot_id));
+	fprintf(fp, "version=%d\n", STATE_VERSION);
+	fprintf(fp, "boot_id=%s\n", boot_id);
+	fprintf(fp, "time=%ld\n", (long)time(NULL));
+	fprintf(fp, "cpus=%u\n", cinfo->cpus);
+	if (rule != NULL)
+		fprintf(fp, "rule=%s\n", rule->name);
+	for (i = 0; i < cinfo->cpus; i++) {
+		if (cinfo->current_profiles[i] != NULL)
+			fprintf(fp, "CPU%u=%s\n", i, cinfo->current_profiles[i]->name);
+	}
+	LIST_FOREACH_NODE(node, &config->plugins) {
+		save_plugin(fp, ((struct plugin_obj *) node->content)->plugin);
+	}
+
+	if (fflush(fp) != 0 || fsync(fileno(fp)) != 0)
+		ret = -1;
+	if (fclose(fp) != 0)
+		ret = -1;
+	if (ret == 0 && rename(tmp, config->state_file) != 0)
+		ret = -1;
+	if (ret < 0) {
+		clog(LOG_ERR, "Unable to write %s (%s)\n", config->state_file,
+				strerror(errno));
+		unlink(tmp);
+		return -1;
+	}
+	clog(LOG_DEBUG, "state saved to %s\n", config->state_file);
+	return 0;
+}
+
+void state_update(struct cpufreqd_conf *config, const struct rule *rule) {
+	if (!config->state_file[0] || config->state_interval == 0
+			|| monotonic_time() - last_save < (double)config->state_interval)
+		return;
+	state_save(config, rule);
+}
+
+void state_free(struct cpufreqd_state *st) {
+	if (st == NULL)
+		return;
+	free(st->profiles);
+	free(st);
+}
+
+/* checks the header lines, a state from another boot or version,
+ * too old or for a different number of cpus is useless
+ *
+ * Returns -1 if name=value makes the state unusable, 0 otherwise
+ */
+static int check_header(const char *name, const char *value, int *seen) {
+	struct cpufreqd_info *cinfo = get_cpufreqd_info();
+	char boot_id[BOOT_ID_LEN];
+	long age = 0;
+
+	if (strcmp(name, "version") == 0) {
+		(*seen)++;
+		return atoi(value) == STATE_VERSION ? 0 : -1;
+	}
+	if (strcmp(name, "boot_id") == 0) {
+		(*seen)++;
+		get_boot_id(boot_id, sizeof(boot_id));
+		return strcmp(value, boot_id) == 0 ? 0 : -1;
+	}
+	if (strcmp(name, "time") == 0) {
+		(*seen)++;
+		age = (long)time(NULL) - atol(value);
+		return age >= 0 && age <= STATE_MAX_AGE ? 0 : -1;
+	}
+	if (strcmp(name, "cpus") == 0) {
+		(*seen)++;
+		return (unsigned int)atoi(value) == cinfo->cpus ? 0 : -1;
+	}
+	return 0;
+}
+
+static void restore_plugin(struct cpufreqd_conf *config, const char *name,
+		const char *value) {
+	struct cpufreqd_plugin *plugin = NULL;
+
+	LIST_FOREACH_NODE(node, &config->plugins) {
+		plugin = ((struct plugin_obj *) node->content)->plugin;
+		if (strcmp(plugin->plugin_name, name) != 0
+				|| plugin->plugin_restore == NULL)
+			continue;
+		if (plugin->plugin_restore(value) != 0)
+			clog(LOG_WARNING, "%s snapshot discarded.\n", name);
+		else
+			clog(LOG_INFO, "%s snapshot restored.\n", name);
+		return;
+	}
+}
+
+struct cpufreqd_state *state_load(struct cpufreqd_conf *config) {
+	struct cpufreqd_info *cinfo = get_cpufreqd_info();
+	struct cpufreqd_state *st = NULL;
+	char *line = NULL, *value = NULL;
+	size_t len = 0;
+	unsigned int cpu = 0;
+	int seen = 0, valid = 1;
+	FILE *fp = NULL;
+
+	last_save = monotonic_time();
+	if (!config->state_file[0])
+		return NULL;
+	if ((fp = fopen(config->state_file, "r")) == NULL) {
+		clog(LOG_INFO, "%s: %s, cold start.\n", config->state_file,
+				strerror(errno));
+		return NULL;
+	}
+	st = calloc(1, sizeof(struct cpufreqd_state));
+	if (st == NULL || (st->profiles = calloc(cinfo->cpus,
+					sizeof(*st->profiles))) == NULL) {
+		clog(LOG_ERR, "Unable to make room for the state (%s)\n",
+				strerror(errno));
+		state_free(st);
+		fclose(fp);
+		return NULL;
+	}
+	st->cpus = cinfo->cpus;
+
+	/* header, Rule and Profiles */
+	while (valid && getline(&line, &len, fp) != -1) {
+		line[strcspn(line, "\n")] = '\0';
+		if ((value = strchr(line, '=')) == NULL) {
+			valid = 0;
+			break;
+		}
+		*value++ = '\0';
+		/* restored once the whole file is known to be good */
+		if (strncmp(line, "plugin:", 7) == 0)
+			continue;
+		if (check_header(line, value, &seen) < 0) {
+			valid = 0;
+		} else if (strcmp(line, "rule") == 0) {
+			snprintf(st->rule, MAX_STRING_LEN, "%s", value);
+		} else if (sscanf(line, "CPU%u", &cpu) == 1 && cpu < st->cpus) {
+			snprintf(st->profiles[cpu], MAX_STRING_LEN, "%s", value);
+		}
+	}
+	if (!valid || seen != 4) {
+		clog(LOG_NOTICE, "%s is stale or invalid, cold start.\n",
+				config->state_file);
+		free(line);
+		fclose(fp);
+		state_free(st);
+		return NULL;
+	}
+
+	/* plugin snapshots */
+	rewind(fp);
+	while (getline(&line, &len, fp) != -1) {
+		line[strcspn(line, "\n")] = '\0';
+		if (strncmp(line, "plugin:", 7) != 0
+				|| (value = strchr(line, '=')) == NULL)
+			continue;
+		*value++ = '\0';
+		restore_plugin(config, line + 7, value);
+	}
+	free(line);
+	fclose(fp);
+	clog(LOG_INFO, "state read from %s, warm start.\n", config->state_file);
+	return st;
+}
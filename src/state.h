@@ -0,0 +1,56 @@
+/*
+ *  Copyright (C) 2002-2008  Mattia Dongili <malattia@linux.it>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __STATE_H__
+#define __STATE_H__ 1
+
+#include "config_parser.h"
+
+/*
+ *  Warm start: the runtime state is written to state_file when exiting
+ *  and every state_interval seconds, then read back at startup. It holds
+ *  the current Rule, the Profile of each cpu and a one line snapshot of
+ *  the plugins that can make one (plugin_save/plugin_restore), e.g. the
+ *  cpu plugin jiffies so that the first cpu usage isn't the uptime
+ *  average.
+ *  The file is only used if it was written during the same boot and
+ *  less than STATE_MAX_AGE seconds before.
+ */
+#define STATE_VERSION	1
+#define STATE_MAX_AGE	600	/* s */
+
+struct cpufreqd_state {
+	char rule[MAX_STRING_LEN];	/* empty if none */
+	unsigned int cpus;
+	char (*profiles)[MAX_STRING_LEN]; /* per cpu, empty if none */
+};
+
+/* Returns -1 if the file can't be written, it is replaced atomically.
+ * Does nothing if no state_file is configured.
+ */
+int state_save(struct cpufreqd_conf *config, const struct rule *rule);
+/* saves if state_interval elapsed since the last time */
+void state_update(struct cpufreqd_conf *config, const struct rule *rule);
+
+/* Reads the state file and restores the plugin snapshots.
+ * Returns NULL if the file is missing, stale or invalid.
+ */
+struct cpufreqd_state *state_load(struct cpufreqd_conf *config);
+void state_free(struct cpufreqd_state *st);
+
+#endif
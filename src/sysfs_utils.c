@@ -0,0 +1,299 @@
+/*
+ *  Copyright (C) 2002-2008  Mattia Dongili <malattia@linux.it>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "cpufreqd_log.h"
+#include "sysfs_utils.h"
+
+#define SYSFS_VALUE_LEN	64
+
+struct sysfs_attr {
+	int fd;
+	int mode;
+	unsigned int used;
+	int failed;		/* don't flood the logs */
+	int partial;		/* procfs seq files hand out a record per read */
+	struct sysfs_attr *next;
+	char path[];
+};
+
+struct sysfs_batch_entry {
+	struct sysfs_attr *attr;
+	int *value;
+	int *valid;
+};
+
+struct sysfs_batch {
+	unsigned int count;
+	unsigned int size;
+	struct sysfs_batch_entry *entries;
+};
+
+/* all the open attributes, shared by path and mode */
+static struct sysfs_attr *attributes;
+
+static int attr_reopen(struct sysfs_attr *attr) {
+	if (attr->fd >= 0)
+		close(attr->fd);
+	attr->fd = open(attr->path, attr->mode | O_CLOEXEC);
+	return attr->fd < 0 ? -1 : 0;
+}
+
+/* the device went away (or is going to be back with the same name) */
+static int attr_gone(int err) {
+	return err == ENODEV || err == ENXIO || err == ENOENT || err == ESTALE;
+}
+
+static void attr_error(struct sysfs_attr *attr, const char *op, int err) {
+	if (!attr->failed)
+		clog(LOG_NOTICE, "couldn't %s %s (%s)\n", op, attr->path,
+				strerror(err));
+	attr->failed = 1;
+}
+
+struct sysfs_attr *sysfs_attr_open(const char *path, int mode) {
+	struct sysfs_attr *attr = attributes;
+	size_t len = strlen(path);
+
+	for (; attr != NULL; attr = attr->next) {
+		if (attr->mode == mode && strcmp(attr->path, path) == 0) {
+			attr->used++;
+			return attr;
+		}
+	}
+
+	attr = calloc(1, sizeof(struct sysfs_attr) + len + 1);
+	if (attr == NULL) {
+		clog(LOG_ERR, "couldn't make enough room for %s (%s)\n", path,
+				strerror(errno));
+		return NULL;
+	}
+	memcpy(attr->path, path, len + 1);
+	attr->mode = mode;
+	attr->partial = strncmp(path, "/sys/", 5) != 0;
+	attr->fd = -1;
+	if (attr_reopen(attr) != 0) {
+		clog(LOG_INFO, "couldn't open %s (%s)\n", path, strerror(errno));
+		free(attr);
+		return NULL;
+	}
+	attr->used = 1;
+	attr->next = attributes;
+	attributes = attr;
+	clog(LOG_DEBUG, "opened %s\n", path);
+	return attr;
+}
+
+void sysfs_attr_close(struct sysfs_attr *attr) {
+	struct sysfs_attr **a = &attributes;
+
+	if (attr == NULL || --attr->used > 0)
+		return;
+
+	while (*a != NULL && *a != attr)
+		a = &(*a)->next;
+	if (*a != NULL)
+		*a = attr->next;
+	clog(LOG_DEBUG, "closing %s\n", attr->path);
+	if (attr->fd >= 0)
+		close(attr->fd);
+	free(attr);
+}
+
+const char *sysfs_attr_path(const struct sysfs_attr *attr) {
+	return attr->path;
+}
+
+ssize_t sysfs_attr_read(struct sysfs_attr *attr, char *buf, size_t len) {
+	ssize_t ret = 0, more = 0;
+	int retry = 1;
+
+	if (len == 0)
+		return -1;
+	if (attr->fd < 0 && attr_reopen(attr) != 0) {
+		attr_error(attr, "open", errno);
+		return -1;
+	}
+
+	while ((ret = pread(attr->fd, buf, len - 1, 0)) < 0) {
+		if (errno == EINTR)
+			continue;
+		if (retry-- > 0 && attr_gone(errno) && attr_reopen(attr) == 0)
+			continue;
+		attr_error(attr, "read", errno);
+		return -1;
+	}
+	/* a sysfs attribute is always returned whole */
+	while (attr->partial && ret > 0 && (size_t)ret < len - 1) {
+		more = pread(attr->fd, buf + ret, len - 1 - (size_t)ret, ret);
+		if (more < 0 && errno == EINTR)
+			continue;
+		if (more <= 0)
+			break;
+		ret += more;
+	}
+	buf[ret] = '\0';
+	if (ret > 0 && buf[ret - 1] == '\n')
+		buf[--ret] = '\0';
+	attr->failed = 0;
+	return ret;
+}
+
+int sysfs_parse_long(const char *str, long *value) {
+	unsigned long v = 0;
+	int neg = 0, digits = 0;
+
+	while (*str == ' ' || *str == '\t')
+		str++;
+	if (*str == '-' || *str == '+')
+		neg = *str++ == '-';
+	for (; *str >= '0' && *str <= '9'; str++, digits++) {
+		if (v > ((unsigned long)LONG_MAX - (unsigned long)(*str - '0')) / 10)
+			return -1;
+		v = v * 10 + (unsigned long)(*str - '0');
+	}
+	while (*str == ' ' || *str == '\t' || *str == '\n')
+		str++;
+	if (digits == 0 || *str != '\0')
+		return -1;
+
+	*value = neg ? -(long)v : (long)v;
+	return 0;
+}
+
+int sysfs_attr_read_long(struct sysfs_attr *attr, long *value) {
+	char buf[SYSFS_VALUE_LEN];
+
+	if (sysfs_attr_read(attr, buf, sizeof(buf)) < 0)
+		return -1;
+	if (sysfs_parse_long(buf, value) != 0) {
+		clog(LOG_NOTICE, "%s: not a number (%s)\n", attr->path, buf);
+		return -1;
+	}
+	return 0;
+}
+
+int sysfs_attr_read_int(struct sysfs_attr *attr, int *value) {
+	long v = 0;
+
+	if (sysfs_attr_read_long(attr, &v) != 0)
+		return -1;
+	if (v > INT_MAX || v < INT_MIN) {
+		clog(LOG_NOTICE, "%s: value out of range (%ld)\n", attr->path, v);
+		return -1;
+	}
+	*value = (int)v;
+	return 0;
+}
+
+int sysfs_attr_write(struct sysfs_attr *attr, const char *value) {
+	size_t len = strlen(value);
+	ssize_t ret = 0;
+	int retry = 1;
+
+	if (attr->fd < 0 && attr_reopen(attr) != 0) {
+		attr_error(attr, "open", errno);
+		return -1;
+	}
+
+	while ((ret = pwrite(attr->fd, value, len, 0)) < 0) {
+		if (errno == EINTR)
+			continue;
+		if (retry-- > 0 && attr_gone(errno) && attr_reopen(attr) == 0)
+			continue;
+		clog(LOG_ERR, "couldn't write %s to %s (%s)\n", value, attr->path,
+				strerror(errno));
+		return -1;
+	}
+	if ((size_t)ret != len) {
+		clog(LOG_ERR, "short write to %s (%s)\n", attr->path, value);
+		return -1;
+	}
+	attr->failed = 0;
+	return 0;
+}
+
+int sysfs_attr_write_long(struct sysfs_attr *attr, long value) {
+	char buf[SYSFS_VALUE_LEN];
+
+	snprintf(buf, sizeof(buf), "%ld", value);
+	return sysfs_attr_write(attr, buf);
+}
+
+struct sysfs_batch *sysfs_batch_new(void) {
+	struct sysfs_batch *batch = calloc(1, sizeof(struct sysfs_batch));
+	if (batch == NULL)
+		clog(LOG_ERR, "couldn't make enough room for a batch (%s)\n",
+				strerror(errno));
+	return batch;
+}
+
+void sysfs_batch_free(struct sysfs_batch *batch) {
+	if (batch == NULL)
+		return;
+	free(batch->entries);
+	free(batch);
+}
+
+int sysfs_batch_add(struct sysfs_batch *batch, struct sysfs_attr *attr,
+		int *value, int *valid) {
+	struct sysfs_batch_entry *e = NULL;
+	unsigned int size = 0;
+
+	if (batch->count == batch->size) {
+		size = batch->size ? batch->size * 2 : 8;
+		e = realloc(batch->entries, size * sizeof(struct sysfs_batch_entry));
+		if (e == NULL) {
+			clog(LOG_ERR, "couldn't make enough room for %s (%s)\n",
+					attr->path, strerror(errno));
+			return -1;
+		}
+		batch->entries = e;
+		batch->size = size;
+	}
+	e = &batch->entries[batch->count++];
+	e->attr = attr;
+	e->value = value;
+	e->valid = valid;
+	return 0;
+}
+
+/* Plain preads: sysfs files don't support non blocking reads,
+ * an asynchronous interface would just bounce each of them to a
+ * kernel worker thread.
+ */
+int sysfs_batch_read(struct sysfs_batch *batch) {
+	struct sysfs_batch_entry *e = NULL;
+	unsigned int i = 0;
+	int ret = 0, ok = 0;
+
+	for (i = 0; i < batch->count; i++) {
+		e = &batch->entries[i];
+		ok = sysfs_attr_read_int(e->attr, e->value) == 0;
+		if (e->valid != NULL)
+			*e->valid = ok;
+		ret += ok;
+	}
+	return ret;
+}
@@ -0,0 +1,71 @@
+/*
+ *  Copyright (C) 2002-2008  Mattia Dongili <malattia@linux.it>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __SYSFS_UTILS_H__
+#define __SYSFS_UTILS_H__ 1
+
+#include <sys/types.h>
+
+/*
+ *  Attribute files (sysfs, but any small procfs file works too)
+ *  exported by the core cpufreqd to plugins.
+ *  An attribute is opened once and shared by everybody asking for
+ *  the same path and mode, reads and writes go through pread/pwrite
+ *  on the cached descriptor. If the device goes away the file is
+ *  transparently reopened on the next access.
+ *  None of these functions is thread safe.
+ */
+struct sysfs_attr;
+
+/* mode is one of O_RDONLY, O_WRONLY, O_RDWR.
+ * Returns NULL if the file can't be opened.
+ */
+struct sysfs_attr *sysfs_attr_open(const char *path, int mode);
+void sysfs_attr_close(struct sysfs_attr *attr);
+const char *sysfs_attr_path(const struct sysfs_attr *attr);
+
+/* reads at most len - 1 bytes into buf, the string is terminated
+ * and the trailing newline removed.
+ * Returns the string length or -1 on errors.
+ */
+ssize_t sysfs_attr_read(struct sysfs_attr *attr, char *buf, size_t len);
+int sysfs_attr_read_int(struct sysfs_attr *attr, int *value);
+int sysfs_attr_read_long(struct sysfs_attr *attr, long *value);
+
+int sysfs_attr_write(struct sysfs_attr *attr, const char *value);
+int sysfs_attr_write_long(struct sysfs_attr *attr, long value);
+
+/* parses a base 10 integer allowing surrounding blanks, no allocations */
+int sysfs_parse_long(const char *str, long *value);
+
+/*
+ *  Batched reads: collect the integer attributes to be read at each
+ *  update once, then read them all with a single call.
+ *  valid (can be NULL) is set to 1 if the value could be read, 0 otherwise,
+ *  values that couldn't be read are left untouched.
+ */
+struct sysfs_batch;
+
+struct sysfs_batch *sysfs_batch_new(void);
+void sysfs_batch_free(struct sysfs_batch *batch);
+int sysfs_batch_add(struct sysfs_batch *batch, struct sysfs_attr *attr,
+		int *value, int *valid);
+/* Returns the number of attributes read successfully */
+int sysfs_batch_read(struct sysfs_batch *batch);
+
+#endif
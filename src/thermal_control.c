@@ -0,0 +1,279 @@
+/*
+ *  Copyright (C) 2002-2008  Mattia Dongili <malattia@linux.it>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cpufreqd_plugin.h"
+#include "cpufreq_utils.h"
+#include "sysfs_utils.h"
+#include "thermal_control.h"
+
+#define SCALING_MAX_FREQ	"/sys/devices/system/cpu/cpu%u/cpufreq/scaling_max_freq"
+
+/* default gains, the output is the fraction of the Profile range */
+#define DEFAULT_KP		0.05	/* full range over 20°C */
+#define DEFAULT_KI		0.01
+#define DEFAULT_KD		0.1
+/* fraction of the range per second the output may move */
+#define RATE_UP			0.05
+#define RATE_DOWN		0.5
+/* seconds, low pass on the temperature derivative */
+#define DERIV_TAU		2.0
+/* longer gaps (suspend, manual mode) don't count as integration time */
+#define DT_MAX			10.0
+
+struct thermal_control {
+	double target;		/* °C */
+	double kp, ki, kd;
+
+	const struct cpufreq_policy *policy;	/* Profile under control */
+	unsigned int cpus;
+	unsigned char *active;	/* per cpu, the Profile is set there */
+	struct sysfs_attr **max_attr;
+	unsigned long *written;	/* last scaling_max_freq written */
+
+	double output;		/* 0 - 1, fraction of the policy range */
+	double integral;
+	double deriv;		/* filtered °C/s */
+	double last_temp;
+	double last_time;
+	int primed;		/* last_temp and last_time are valid */
+};
+
+static double clamp(double v, double lo, double hi) {
+	return v < lo ? lo : (v > hi ? hi : v);
+}
+
+static int parse_double(const char **s, double *value) {
+	char *end = NULL;
+
+	*value = strtod(*s, &end);
+	if (end == *s || (*end != '\0' && *end != ':'))
+		return -1;
+	*s = *end == ':' ? end + 1 : end;
+	return 0;
+}
+
+struct thermal_control *thermal_control_parse(const char *str) {
+	struct thermal_control *ctl = calloc(1, sizeof(struct thermal_control));
+	const char *s = str;
+
+	if (ctl == NULL) {
+		clog(LOG_ERR, "couldn't make enough room for thermal_control (%s)\n",
+				strerror(errno));
+		return NULL;
+	}
+	ctl->kp = DEFAULT_KP;
+	ctl->ki = DEFAULT_KI;
+	ctl->kd = DEFAULT_KD;
+	ctl->output = 1.0;
+
+	if (parse_double(&s, &ctl->target) != 0 || ctl->target <= 0.0
+			|| (*s != '\0' && (parse_double(&s, &ctl->kp) != 0
+					|| parse_double(&s, &ctl->ki) != 0
+					|| parse_double(&s, &ctl->kd) != 0
+					|| *s != '\0'))
+			|| ctl->kp < 0.0 || ctl->ki < 0.0 || ctl->kd < 0.0) {
+		clog(LOG_ERR, "couldn't parse %s, target[:kp:ki:kd] expected\n", str);
+		free(ctl);
+		return NULL;
+	}
+	clog(LOG_INFO, "target %.1fC (kp %g ki %g kd %g)\n", ctl->target,
+			ctl->kp, ctl->ki, ctl->kd);
+	return ctl;
+}
+
+double thermal_control_target(const struct thermal_control *ctl) {
+	return ctl->target;
+}
+
+static int alloc_cpus(struct thermal_control *ctl) {
+	unsigned int cpus = get_cpufreqd_info()->cpus;
+
+	ctl->active = calloc(cpus, sizeof(unsigned char));
+	ctl->max_attr = calloc(cpus, sizeof(struct sysfs_attr *));
+	ctl->written = calloc(cpus, sizeof(unsigned long));
+	if (ctl->active == NULL || ctl->max_attr == NULL || ctl->written == NULL) {
+		clog(LOG_ERR, "couldn't make enough room for thermal_control (%s)\n",
+				strerror(errno));
+		free(ctl->active);
+		free(ctl->max_attr);
+		free(ctl->written);
+		ctl->active = NULL;
+		ctl->max_attr = NULL;
+		ctl->written = NULL;
+		return -1;
+	}
+	ctl->cpus = cpus;
+	return 0;
+}
+
+static int is_current(const struct thermal_control *ctl, unsigned int cpu) {
+	const struct profile *p = get_cpufreqd_info()->current_profiles[cpu];
+	return p != NULL && &p->policy == ctl->policy;
+}
+
+void thermal_control_activate(struct thermal_control *ctl,
+		const struct cpufreq_policy *old,
+		const struct cpufreq_policy *new, unsigned int cpu) {
+	char path[MAX_PATH_LEN];
+	unsigned int i = 0, running = 0;
+
+	if (ctl->active == NULL && alloc_cpus(ctl) != 0)
+		return;
+	if (cpu >= ctl->cpus)
+		return;
+	/* Profile unchanged, keep going */
+	if (old == new && ctl->active[cpu])
+		return;
+
+	if (ctl->max_attr[cpu] == NULL) {
+		snprintf(path, sizeof(path), SCALING_MAX_FREQ, cpu);
+		if ((ctl->max_attr[cpu] = sysfs_attr_open(path, O_WRONLY)) == NULL) {
+			clog(LOG_WARNING, "can't control CPU%u max frequency\n", cpu);
+			return;
+		}
+	}
+
+	for (i = 0; i < ctl->cpus; i++)
+		running += ctl->active[i] && is_current(ctl, i);
+	/* start over from the Profile max, no bump */
+	if (!running) {
+		ctl->output = 1.0;
+		ctl->deriv = 0.0;
+		ctl->primed = 0;
+	}
+	ctl->policy = new;
+	ctl->active[cpu] = 1;
+	/* set_policy() just wrote it */
+	ctl->written[cpu] = new->max;
+	clog(LOG_DEBUG, "controlling CPU%u towards %.1fC\n", cpu, ctl->target);
+}
+
+/* the highest available frequency not above freq */
+static unsigned long pick_frequency(unsigned int cpu, unsigned long freq,
+		unsigned long min) {
+	const struct freq_table *t = get_cpufreqd_info()->sys_info[cpu].table;
+	unsigned long best = 0;
+
+	if (t == NULL)
+		return freq;
+	best = freq_table_floor(t, freq);
+	return best > min && best <= freq ? best : min;
+}
+
+static void write_max(struct thermal_control *ctl, unsigned int cpu,
+		unsigned long freq, double temperature) {
+	if (freq == ctl->written[cpu])
+		return;
+	if (sysfs_attr_write_long(ctl->max_attr[cpu], (long)freq) != 0)
+		return;
+	clog(LOG_INFO, "CPU%u max frequency set to %lu (%.1fC, target %.1fC)\n",
+			cpu, freq, temperature, ctl->target);
+	ctl->written[cpu] = freq;
+}
+
+void thermal_control_update(struct thermal_control *ctl, double temperature) {
+	unsigned int i = 0, running = 0;
+	double now = monotonic_time(), dt = 0.0, err = 0.0;
+	double p = 0.0, integral = 0.0, d = 0.0, u = 0.0, lo = 0.0, hi = 0.0;
+	unsigned long min = 0, max = 0;
+
+	if (ctl->active == NULL)
+		return;
+	for (i = 0; i < ctl->cpus; i++) {
+		/* another Profile has been set, it has its own max */
+		if (ctl->active[i] && !is_current(ctl, i)) {
+			clog(LOG_DEBUG, "released CPU%u\n", i);
+			ctl->active[i] = 0;
+		}
+		running += ctl->active[i];
+	}
+	if (!running)
+		return;
+
+	err = ctl->target - temperature;
+	if (!ctl->primed) {
+		/* the integral takes the current output, no bump */
+		ctl->integral = clamp(ctl->output - ctl->kp * err, 0.0, 1.0);
+		ctl->last_temp = temperature;
+		ctl->last_time = now;
+		ctl->primed = 1;
+		return;
+	}
+	dt = now - ctl->last_time;
+	if (dt <= 0.0)
+		return;
+	if (dt > DT_MAX)
+		dt = DT_MAX;
+
+	/* derivative on the measurement, changing target doesn't kick */
+	ctl->deriv += ((temperature - ctl->last_temp) / dt - ctl->deriv) *
+		dt / (DERIV_TAU + dt);
+	ctl->last_temp = temperature;
+	ctl->last_time = now;
+
+	p = ctl->kp * err;
+	d = -ctl->kd * ctl->deriv;
+	integral = ctl->integral + ctl->ki * err * dt;
+	u = p + integral + d;
+
+	/* saturation and rate limits */
+	lo = ctl->output - RATE_DOWN * dt;
+	hi = ctl->output + RATE_UP * dt;
+	lo = lo < 0.0 ? 0.0 : lo;
+	hi = hi > 1.0 ? 1.0 : hi;
+	/* anti-windup: don't integrate further into a limit */
+	if (!((u > hi && err > 0.0) || (u < lo && err < 0.0)))
+		ctl->integral = clamp(integral, 0.0, 1.0);
+	ctl->output = clamp(u, lo, hi);
+
+	clog(LOG_DEBUG, "%.1fC (%+.2fC/s) target %.1fC: p %.3f i %.3f d %.3f -> %.3f\n",
+			temperature, ctl->deriv, ctl->target, p, ctl->integral, d,
+			ctl->output);
+
+	min = ctl->policy->min;
+	max = ctl->policy->max;
+	for (i = 0; i < ctl->cpus; i++) {
+		if (!ctl->active[i])
+			continue;
+		write_max(ctl, i, pick_frequency(i, min + (unsigned long)
+					(ctl->output * (double)(max - min)), min),
+				temperature);
+	}
+}
+
+void thermal_control_free(struct thermal_control *ctl) {
+	unsigned int i = 0;
+
+	if (ctl == NULL)
+		return;
+	for (i = 0; i < ctl->cpus; i++) {
+		/* leave the Profile as it was set */
+		if (ctl->active[i] && is_current(ctl, i))
+			write_max(ctl, i, ctl->policy->max, ctl->last_temp);
+		sysfs_attr_close(ctl->max_attr[i]);
+	}
+	free(ctl->active);
+	free(ctl->max_attr);
+	free(ctl->written);
+	free(ctl);
+}
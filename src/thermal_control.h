@@ -0,0 +1,61 @@
+/*
+ *  Copyright (C) 2002-2008  Mattia Dongili <malattia@linux.it>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __THERMAL_CONTROL_H__
+#define __THERMAL_CONTROL_H__ 1
+
+#include <cpufreq.h>
+
+/*
+ *  Closed loop thermal control exported by the core cpufreqd to plugins.
+ *  A controller belongs to a Profile directive and, while that Profile
+ *  is set, moves scaling_max_freq within the Profile min-max range
+ *  so that the temperature fed by the plugin stays at the target.
+ *
+ *  The controller is a PID working on the fraction of the Profile
+ *  range, the integral stops accumulating while the output is
+ *  saturated (anti-windup) and the output can't move faster than
+ *  a fixed rate (quicker going down than going up).
+ */
+struct thermal_control;
+
+/* parses target[:kp:ki:kd] (°C, then gains in fraction of the
+ * frequency range per °C, °C*s and °C/s).
+ * Returns NULL on errors.
+ */
+struct thermal_control *thermal_control_parse(const char *str);
+
+/* restores the Profile max frequency if the controller is still active */
+void thermal_control_free(struct thermal_control *ctl);
+
+/* to be called from the profile_post_change event, old and new as
+ * passed to it
+ */
+void thermal_control_activate(struct thermal_control *ctl,
+		const struct cpufreq_policy *old,
+		const struct cpufreq_policy *new, unsigned int cpu);
+
+/* feeds a temperature reading (°C), to be called from the plugin update.
+ * The frequency is written only if the controller's Profile is
+ * the current one.
+ */
+void thermal_control_update(struct thermal_control *ctl, double temperature);
+
+double thermal_control_target(const struct thermal_control *ctl);
+
+#endif
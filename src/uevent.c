@@ -0,0 +1,194 @@
+/*
+ *  Copyright (C) 2002-2008  Mattia Dongili <malattia@linux.it>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <linux/netlink.h>
+#include "cpufreqd_log.h"
+#include "uevent.h"
+
+#define UEVENT_BUF_SIZE		8192
+#define UEVENT_RCVBUF_SIZE	(256 * 1024)
+
+struct subscription {
+	const char *subsystem;
+	uevent_handler handler;
+};
+
+static int sock = -1;
+static struct subscription subscriptions[UEVENT_HANDLERS_MAX];
+static char event_buf[UEVENT_BUF_SIZE];
+
+int uevent_subscribe(const char *subsystem, uevent_handler handler) {
+	unsigned int i = 0;
+
+	if (sock == -1)
+		return -1;
+	for (i = 0; i < UEVENT_HANDLERS_MAX; i++) {
+		if (subscriptions[i].handler != NULL)
+			continue;
+		subscriptions[i].subsystem = subsystem;
+		subscriptions[i].handler = handler;
+		clog(LOG_DEBUG, "listening to %s uevents.\n", subsystem);
+		return 0;
+	}
+	clog(LOG_ERR, "no uevent handler left for %s\n", subsystem);
+	return -1;
+}
+
+void uevent_unsubscribe(uevent_handler handler) {
+	unsigned int i = 0;
+
+	for (i = 0; i < UEVENT_HANDLERS_MAX; i++) {
+		if (subscriptions[i].handler == handler) {
+			subscriptions[i].handler = NULL;
+			subscriptions[i].subsystem = NULL;
+		}
+	}
+}
+
+const char *uevent_get(const struct uevent *ev, const char *key) {
+	const char *s = ev->env;
+	size_t len = strlen(key);
+
+	while (s < ev->env + ev->env_len) {
+		if (strncmp(s, key, len) == 0 && s[len] == '=')
+			return s + len + 1;
+		s += strlen(s) + 1;
+	}
+	return NULL;
+}
+
+/* everything has to be read again */
+static int lost(void) {
+	unsigned int i = 0;
+	int wake = 0;
+
+	for (i = 0; i < UEVENT_HANDLERS_MAX; i++) {
+		if (subscriptions[i].handler != NULL)
+			wake |= subscriptions[i].handler(NULL);
+	}
+	return wake;
+}
+
+static int dispatch(char *msg, size_t len) {
+	struct uevent ev;
+	char *at = NULL;
+	size_t hlen = strnlen(msg, len);
+	unsigned int i = 0;
+	int wake = 0;
+
+	if (hlen == len || (at = strchr(msg, '@')) == NULL)
+		return 0;
+	ev.env = msg + hlen + 1;
+	ev.env_len = len - hlen - 1;
+	if ((ev.subsystem = uevent_get(&ev, "SUBSYSTEM")) == NULL)
+		return 0;
+	*at = '\0';
+	ev.action = msg;
+	ev.devpath = at + 1;
+
+	for (i = 0; i < UEVENT_HANDLERS_MAX; i++) {
+		if (subscriptions[i].handler != NULL
+				&& strcmp(subscriptions[i].subsystem, ev.subsystem) == 0)
+			wake |= subscriptions[i].handler(&ev);
+	}
+	return wake;
+}
+
+int uevent_read(void) {
+	struct sockaddr_nl snl;
+	struct iovec iov = { .iov_base = event_buf, .iov_len = UEVENT_BUF_SIZE - 1 };
+	struct msghdr msg;
+	ssize_t len = 0;
+	int wake = 0;
+
+	if (sock == -1)
+		return 0;
+	for (;;) {
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_name = &snl;
+		msg.msg_namelen = sizeof(snl);
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+
+		len = recvmsg(sock, &msg, MSG_DONTWAIT);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == ENOBUFS) {
+				clog(LOG_NOTICE, "uevents lost, rereading everything.\n");
+				wake |= lost();
+				continue;
+			}
+			if (errno != EAGAIN)
+				clog(LOG_ERR, "Error reading uevents (%s).\n",
+						strerror(errno));
+			break;
+		}
+		/* only trust the kernel */
+		if (snl.nl_pid != 0 || len == 0)
+			continue;
+		event_buf[len] = '\0';
+		wake |= dispatch(event_buf, (size_t)len);
+	}
+	return wake;
+}
+
+int uevent_fd(void) {
+	return sock;
+}
+
+int uevent_init(void) {
+	struct sockaddr_nl snl;
+	int size = UEVENT_RCVBUF_SIZE;
+
+	sock = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+			NETLINK_KOBJECT_UEVENT);
+	if (sock == -1) {
+		clog(LOG_NOTICE, "Couldn't open uevent socket (%s).\n",
+				strerror(errno));
+		return -1;
+	}
+
+	memset(&snl, 0, sizeof(snl));
+	snl.nl_family = AF_NETLINK;
+	snl.nl_groups = 1; /* kernel events */
+	if (bind(sock, (struct sockaddr *)&snl, sizeof(snl)) == -1) {
+		clog(LOG_NOTICE, "Couldn't bind uevent socket (%s).\n",
+				strerror(errno));
+		close(sock);
+		sock = -1;
+		return -1;
+	}
+	/* events come in bursts on suspend/resume or when docking */
+	if (setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &size,
+				sizeof(size)) == -1)
+		setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	return 0;
+}
+
+void uevent_exit(void) {
+	if (sock != -1)
+		close(sock);
+	sock = -1;
+	memset(subscriptions, 0, sizeof(subscriptions));
+}
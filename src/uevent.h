@@ -0,0 +1,65 @@
+/*
+ *  Copyright (C) 2002-2008  Mattia Dongili <malattia@linux.it>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __UEVENT_H__
+#define __UEVENT_H__ 1
+
+#include <stddef.h>
+
+/*
+ *  Kernel uevents (NETLINK_KOBJECT_UEVENT) exported by the core cpufreqd
+ *  to plugins. A single socket is shared, it is part of the main loop
+ *  pselect() set and drained there: events are handed to the handlers
+ *  of their subsystem, the others are dropped. A Rule pass is only run
+ *  if a handler asks for it.
+ */
+#define UEVENT_HANDLERS_MAX	4
+
+/* The message is "action@devpath\0KEY=VALUE\0KEY=VALUE\0..." */
+struct uevent {
+	const char *action;
+	const char *devpath;
+	const char *subsystem;
+	const char *env;	/* KEY=VALUE\0 pairs */
+	size_t env_len;
+};
+
+/* Called with a NULL event when some were lost, everything should be
+ * read again. Returns 1 if the Rules need to be evaluated again.
+ */
+typedef int (*uevent_handler)(const struct uevent *ev);
+
+/* Returns -1 if uevents are not available or no slot is left */
+int uevent_subscribe(const char *subsystem, uevent_handler handler);
+/* drops every subscription of handler */
+void uevent_unsubscribe(uevent_handler handler);
+/* the value of key in the event environment, NULL if missing */
+const char *uevent_get(const struct uevent *ev, const char *key);
+
+/*
+ *  Core cpufreqd only
+ */
+/* to be called after daemonizing */
+int uevent_init(void);
+void uevent_exit(void);
+/* the socket to wait on, -1 if none */
+int uevent_fd(void);
+/* drains the pending events, returns 1 if a Rule pass is needed */
+int uevent_read(void);
+
+#endif
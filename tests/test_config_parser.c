@@ -44,6 +44,92 @@ START_TEST(test_strip_comments_line)
 }
 END_TEST
 
+START_TEST(test_normalize_frequency)
+{
+	struct cpufreq_available_frequencies f[4] = {
+		{ 1600000, &f[1], NULL },
+		{ 800000, &f[2], NULL },
+		{ 2400000, &f[3], NULL },
+		{ 1600000, NULL, NULL },
+	};
+	struct cpufreq_limits limits = { 800000, 2400000 };
+	struct freq_table *t = freq_table_new(f);
+
+	ck_assert_uint_eq(t->count, 3);
+	ck_assert_uint_eq(freq_table_min(t), 800000);
+	ck_assert_uint_eq(freq_table_max(t), 2400000);
+	ck_assert_uint_eq(normalize_frequency(&limits, t, 1000000), 800000);
+	ck_assert_uint_eq(normalize_frequency(&limits, t, 1200000), 1600000);
+	ck_assert_uint_eq(normalize_frequency(&limits, t, 2100000), 2400000);
+	ck_assert_uint_eq(normalize_frequency(&limits, t, 3000000), 2400000);
+	ck_assert_uint_eq(normalize_frequency(NULL, t, 100000), 800000);
+	ck_assert_uint_eq(percent_to_absolute(2400000, 50), 1200000);
+	ck_assert_uint_eq(percent_to_absolute(2400000, 100), 2400000);
+	ck_assert_uint_eq(percent_to_absolute(2400099, 33), 792032);
+	ck_assert_uint_eq(get_min_available_freq(f), 800000);
+	freq_table_put(t);
+}
+END_TEST
+
+static struct NODE *new_profile(struct LIST *l, const char *name, const char *source)
+{
+	struct NODE *n = node_new(NULL, sizeof(struct profile));
+	struct profile *p = (struct profile *)n->content;
+
+	snprintf(p->name, MAX_STRING_LEN, "%s", name);
+	p->source = strdup(source);
+	list_append(l, n);
+	return n;
+}
+
+static struct NODE *new_rule(struct LIST *l, const char *name, const char *source,
+		struct profile *p)
+{
+	struct NODE *n = node_new(NULL, sizeof(struct rule));
+	struct rule *r = (struct rule *)n->content;
+
+	snprintf(r->name, MAX_STRING_LEN, "%s", name);
+	r->source = strdup(source);
+	r->prof = calloc(1, sizeof(struct profile *));
+	r->prof[0] = p;
+	r->assigned_cpus = cpumask_new(1);
+	list_append(l, n);
+	return n;
+}
+
+START_TEST(test_swap_configuration)
+{
+	struct cpufreqd_conf config, *new = calloc(1, sizeof(struct cpufreqd_conf));
+	struct NODE *a = NULL, *b = NULL, *a1 = NULL, *b1 = NULL, *r = NULL, *r1 = NULL;
+
+	memset(&config, 0, sizeof(struct cpufreqd_conf));
+	cpufreqd_info->cpus = 1;
+	a = new_profile(&config.profiles, "a", "name=a\n");
+	b = new_profile(&config.profiles, "b", "name=b\n");
+	r = new_rule(&config.rules, "r", "name=r\n", a->content);
+	a1 = new_profile(&new->profiles, "a", "name=a\n");
+	b1 = new_profile(&new->profiles, "b", "name=b\nminfreq=0\n");
+	r1 = new_rule(&new->rules, "r", "name=r\n", a1->content);
+	new->ramp_step = 2;
+
+	swap_configuration(&config, new);
+	/* unchanged ones kept, in the new order */
+	ck_assert_ptr_eq(config.profiles.first, a);
+	ck_assert_ptr_eq(config.profiles.last, b1);
+	ck_assert_ptr_eq(config.rules.first, r);
+	ck_assert_ptr_eq(config.rules.last, r);
+	ck_assert_ptr_eq(((struct rule *)r->content)->prof[0], a->content);
+	/* the replaced and duplicate ones go away */
+	ck_assert_ptr_eq(new->profiles.first, a1);
+	ck_assert_ptr_eq(new->profiles.last, b);
+	ck_assert_ptr_eq(new->rules.first, r1);
+	ck_assert_uint_eq(config.ramp_step, 2);
+	discard_configuration(new);
+	free_rules_profiles(&config);
+	cpufreqd_info->cpus = 0;
+}
+END_TEST
+
 /* test suite boilerplate */
 
 Suite * cpufreqd_suite(void)
@@ -58,6 +144,8 @@ Suite * cpufreqd_suite(void)
 
     tcase_add_test(tc_core, test_clean_config_line);
     tcase_add_test(tc_core, test_strip_comments_line);
+    tcase_add_test(tc_core, test_normalize_frequency);
+    tcase_add_test(tc_core, test_swap_configuration);
     suite_add_tcase(s, tc_core);
 
     return s;
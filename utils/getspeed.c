@@ -4,6 +4,7 @@
 #include <poll.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -11,24 +12,54 @@
 #include <sys/time.h>
 #include <sys/un.h>
 #include "cpufreqd_remote.h"
+#include "cpumask.h"
 
 static int cpufreqd_dirs(const struct dirent *d) {
 	return (strncmp(d->d_name, "cpufreqd-", 9) == 0);
 }
 
+static void print_range(int first, int last, int *count) {
+	printf("%s%d", (*count)++ > 0 ? ", " : "", first);
+	if (last > first)
+		printf("-%d", last);
+}
+
+/* pretty print active cpus, consecutive ones as ranges */
+static void print_cpus(const struct cpumask *cpus) {
+	int cpu = 0, first = -1, last = -1, count = 0;
+
+	if (cpumask_weight(cpus) == 0)
+		return;
+	printf("Active on CPU#:\t");
+	cpumask_for_each(cpu, cpus) {
+		if (first >= 0 && cpu == last + 1) {
+			last = cpu;
+			continue;
+		}
+		if (first >= 0)
+			print_range(first, last, &count);
+		first = last = cpu;
+	}
+	print_range(first, last, &count);
+	printf("\n");
+}
+
 int main(int argc, char *argv[])
 {
 	int sock;
 	struct dirent **namelist = NULL;
 	struct sockaddr_un sck;
 	struct stat st;
+	struct cpumask *active = NULL;
+	FILE *fp = NULL;
+	char *line = NULL;
+	size_t line_len = 0;
 	time_t last_mtime = 0;
 	unsigned int cmd = 0;
 	unsigned int full_cmd = 0;
-	unsigned int i = 0;
 	char buf[4096] = {0}, name[256] = {0}, policy[255] = {0};
-	char *in;
-	int min, max, active, n;
+	const char *in;
+	int min, max, cpu, n;
 
 	if (argc == 2 && !strcmp(argv[1], "-l"))
 		cmd = CMD_CUR_PROFILES;
@@ -91,43 +122,39 @@ int main(int argc, char *argv[])
 	if (write(sock, &full_cmd, 4) != 4)
 		perror("write()");
 
+	if ((fp = fdopen(sock, "r")) == NULL) {
+		perror("fdopen()");
+		close(sock);
+		return 1;
+	}
+
 	n = 0;
-	while (read(sock, buf, 4096)) {
-		int is_active = 0;
-		in = buf;
-		while (cmd == CMD_LIST_PROFILES 
-				&& sscanf(in, "%d/%[^/]/%d/%d/%[^\n]\n", &active, name, &min, &max, policy) == 5) {
-			printf("\nName (#%d):\t%s\n", ++n, name);
-			/* pretty print active cpus */
-			is_active = 0;
-			for (i = 0; i < sizeof(active); i++) {
-				if (active & (1 << i)) {
-					if (is_active == 0)
-						printf("Active on CPU#:\t");
-					else if (is_active > 0)
-						printf(", ");
-					printf("%d", i);
-					is_active++;
-				}
+	while (getline(&line, &line_len, fp) > 0) {
+		if (cmd == CMD_LIST_PROFILES) {
+			active = cpumask_parse(line, &in);
+			if (active == NULL || sscanf(in, "/%255[^/]/%d/%d/%254[^\n]\n",
+						name, &min, &max, policy) != 4) {
+				cpumask_free(active);
+				continue;
 			}
-			if (is_active)
-				printf("\n");
+			printf("\nName (#%d):\t%s\n", ++n, name);
+			print_cpus(active);
+			cpumask_free(active);
 
 			printf("Governor:\t%s\n", policy);
 			printf("Min freq:\t%d\n", min);
 			printf("Max freq:\t%d\n", max);
-			in = strchr(in, '\n') + 1;
 		}
-
-		while (cmd == CMD_CUR_PROFILES
-				&& sscanf(in, "%d/%[^/]/%d/%d/%[^\n]\n", &active, name, &min, &max, policy) == 5) {
-			printf("\nCPU#%d: \"%s\" ", active, name);
+		else if (cmd == CMD_CUR_PROFILES
+				&& sscanf(line, "%d/%255[^/]/%d/%d/%254[^\n]\n",
+					&cpu, name, &min, &max, policy) == 5) {
+			printf("\nCPU#%d: \"%s\" ", cpu, name);
 			printf("%s %d-%d\n", policy, min, max);
-			in = strchr(in, '\n') + 1;
 		}
 	}
 
-	close(sock);
+	free(line);
+	fclose(fp);
 
 	return 0;
 }